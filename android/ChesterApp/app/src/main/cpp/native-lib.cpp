@@ -25,7 +25,7 @@ bool button_down;
 bool button_left;
 bool button_right;
 
-static int keysCb(keys* k)
+static int keysCb(void*, keys* k)
 {
     k->a = button_a;
     k->b = button_b;
@@ -41,25 +41,25 @@ static int keysCb(keys* k)
             button_up || button_down || button_left || button_right;
 }
 
-static uint32_t ticksCb()
+static uint32_t ticksCb(void*)
 {
     struct timespec res;
     clock_gettime(CLOCK_MONOTONIC, &res);
     return static_cast<uint32_t>(1000.0 * res.tv_sec + (double) res.tv_nsec / 1e6);
 }
 
-static void delayCb(uint32_t ms)
+static void delayCb(void*, uint32_t ms)
 {
     usleep(ms * 1000);
 }
 
-static bool initGpuCb(gpu* g)
+static bool initGpuCb(void*, gpu* g)
 {
     g->pixel_data = malloc(buffer_size);
     return true;
 }
 
-static void uninitGpuCb(gpu* g)
+static void uninitGpuCb(void*, gpu* g)
 {
     if (g->pixel_data) {
         free(g->pixel_data);
@@ -67,7 +67,7 @@ static void uninitGpuCb(gpu* g)
     }
 }
 
-static bool initPixelData(gpu* g)
+static bool initPixelData(void*, gpu* g)
 {
     // Buffer allocated in initGpuCb can be reused
     assert (g->pixel_data);
@@ -75,7 +75,7 @@ static bool initPixelData(gpu* g)
     return true;
 }
 
-static void renderCb(gpu* g)
+static void renderCb(void*, gpu* g)
 {
     JNIEnv *env;
     jvm->AttachCurrentThread(&env, NULL);
@@ -94,14 +94,14 @@ Java_com_chester_chesterapp_MainActivity_initChester(
     jint rs = env->GetJavaVM(&jvm);
     assert (rs == JNI_OK);
 
-    register_delay_callback(&gChester, &delayCb);
-    register_keys_callback(&gChester, &keysCb);
-    register_get_ticks_callback(&gChester, &ticksCb);
-    register_gpu_init_callback(&gChester, &initGpuCb);
-    register_gpu_uninit_callback(&gChester, &uninitGpuCb);
-    register_gpu_alloc_image_buffer_callback(&gChester, &initPixelData);
-    register_gpu_render_callback(&gChester, &renderCb);
-    register_serial_callback(&gChester, NULL);
+    register_delay_callback(&gChester, &delayCb, NULL);
+    register_keys_callback(&gChester, &keysCb, NULL);
+    register_get_ticks_callback(&gChester, &ticksCb, NULL);
+    register_gpu_init_callback(&gChester, &initGpuCb, NULL);
+    register_gpu_uninit_callback(&gChester, &uninitGpuCb, NULL);
+    register_gpu_alloc_image_buffer_callback(&gChester, &initPixelData, NULL);
+    register_gpu_render_callback(&gChester, &renderCb, NULL);
+    register_serial_callback(&gChester, NULL, NULL);
 
     button_a = false;
     button_b = false;
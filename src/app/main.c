@@ -8,9 +8,7 @@
 #include <stdlib.h>
 
 bool done = false;
-#ifdef CGB
 bool toggle_color_correction = false;
-#endif
 
 #if defined(WIN32)
 #if defined(NDEBUG)
@@ -32,7 +30,7 @@ struct sdl_graphics_s {
 
 typedef struct sdl_graphics_s sdl_graphics;
 
-bool init_graphics(gpu *g)
+bool init_graphics(void *context, gpu *g)
 {
   g->app_data = malloc(sizeof(sdl_graphics));
   sdl_graphics *sdl_graphics_ptr = (sdl_graphics*)g->app_data;
@@ -83,7 +81,7 @@ bool init_graphics(gpu *g)
   return true;
 }
 
-void uninit_graphics(gpu *g)
+void uninit_graphics(void *context, gpu *g)
 {
   if (g->app_data)
   {
@@ -106,7 +104,7 @@ void uninit_graphics(gpu *g)
   SDL_Quit();
 }
 
-bool lock_texture(gpu *g)
+bool lock_texture(void *context, gpu *g)
 {
   if (g->app_data)
   {
@@ -123,7 +121,7 @@ bool lock_texture(gpu *g)
   return true;
 }
 
-void render(gpu *g)
+void render(void *context, gpu *g)
 {
   if (g->app_data)
   {
@@ -147,7 +145,7 @@ void render(gpu *g)
   }
 }
 
-int keys_update(keys *k)
+int keys_update(void *context, keys *k)
 {
   SDL_Event event;
   int ret = 0;
@@ -221,11 +219,9 @@ int keys_update(keys *k)
       case SDLK_m:
         k->select = false;
         break;
-#ifdef CGB
       case SDLK_F4:
         toggle_color_correction = true;
         break;
-#endif
       default:
         break;
       }
@@ -236,12 +232,12 @@ int keys_update(keys *k)
   return ret;
 }
 
-uint32_t get_ticks(void)
+uint32_t get_ticks(void *context)
 {
   return SDL_GetTicks();
 }
 
-void delay(uint32_t ms)
+void delay(void *context, uint32_t ms)
 {
   SDL_Delay(ms);
 }
@@ -258,14 +254,14 @@ int main(int argc, char **argv)
       return 1;
     }
 
-  register_keys_callback(&chester, &keys_update);
-  register_get_ticks_callback(&chester, &get_ticks);
-  register_delay_callback(&chester, &delay);
-  register_gpu_init_callback(&chester, &init_graphics);
-  register_gpu_uninit_callback(&chester, &uninit_graphics);
-  register_gpu_alloc_image_buffer_callback(&chester, &lock_texture);
-  register_gpu_render_callback(&chester, &render);
-  register_serial_callback(&chester, NULL);
+  register_keys_callback(&chester, &keys_update, NULL);
+  register_get_ticks_callback(&chester, &get_ticks, NULL);
+  register_delay_callback(&chester, &delay, NULL);
+  register_gpu_init_callback(&chester, &init_graphics, NULL);
+  register_gpu_uninit_callback(&chester, &uninit_graphics, NULL);
+  register_gpu_alloc_image_buffer_callback(&chester, &lock_texture, NULL);
+  register_gpu_render_callback(&chester, &render, NULL);
+  register_serial_callback(&chester, NULL, NULL);
 
   if (!init(&chester, argv[1], NULL, bootloader_file))
     {
@@ -279,7 +275,7 @@ int main(int argc, char **argv)
 
   while (!done)
     {
-      const int ret = run(&chester);
+      const int ret = run_frame(&chester);
       if (ret)
         {
           // Only return error conditions, return 0
@@ -291,13 +287,11 @@ int main(int argc, char **argv)
           break;
         }
 
-#ifdef CGB
       if (toggle_color_correction)
         {
           toggle_color_correction = false;
           set_color_correction(&chester, !get_color_correction(&chester));
         }
-#endif
     }
 
   uninit(&chester);
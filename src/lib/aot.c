@@ -0,0 +1,43 @@
+#include "aot.h"
+
+#ifdef AOT
+
+#include <stddef.h>
+
+const aot_program *aot_find_program(const uint8_t *rom, const uint32_t size)
+{
+  const uint32_t hash = aot_rom_hash(rom, size);
+
+  for (const aot_program *const *program = aot_programs; *program; ++program)
+    {
+      if ((*program)->rom_size == size && (*program)->rom_hash == hash)
+        return *program;
+    }
+
+  return NULL;
+}
+
+aot_fn aot_find(const aot_program *program, const uint16_t pc, const uint16_t bank)
+{
+  const uint32_t key = (uint32_t)bank << 16 | pc;
+  uint32_t low = 0, high = program->count;
+
+  while (low < high)
+    {
+      const uint32_t middle = low + (high - low) / 2;
+      const aot_entry *entry = &program->entries[middle];
+      const uint32_t middle_key = (uint32_t)entry->bank << 16 | entry->pc;
+
+      if (middle_key == key)
+        return entry->fn;
+
+      if (middle_key < key)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "cpu.h"
+#include "jit.h"
+#include "mmu.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Code translated ahead of time by chester-recompile. A function runs
+// the recovered instructions from PC on, with the same checks as the run
+// loop after each of them.
+typedef int (*aot_fn)(registers *reg, memory *mem, block_batch *batch);
+
+// Function handling an instruction of a ROM bank
+struct aot_entry_s {
+  uint16_t bank;
+  uint16_t pc;
+  aot_fn fn;
+};
+
+typedef struct aot_entry_s aot_entry;
+
+// Entries are sorted on bank, then address
+struct aot_program_s {
+  uint32_t rom_hash;
+  uint32_t rom_size;
+  const aot_entry *entries;
+  uint32_t count;
+};
+
+typedef struct aot_program_s aot_program;
+
+// FNV-1a, identifies the ROM a program was translated from
+static inline uint32_t aot_rom_hash(const uint8_t *rom, const uint32_t size)
+{
+  uint32_t hash = 2166136261u;
+
+  for (uint32_t i = 0; i < size; ++i)
+    {
+      hash ^= rom[i];
+      hash *= 16777619u;
+    }
+
+  return hash;
+}
+
+#ifdef AOT
+
+// NULL terminated, generated at build time from the AOT_ROMS option
+extern const aot_program *const aot_programs[];
+
+const aot_program *aot_find_program(const uint8_t *rom, const uint32_t size);
+
+aot_fn aot_find(const aot_program *program, const uint16_t pc, const uint16_t bank);
+
+// Same as the end of cpu_execute() followed by the run loop checks.
+// Returns true when translated code has to return.
+static inline bool aot_end(registers *reg, memory *mem, block_batch *batch, const uint8_t cycles, const uint16_t next)
+{
+  if (cycles)
+    {
+      reg->clock.last.t = cycles;
+    }
+
+  reg->clock.last.t >>= reg->speed_shifter;
+
+  reg->clock.t += reg->clock.last.t;
+  reg->clock.m += reg->clock.last.t / 4;
+
+  if (reg->halt && mem->irq_pending)
+    {
+      reg->halt = false;
+    }
+
+  if (reg->ime && !reg->halt)
+    {
+      cpu_check_interrupts(reg, mem);
+    }
+
+  *batch->cycles += reg->clock.last.t;
+
+  return *batch->cycles >= batch->deadline || *batch->synced ||
+    reg->stop || reg->halt || reg->pc != next ||
+    mem->code_generation != batch->generation;
+}
+
+#endif
+
+#endif // AOT_H
@@ -0,0 +1,400 @@
+// For pinning threads to cores
+#define _GNU_SOURCE
+
+#include "batch.h"
+
+#ifdef BATCH_ENABLED
+
+#include "logger.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct batch_slot_s {
+  chester_batch *batch;
+  unsigned int index;
+  keys input;
+  int ret;
+};
+
+typedef struct batch_slot_s batch_slot;
+
+// Each worker starts with a range of instances and then steals from the
+// ranges of the others, next is shared by everybody taking from it
+struct batch_worker_s {
+  chester_batch *batch;
+  pthread_t thread;
+  unsigned int index;
+  unsigned int begin, end;
+  atomic_uint next;
+};
+
+typedef struct batch_worker_s batch_worker;
+
+struct chester_batch_s {
+  chester *instances;
+  batch_slot *slots;
+  unsigned int size;
+
+  uint8_t *frames;
+  uint8_t *ram;
+
+  // Worker 0 is the thread calling chester_batch_step()
+  batch_worker *workers;
+  unsigned int worker_count;
+  unsigned int cores;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start, done;
+  unsigned int generation;
+  unsigned int running;
+  bool quit;
+
+  // Work of the current step
+  const keys *inputs;
+  unsigned int step_frames;
+
+  batch_latency latency;
+};
+
+static int batch_keys(void *context, keys *k)
+{
+  const batch_slot *slot = context;
+
+  *k = slot->input;
+
+  return k->up || k->down || k->left || k->right ||
+    k->a || k->b || k->start || k->select;
+}
+
+static uint32_t batch_get_ticks(void *context)
+{
+  return 0;
+}
+
+static void batch_delay(void *context, uint32_t ms)
+{
+}
+
+static bool batch_gpu_init(void *context, gpu *g)
+{
+  const batch_slot *slot = context;
+
+  // Steps end right after a frame is rendered, so the instance can draw
+  // straight to its frame
+  g->pixel_data = slot->batch->frames + (size_t)slot->index * BATCH_FRAME_SIZE;
+
+  return true;
+}
+
+static void batch_gpu_uninit(void *context, gpu *g)
+{
+  g->pixel_data = NULL;
+}
+
+static bool batch_gpu_alloc_image_buffer(void *context, gpu *g)
+{
+  // Buffer set in batch_gpu_init() is kept
+  return true;
+}
+
+static void batch_gpu_render(void *context, gpu *g)
+{
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+}
+
+static void pin_to_core(const unsigned int core)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+    {
+      gb_log (WARNING, "Could not pin batch worker to core %u", core);
+    }
+#else
+  (void)core;
+#endif
+}
+
+static void step_instance(chester_batch *b, const unsigned int index)
+{
+  batch_slot *slot = &b->slots[index];
+  chester *chester = &b->instances[index];
+
+  if (slot->ret)
+    return;
+
+  if (b->inputs)
+    slot->input = b->inputs[index];
+
+  for (unsigned int frame = 0; frame < b->step_frames && !slot->ret; ++frame)
+    slot->ret = run_frame(chester);
+
+  // Work RAM is always mapped, a page at a time
+  uint8_t *ram = b->ram + (size_t)index * BATCH_RAM_SIZE;
+  for (unsigned int page = 0; page < (BATCH_RAM_SIZE >> MEM_PAGE_SHIFT); ++page)
+    {
+      memcpy(ram + (page << MEM_PAGE_SHIFT),
+             chester->mem.read_map[(BATCH_RAM_ADDR >> MEM_PAGE_SHIFT) + page],
+             1 << MEM_PAGE_SHIFT);
+    }
+}
+
+static void run_jobs(chester_batch *b, batch_worker *w)
+{
+  unsigned int index;
+
+  for (unsigned int i = 0; i < b->worker_count; ++i)
+    {
+      batch_worker *victim = &b->workers[(w->index + i) % b->worker_count];
+
+      while ((index = atomic_fetch_add(&victim->next, 1)) < victim->end)
+        {
+          step_instance(b, index);
+        }
+    }
+}
+
+static void *worker_main(void *data)
+{
+  batch_worker *w = data;
+  chester_batch *b = w->batch;
+  unsigned int generation = 0;
+
+  pin_to_core(w->index % b->cores);
+
+  pthread_mutex_lock(&b->lock);
+
+  for (;;)
+    {
+      while (b->generation == generation && !b->quit)
+        pthread_cond_wait(&b->start, &b->lock);
+
+      if (b->quit)
+        break;
+
+      generation = b->generation;
+      pthread_mutex_unlock(&b->lock);
+
+      run_jobs(b, w);
+
+      pthread_mutex_lock(&b->lock);
+      if (--b->running == 0)
+        pthread_cond_signal(&b->done);
+    }
+
+  pthread_mutex_unlock(&b->lock);
+
+  return NULL;
+}
+
+chester_batch *chester_batch_create(const char *rom, unsigned int instances, unsigned int workers)
+{
+  chester_batch *b = calloc(1, sizeof(chester_batch));
+
+  if (!b || !instances)
+    {
+      free(b);
+      return NULL;
+    }
+
+  const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  b->cores = cores > 0 ? (unsigned int)cores : 1;
+
+  if (!workers)
+    workers = b->cores;
+  if (workers > instances)
+    workers = instances;
+
+  b->instances = calloc(instances, sizeof(chester));
+  b->slots = calloc(instances, sizeof(batch_slot));
+  b->frames = calloc(instances, BATCH_FRAME_SIZE);
+  b->ram = calloc(instances, BATCH_RAM_SIZE);
+  b->workers = calloc(workers, sizeof(batch_worker));
+
+  if (!b->instances || !b->slots || !b->frames || !b->ram || !b->workers)
+    {
+      chester_batch_destroy(b);
+      return NULL;
+    }
+
+  b->latency.min_ns = UINT64_MAX;
+
+  for (unsigned int i = 0; i < instances; ++i)
+    {
+      batch_slot *slot = &b->slots[i];
+      chester *chester = &b->instances[i];
+
+      slot->batch = b;
+      slot->index = i;
+
+      register_keys_callback(chester, batch_keys, slot);
+      register_get_ticks_callback(chester, batch_get_ticks, slot);
+      register_delay_callback(chester, batch_delay, slot);
+      register_gpu_init_callback(chester, batch_gpu_init, slot);
+      register_gpu_uninit_callback(chester, batch_gpu_uninit, slot);
+      register_gpu_alloc_image_buffer_callback(chester, batch_gpu_alloc_image_buffer, slot);
+      register_gpu_render_callback(chester, batch_gpu_render, slot);
+      register_serial_callback(chester, NULL, NULL);
+
+      // Counted before init so that a failed instance gets cleaned up
+      b->size = i + 1;
+
+      if (!init(chester, rom, NULL, NULL))
+        {
+          gb_log (ERROR, "Could not create batch instance %u", i);
+          chester_batch_destroy(b);
+          return NULL;
+        }
+
+      chester->save_supported = false;
+    }
+
+  pthread_mutex_init(&b->lock, NULL);
+  pthread_cond_init(&b->start, NULL);
+  pthread_cond_init(&b->done, NULL);
+
+  for (unsigned int i = 0; i < workers; ++i)
+    {
+      batch_worker *w = &b->workers[i];
+
+      w->batch = b;
+      w->index = i;
+      atomic_init(&w->next, 0);
+
+      if (i && pthread_create(&w->thread, NULL, worker_main, w))
+        {
+          gb_log (WARNING, "Could not start batch worker %u", i);
+          break;
+        }
+
+      b->worker_count = i + 1;
+    }
+
+  // Workers only look at their ranges once stepping
+  for (unsigned int i = 0; i < b->worker_count; ++i)
+    {
+      batch_worker *w = &b->workers[i];
+
+      w->begin = (unsigned int)((uint64_t)instances * i / b->worker_count);
+      w->end = (unsigned int)((uint64_t)instances * (i + 1) / b->worker_count);
+    }
+
+  return b;
+}
+
+void chester_batch_destroy(chester_batch *b)
+{
+  if (!b)
+    return;
+
+  if (b->worker_count)
+    {
+      pthread_mutex_lock(&b->lock);
+      b->quit = true;
+      pthread_cond_broadcast(&b->start);
+      pthread_mutex_unlock(&b->lock);
+
+      for (unsigned int i = 1; i < b->worker_count; ++i)
+        pthread_join(b->workers[i].thread, NULL);
+
+      pthread_cond_destroy(&b->done);
+      pthread_cond_destroy(&b->start);
+      pthread_mutex_destroy(&b->lock);
+    }
+
+  for (unsigned int i = 0; i < b->size; ++i)
+    {
+      uninit(&b->instances[i]);
+    }
+
+  free(b->workers);
+  free(b->ram);
+  free(b->frames);
+  free(b->slots);
+  free(b->instances);
+  free(b);
+}
+
+unsigned int chester_batch_size(chester_batch *b)
+{
+  return b->size;
+}
+
+int chester_batch_step(chester_batch *b, const keys *inputs, const unsigned int frames)
+{
+  const uint64_t start = now_ns();
+
+  b->inputs = inputs;
+  b->step_frames = frames;
+
+  for (unsigned int i = 0; i < b->worker_count; ++i)
+    atomic_store(&b->workers[i].next, b->workers[i].begin);
+
+  pthread_mutex_lock(&b->lock);
+  b->running = b->worker_count - 1;
+  ++b->generation;
+  pthread_cond_broadcast(&b->start);
+  pthread_mutex_unlock(&b->lock);
+
+  run_jobs(b, &b->workers[0]);
+
+  pthread_mutex_lock(&b->lock);
+  while (b->running)
+    pthread_cond_wait(&b->done, &b->lock);
+  pthread_mutex_unlock(&b->lock);
+
+  const uint64_t latency = now_ns() - start;
+
+  b->latency.last_ns = latency;
+  b->latency.total_ns += latency;
+  if (latency < b->latency.min_ns)
+    b->latency.min_ns = latency;
+  if (latency > b->latency.max_ns)
+    b->latency.max_ns = latency;
+  ++b->latency.batches;
+
+  for (unsigned int i = 0; i < b->size; ++i)
+    {
+      if (b->slots[i].ret)
+        return b->slots[i].ret;
+    }
+
+  return 0;
+}
+
+const uint8_t *chester_batch_frames(chester_batch *b)
+{
+  return b->frames;
+}
+
+const uint8_t *chester_batch_ram(chester_batch *b)
+{
+  return b->ram;
+}
+
+chester *chester_batch_instance(chester_batch *b, const unsigned int index)
+{
+  return &b->instances[index];
+}
+
+batch_latency chester_batch_get_latency(chester_batch *b)
+{
+  return b->latency;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "chester.h"
+
+#include <stdint.h>
+
+#if defined(BATCH) && !defined(_WIN32)
+#define BATCH_ENABLED
+#endif
+
+#ifdef BATCH_ENABLED
+
+// Each instance has a frame of Y_RES lines in chester_batch_frames(),
+// laid out like the image buffer of a single instance: lines of 256
+// pixels of which the first X_RES are visible
+#define BATCH_FRAME_PITCH (256 * 4)
+#define BATCH_FRAME_SIZE (BATCH_FRAME_PITCH * Y_RES)
+
+// Each instance has a copy of work RAM as seen at 0xC000-0xDFFF in
+// chester_batch_ram()
+#define BATCH_RAM_ADDR 0xC000
+#define BATCH_RAM_SIZE 0x2000
+
+// Wall clock time taken by chester_batch_step()
+struct batch_latency_s {
+  uint64_t last_ns, min_ns, max_ns, total_ns;
+  uint64_t batches;
+};
+
+typedef struct batch_latency_s batch_latency;
+
+typedef struct chester_batch_s chester_batch;
+
+// Creates instances of the ROM stepped together by a pool of workers, one
+// per core if workers is 0. Workers are pinned to cores where supported.
+// Battery RAM isn't saved. Returns NULL if an instance couldn't be created.
+chester_batch *chester_batch_create(const char *rom, unsigned int instances, unsigned int workers);
+
+void chester_batch_destroy(chester_batch *b);
+
+unsigned int chester_batch_size(chester_batch *b);
+
+// Sets the keys of every instance, inputs has an entry for each of them
+// or is NULL to keep the previous ones, and runs them all for the given
+// number of frames. Frames and RAM are updated for every instance. An
+// instance which failed isn't run any more, the error of the first one
+// is returned, 0 if there were none.
+int chester_batch_step(chester_batch *b, const keys *inputs, const unsigned int frames);
+
+// Frame rendered last by each instance, BATCH_FRAME_SIZE bytes apart
+const uint8_t *chester_batch_frames(chester_batch *b);
+
+// Work RAM of each instance, BATCH_RAM_SIZE bytes apart
+const uint8_t *chester_batch_ram(chester_batch *b);
+
+// Instance for inspecting it between steps
+chester *chester_batch_instance(chester_batch *b, const unsigned int index);
+
+batch_latency chester_batch_get_latency(chester_batch *b);
+
+#endif
+
+#endif // BATCH_H
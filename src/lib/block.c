@@ -0,0 +1,316 @@
+#include "block.h"
+
+#include <string.h>
+
+void block_cache_init(block_cache *cache)
+{
+#ifdef AOT
+  cache->program = NULL;
+#endif
+#ifdef JIT_ENABLED
+  jit_init(&cache->jit);
+#endif
+
+  block_cache_reset(cache);
+}
+
+void block_cache_uninit(block_cache *cache)
+{
+#ifdef JIT_ENABLED
+  jit_uninit(&cache->jit);
+#else
+  (void)cache;
+#endif
+}
+
+void block_cache_reset(block_cache *cache)
+{
+  for (unsigned int i = 0; i < BLOCK_CACHE_SIZE; ++i)
+    cache->blocks[i].length = 0;
+
+  cache->next = NULL;
+  cache->end = NULL;
+  cache->generation = 0;
+#if defined(AOT) || defined(JIT_ENABLED)
+  cache->current = NULL;
+#endif
+}
+
+static bool ends_block(const uint8_t code)
+{
+  switch (code)
+    {
+    case 0x10: // STOP
+    case 0x18: // JR n
+    case 0x76: // HALT
+    case 0xC3: // JP nn
+    case 0xC9: // RET
+    case 0xD9: // RETI
+    case 0xE9: // JP (HL)
+      return true;
+    default:
+      return false;
+    }
+}
+
+// Finds where code at an address comes from. Returns false for memory
+// which is not worth caching, like VRAM or cartridge RAM.
+static bool get_code_source(memory *mem, const uint16_t pc, uint16_t *bank, uint16_t *limit, bool *ram)
+{
+  *ram = false;
+  *bank = 0;
+
+  switch (pc & 0xF000)
+    {
+    case 0x0000:
+      if (mem->bootloader_running && pc < 0x0100)
+        return false;
+      // Intentional fall through
+    case 0x1000:
+    case 0x2000:
+    case 0x3000:
+      *limit = 0x4000;
+      return true;
+    case 0x4000:
+    case 0x5000:
+    case 0x6000:
+    case 0x7000:
+      *bank = mem->banks.rom.selected;
+      *limit = 0x8000;
+      return true;
+    case 0xC000:
+      *ram = true;
+      *limit = 0xD000;
+      return true;
+    case 0xD000:
+      if (mem->cgb_mode)
+        *bank = mem->high_empty[MEM_SVBK_ADDR - MEM_HIGH_EMPTY_START_ADDR];
+      *ram = true;
+      *limit = 0xE000;
+      return true;
+    case 0xF000:
+      if (pc >= 0xFF80)
+        {
+          *ram = true;
+          *limit = 0xFFFF;
+          return true;
+        }
+      return false;
+    default:
+      return false;
+    }
+}
+
+static block *decode(block *b, memory *mem, const uint16_t pc, const uint16_t bank, const uint16_t limit, const bool ram)
+{
+  unsigned int address = pc;
+
+  b->pc = pc;
+  b->bank = bank;
+  b->generation = mem->code_generation;
+  b->ram = ram;
+  b->length = 0;
+#ifdef JIT_ENABLED
+  b->native = NULL;
+  b->hits = 0;
+#endif
+
+  while (b->length < BLOCK_MAX_LENGTH)
+    {
+      const uint8_t code = mmu_read_byte(mem, (uint16_t)address);
+      const opcode *op = &cpu_opcodes[code];
+      const uint8_t length = cpu_instruction_length(op);
+
+      // Operands beyond the limit come from elsewhere
+      if (address + length > limit)
+        break;
+
+      block_op *o = &b->ops[b->length++];
+      o->op = op;
+      o->pc = (uint16_t)address;
+      o->length = length;
+
+      switch (op->operand)
+        {
+        case OPERAND_D8:
+        case OPERAND_S8:
+          o->operand = mmu_read_byte(mem, (uint16_t)(address + 1));
+          break;
+        case OPERAND_D16:
+          o->operand = mmu_read_word(mem, (uint16_t)(address + 1));
+          break;
+        default:
+          o->operand = 0;
+          break;
+        }
+
+      address += length;
+
+      if (ends_block(code))
+        break;
+    }
+
+  if (!b->length)
+    return NULL;
+
+  if (ram)
+    mmu_mark_code(mem, pc, (uint16_t)(address - 1));
+
+  return b;
+}
+
+static block *lookup(block_cache *cache, memory *mem, const uint16_t pc)
+{
+  uint16_t bank, limit;
+  bool ram;
+
+  if (!get_code_source(mem, pc, &bank, &limit, &ram))
+    return NULL;
+
+  block *b = &cache->blocks[(pc ^ (bank << 6)) & (BLOCK_CACHE_SIZE - 1)];
+
+  if (!b->length || b->pc != pc || b->bank != bank || b->ram != ram ||
+      (ram && b->generation != mem->code_generation))
+    {
+      if (!decode(b, mem, pc, bank, limit, ram))
+        return NULL;
+
+#ifdef AOT
+      b->translated = cache->program && !ram ? aot_find(cache->program, pc, bank) : NULL;
+#endif
+    }
+
+  cache->next = b->ops;
+  cache->end = b->ops + b->length;
+  cache->generation = mem->code_generation;
+#if defined(AOT) || defined(JIT_ENABLED)
+  cache->current = b;
+#endif
+
+  return b;
+}
+
+static inline bool cursor_valid(block_cache *cache, registers *reg, memory *mem)
+{
+  return cache->next != cache->end && cache->next->pc == reg->pc &&
+    cache->generation == mem->code_generation;
+}
+
+int block_next_command(block_cache *cache, registers *reg, memory *mem)
+{
+  if (reg->stop || reg->halt)
+    return cpu_next_command(reg, mem);
+
+  if (!cursor_valid(cache, reg, mem) && !lookup(cache, mem, reg->pc))
+    {
+      cache->next = cache->end = NULL;
+      return cpu_next_command(reg, mem);
+    }
+
+  const block_op *op = cache->next++;
+
+  return cpu_execute(reg, mem, op->op, op->operand, op->length);
+}
+
+#ifdef JIT_ENABLED
+// Compiled code for a block, if it is hot enough
+static jit_fn native_code(block_cache *cache, block *b)
+{
+  if (b->native && b->native_generation == cache->jit.generation)
+    return b->native;
+
+  if (++b->hits < JIT_THRESHOLD)
+    return NULL;
+
+  b->native = jit_compile(&cache->jit, b->ops, b->length, b->entries);
+  b->native_generation = cache->jit.generation;
+
+  return b->native;
+}
+
+static int run_native(block_cache *cache, registers *reg, memory *mem, block_batch *batch)
+{
+  block *b = cache->current;
+  jit_fn native;
+
+  if (!cursor_valid(cache, reg, mem) && !(b = lookup(cache, mem, reg->pc)))
+    return -1;
+
+  if (!(native = native_code(cache, b)))
+    return -1;
+
+  batch->generation = mem->code_generation;
+
+  if (native(reg, mem, batch, (const uint8_t *)(void *)native + b->entries[cache->next - b->ops]))
+    return 1;
+
+  // Left before the end of the block, it is entered again from there
+  cache->next = cache->end;
+
+  if (cache->generation == mem->code_generation)
+    {
+      for (const block_op *op = b->ops; op != cache->end; ++op)
+        {
+          if (op->pc == reg->pc)
+            {
+              cache->next = op;
+              break;
+            }
+        }
+    }
+
+  return 0;
+}
+#endif
+
+#ifdef AOT
+// Code translated ahead of time is only entered at the start of blocks
+static int run_translated(block_cache *cache, registers *reg, memory *mem, block_batch *batch)
+{
+  block *b;
+
+  if (cursor_valid(cache, reg, mem) || !(b = lookup(cache, mem, reg->pc)) || !b->translated)
+    return -1;
+
+  batch->generation = mem->code_generation;
+
+  if (b->translated(reg, mem, batch))
+    return 1;
+
+  cache->next = cache->end;
+
+  return 0;
+}
+#endif
+
+int block_run(block_cache *cache, registers *reg, memory *mem, block_batch *batch)
+{
+  batch->pc = reg->pc;
+
+#ifdef AOT
+  if (cache->program && !reg->stop && !reg->halt)
+    {
+      const int ret = run_translated(cache, reg, mem, batch);
+
+      if (ret >= 0)
+        return ret;
+    }
+#endif
+
+#ifdef JIT_ENABLED
+  if (cache->jit.code && !reg->stop && !reg->halt)
+    {
+      const int ret = run_native(cache, reg, mem, batch);
+
+      if (ret >= 0)
+        return ret;
+    }
+#endif
+
+  if (block_next_command(cache, reg, mem))
+    return 1;
+
+  *batch->cycles += reg->clock.last.t;
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "aot.h"
+#include "cpu.h"
+#include "jit.h"
+#include "mmu.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOCK_CACHE_SIZE 1024
+#define BLOCK_MAX_LENGTH 16
+
+// An instruction with its operand already fetched
+struct block_op_s {
+  const opcode *op;
+  uint16_t operand;
+  uint16_t pc;
+  uint8_t length;
+};
+
+typedef struct block_op_s block_op;
+
+// Straight run of instructions, up to an unconditional jump
+struct block_s {
+  uint16_t pc;
+  uint16_t bank;
+  uint32_t generation;
+  bool ram;
+  uint8_t length;
+  block_op ops[BLOCK_MAX_LENGTH];
+#ifdef AOT
+  aot_fn translated;
+#endif
+#ifdef JIT_ENABLED
+  jit_fn native;
+  uint16_t entries[BLOCK_MAX_LENGTH];
+  uint32_t native_generation;
+  uint16_t hits;
+#endif
+};
+
+typedef struct block_s block;
+
+// Blocks from ROM are keyed on address and bank, blocks from internal
+// RAM are also dropped when the code generation changes
+struct block_cache_s {
+  block blocks[BLOCK_CACHE_SIZE];
+
+  // Instructions following the last one run, while the generation holds
+  const block_op *next;
+  const block_op *end;
+  uint32_t generation;
+
+#if defined(AOT) || defined(JIT_ENABLED)
+  block *current;
+#endif
+#ifdef AOT
+  const aot_program *program;
+#endif
+#ifdef JIT_ENABLED
+  jit jit;
+#endif
+};
+
+typedef struct block_cache_s block_cache;
+
+void block_cache_init(block_cache *cache);
+
+void block_cache_uninit(block_cache *cache);
+
+void block_cache_reset(block_cache *cache);
+
+// Same as cpu_next_command(), using decoded instructions where possible
+int block_next_command(block_cache *cache, registers *reg, memory *mem);
+
+// Runs one instruction, or a whole compiled block when entering one.
+// Cycles run are added to the batch, which also gets the address of the
+// last instruction.
+int block_run(block_cache *cache, registers *reg, memory *mem, block_batch *batch);
+
+#endif // BLOCK_H
@@ -0,0 +1,107 @@
+#include "checkpoint.h"
+
+#include "logger.h"
+
+#include <stdlib.h>
+
+// Same parts of the instance as in a saved state, memory coming with
+// references to the pages of RAM
+struct checkpoint_s {
+  registers cpu_reg;
+  mem_checkpoint mem;
+  uint16_t gpu_clock;
+  keys k;
+  scheduler sched;
+
+  uint64_t cycles;
+  int keys_cumulative_ticks;
+  int keys_ticks;
+  unsigned int overshoot;
+
+  // The sync event is scheduled from it, a reset also restarts the
+  // timing of the current frame
+  int sync_cumulative_ticks;
+};
+
+bool chester_mark_checkpoint(chester *chester)
+{
+  // Its state can't be returned to once the bootloader is gone
+  if (chester->mem.bootloader_running)
+    {
+      gb_log (ERROR, "Checkpoint can't be marked while the bootloader runs");
+      return false;
+    }
+
+  chester_drop_checkpoint(chester);
+
+  checkpoint *cp = malloc(sizeof(checkpoint));
+
+  if (!cp)
+    {
+      return false;
+    }
+
+  cp->cpu_reg = chester->cpu_reg;
+  mmu_mark_checkpoint(&chester->mem, &cp->mem);
+  cp->gpu_clock = chester->g.clock.t;
+  cp->k = chester->k;
+  cp->sched = chester->sched;
+
+  cp->cycles = chester->cycles;
+  cp->keys_cumulative_ticks = chester->keys_cumulative_ticks;
+  cp->keys_ticks = chester->keys_ticks;
+  cp->overshoot = chester->overshoot;
+  cp->sync_cumulative_ticks = chester->s.timing_cumulative_ticks;
+
+  chester->checkpoint = cp;
+
+  return true;
+}
+
+bool chester_reset_to_checkpoint(chester *chester)
+{
+  checkpoint *cp = chester->checkpoint;
+
+  if (!cp)
+    return false;
+
+  if (!mmu_reset_to_checkpoint(&chester->mem, &cp->mem))
+    {
+      gb_log (ERROR, "Could not reset to the checkpoint, out of memory");
+      return false;
+    }
+
+  chester->cpu_reg = cp->cpu_reg;
+  chester->g.clock.t = cp->gpu_clock;
+  chester->k = cp->k;
+  chester->sched = cp->sched;
+
+  chester->cycles = cp->cycles;
+  chester->keys_cumulative_ticks = cp->keys_cumulative_ticks;
+  chester->keys_ticks = cp->keys_ticks;
+  chester->overshoot = cp->overshoot;
+  chester->s.timing_cumulative_ticks = cp->sync_cumulative_ticks;
+  chester->s.framestarttime = chester->ticks_cb(chester->ticks_context);
+
+  // Decoded code is kept, blocks from RAM are dropped by the code
+  // generation having changed
+  chester->batch_synced = false;
+  chester->frame_rendered = false;
+  chester->rewind_pending = false;
+  chester->idle_loop.valid = false;
+
+  return true;
+}
+
+void chester_drop_checkpoint(chester *chester)
+{
+  checkpoint *cp = chester->checkpoint;
+
+  if (!cp)
+    return;
+
+  mmu_drop_checkpoint(&chester->mem, &cp->mem);
+  free(cp);
+
+  chester->checkpoint = NULL;
+}
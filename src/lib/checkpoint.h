@@ -0,0 +1,23 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "chester.h"
+
+#include <stdbool.h>
+
+typedef struct checkpoint_s checkpoint;
+
+// Keeps the state of the instance to return to, replacing any previous
+// checkpoint. Memory written from then on is tracked in pages, so that
+// returning costs as much as what got written and not the whole machine.
+// Returns false while the bootloader runs or when out of memory.
+bool chester_mark_checkpoint(chester *chester);
+
+// Returns the instance to the checkpoint, which is kept for returning to
+// again. Returns false if there is none, or if out of memory for copying
+// back RAM, in which case it has to be called again before running on.
+bool chester_reset_to_checkpoint(chester *chester);
+
+void chester_drop_checkpoint(chester *chester);
+
+#endif // CHECKPOINT_H
@@ -1,4 +1,6 @@
 #include "chester.h"
+#include "block.h"
+#include "checkpoint.h"
 #include "cpu.h"
 #include "gpu.h"
 #include "interrupts.h"
@@ -6,12 +8,18 @@
 #include "mmu.h"
 #include "loader.h"
 #include "logger.h"
+#include "memory_inline.h"
 #include "timer.h"
+#include "rewind.h"
 #include "save.h"
+#include "scheduler.h"
+#include "shared.h"
 #include "sync.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -19,10 +27,198 @@
 #include <libgen.h>
 #endif
 
+static inline void schedule_in(chester *chester, const event e, const uint64_t now, const unsigned int cycles)
+{
+  scheduler_schedule(&chester->sched, e, cycles == UINT_MAX ? SCHEDULER_NEVER : now + cycles);
+}
+
+// Frame is complete, passed on to the registered callback
+static void render(void *context, gpu *g)
+{
+  chester *chester = context;
+
+  chester->frame_rendered = true;
+
+  if (chester->rewind_buf)
+    chester->rewind_pending = true;
+
+  chester->gpu_render_cb(chester->gpu_render_context, g);
+}
+
+static int update_gpu(chester *chester, const uint64_t now)
+{
+  const unsigned int cycles = scheduler_elapsed(&chester->sched, EVENT_GPU, now);
+
+  if (gpu_update(&chester->g, &chester->mem, cycles,
+                 render, chester,
+                 chester->gpu_alloc_image_buffer_cb, chester->gpu_alloc_image_buffer_context))
+    {
+      gb_log (ERROR, "GPU error");
+      gpu_debug_print(&chester->g, ERROR);
+      return -2;
+    }
+
+  schedule_in(chester, EVENT_GPU, now, gpu_cycles_to_event(&chester->g, &chester->mem));
+
+  return 0;
+}
+
+static void update_timer(chester *chester, const uint64_t now, const bool timer_running)
+{
+  const unsigned int cycles = scheduler_elapsed(&chester->sched, EVENT_TIMER, now);
+
+  if (timer_running)
+    timer_update(&chester->cpu_reg, &chester->mem, cycles);
+
+  schedule_in(chester, EVENT_TIMER, now, timer_cycles_to_event(&chester->cpu_reg, &chester->mem));
+}
+
+static inline unsigned int keys_cycles_to_event(chester *chester)
+{
+  if (chester->keys_cumulative_ticks > chester->keys_ticks)
+    return 1;
+
+  return (unsigned int)(chester->keys_ticks - chester->keys_cumulative_ticks) + 1;
+}
+
+static int update_keys(chester *chester, const uint64_t now)
+{
+  const unsigned int cycles = scheduler_elapsed(&chester->sched, EVENT_KEYS, now);
+
+  // Nothing happened since the last update, keys are only polled after
+  // some cycles went by
+  if (!cycles)
+    return 0;
+
+  if (chester->keys_cumulative_ticks > chester->keys_ticks)
+    {
+      if (chester->save_supported && chester->save_timer++ >= 10000)
+        {
+          chester->save_timer = 0;
+
+          if (chester->mem.banks.ram.written)
+            {
+              mmu_clear_ram_written(&chester->mem);
+
+              save_game(chester->save_game_file, &chester->mem);
+            }
+        }
+
+      chester->keys_cumulative_ticks = 0;
+
+      switch(chester->k_cb(chester->k_context, &chester->k))
+        {
+        case -1:
+          return 1;
+        case 1:
+          isr_set_if_flag(&chester->mem, MEM_IF_PIN_FLAG);
+          chester->cpu_reg.halt =  false;
+          chester->cpu_reg.stop =  false;
+          break;
+        default:
+          break;
+        }
+    }
+  else
+    {
+      chester->keys_cumulative_ticks += cycles;
+    }
+
+  schedule_in(chester, EVENT_KEYS, now, keys_cycles_to_event(chester));
+
+  return 0;
+}
+
+static void update_sync(chester *chester, const uint64_t now)
+{
+  const unsigned int cycles = scheduler_elapsed(&chester->sched, EVENT_SYNC, now);
+
+  if (!cycles)
+    return;
+
+  sync_time(&chester->s, cycles,
+            chester->ticks_cb, chester->ticks_context,
+            chester->delay_cb, chester->delay_context);
+
+  schedule_in(chester, EVENT_SYNC, now, sync_cycles_to_event(&chester->s));
+}
+
+static int update_all(chester *chester, const uint64_t now, const bool timer_running)
+{
+  int ret;
+
+  if ((ret = update_gpu(chester, now)))
+    return ret;
+
+  update_timer(chester, now, timer_running);
+
+  if ((ret = update_keys(chester, now)))
+    return ret;
+
+  update_sync(chester, now);
+
+  return 0;
+}
+
+static int update_due(chester *chester, const uint64_t now)
+{
+  int ret;
+
+  if (scheduler_is_due(&chester->sched, EVENT_GPU, now) &&
+      (ret = update_gpu(chester, now)))
+    return ret;
+
+  if (scheduler_is_due(&chester->sched, EVENT_TIMER, now))
+    update_timer(chester, now, true);
+
+  if (scheduler_is_due(&chester->sched, EVENT_KEYS, now) &&
+      (ret = update_keys(chester, now)))
+    return ret;
+
+  if (scheduler_is_due(&chester->sched, EVENT_SYNC, now))
+    update_sync(chester, now);
+
+  return 0;
+}
+
+static void schedule_all(chester *chester)
+{
+  const uint64_t now = chester->cycles;
+
+  schedule_in(chester, EVENT_GPU, now, gpu_cycles_to_event(&chester->g, &chester->mem));
+  schedule_in(chester, EVENT_TIMER, now, timer_cycles_to_event(&chester->cpu_reg, &chester->mem));
+  schedule_in(chester, EVENT_KEYS, now, keys_cycles_to_event(chester));
+  schedule_in(chester, EVENT_SYNC, now, sync_cycles_to_event(&chester->s));
+}
+
+static void sync_peripherals(void *data)
+{
+  chester *chester = data;
+
+  // A register changing how peripherals count is about to be written,
+  // so catch them up and end the batch after the current instruction.
+  // No event is due before the end of the batch, so this cannot fail.
+  update_all(chester, chester->cycles, true);
+
+  chester->batch_synced = true;
+}
+
+static void catch_up_timer(void *data)
+{
+  chester *chester = data;
+
+  // DIV or TIMA is about to be read. They change without an event, so a
+  // loop reading them cannot be skipped.
+  update_timer(chester, chester->cycles, true);
+
+  chester->idle_loop.valid = false;
+}
+
 bool init(chester *chester, const char* rom, const char* save_path, const char* bootloader)
 {
   chester->rom = NULL;
   chester->bootloader = NULL;
+  chester->blocks = NULL;
 
   chester->keys_cumulative_ticks = 0;
   chester->keys_ticks = 15000;
@@ -31,6 +227,19 @@ bool init(chester *chester, const char* rom, const char* save_path, const char*
   chester->save_game_file = NULL;
   chester->save_supported = false;
 
+  chester->cycles = 0;
+  chester->overshoot = 0;
+  chester->frame_rendered = false;
+  chester->skipped_idle_cycles = 0;
+  chester->batch_synced = false;
+  chester->rewind_buf = NULL;
+  chester->rewind_pending = false;
+  chester->checkpoint = NULL;
+  scheduler_reset(&chester->sched);
+
+  // Before anything can fail, so that uninit() finds memory in order
+  mmu_reset(&chester->mem);
+
   uint32_t rom_size = 0;
   chester->rom = read_file(rom, &rom_size, true);
 
@@ -41,14 +250,34 @@ bool init(chester *chester, const char* rom, const char* save_path, const char*
 
   gb_log_print_rom_info(chester->rom);
 
-  cpu_reset(&chester->cpu_reg);
+  // The header tells which core the game runs on
+  switch (chester->rom[0x0143])
+  {
+  case 0x80:
+  case 0xC0:
+    mmu_set_cgb_mode(&chester->mem, true);
+    break;
+  }
+
+  // Padding too, registers being saved as they are
+  memset(&chester->cpu_reg, 0, sizeof chester->cpu_reg);
+  cpu_reset(&chester->cpu_reg, chester->mem.cgb_mode);
 
-  if (!gpu_init(&chester->g, chester->gpu_init_cb))
+  if (!gpu_init(&chester->g, chester->gpu_init_cb, chester->gpu_init_context))
     {
       return false;
     }
 
-  mmu_reset(&chester->mem);
+  chester->blocks = malloc(sizeof(block_cache));
+
+  if (!chester->blocks)
+    {
+      return false;
+    }
+
+  block_cache_init(chester->blocks);
+
+  mmu_set_io_sync(&chester->mem, sync_peripherals, catch_up_timer, chester);
 
   const mbc type = get_type(chester->rom);
 
@@ -57,18 +286,17 @@ bool init(chester *chester, const char* rom, const char* save_path, const char*
       return false;
     }
 
-  mmu_set_rom(&chester->mem, chester->rom, type, rom_size);
+  mmu_set_rom(&chester->mem, chester->rom, type, rom_size, get_ram_size(chester->rom));
 
-#ifdef CGB
-  switch (chester->rom[0x0143])
-  {
-  case 0x80:
-  case 0xC0:
-    chester->mem.cgb_mode = true;
-    break;
-  }
+#ifdef AOT
+  if ((chester->blocks->program = aot_find_program(chester->rom, rom_size)))
+    {
+      gb_log (INFO, "Running code translated ahead of time");
+    }
 #endif
 
+  gpu_select_core(&chester->g, chester->mem.cgb_mode);
+
   chester->bootloader = read_file(bootloader, NULL, false);
 
   if (chester->bootloader)
@@ -84,9 +312,13 @@ bool init(chester *chester, const char* rom, const char* save_path, const char*
   mmu_set_keys(&chester->mem, &chester->k);
   keys_reset(&chester->k);
 
-  sync_init(&chester->s, 100000, chester->ticks_cb);
+  sync_init(&chester->s, 100000, chester->ticks_cb, chester->ticks_context);
+
+  schedule_all(chester);
 
-  chester->save_supported = (chester->mem.rom.type & MBC_BATTERY_MASK);
+  // Nothing to save without RAM
+  chester->save_supported = (chester->mem.rom.type & MBC_BATTERY_MASK) &&
+    chester->mem.banks.ram.size;
 
   if (chester->save_supported)
     {
@@ -120,50 +352,144 @@ bool init(chester *chester, const char* rom, const char* save_path, const char*
   return true;
 }
 
-void register_keys_callback(chester *chester, keys_cb cb)
+bool chester_fork(chester *parent, chester *child)
+{
+  child->rom = NULL;
+  child->bootloader = NULL;
+  child->blocks = NULL;
+
+  child->keys_cumulative_ticks = parent->keys_cumulative_ticks;
+  child->keys_ticks = parent->keys_ticks;
+
+  child->save_timer = 0;
+  child->save_game_file = NULL;
+  child->save_supported = false;
+
+  child->cycles = parent->cycles;
+  child->overshoot = parent->overshoot;
+  child->frame_rendered = false;
+  child->skipped_idle_cycles = parent->skipped_idle_cycles;
+  child->batch_synced = false;
+  child->idle_loop.valid = false;
+  child->rewind_buf = NULL;
+  child->rewind_pending = false;
+  child->checkpoint = NULL;
+  child->sched = parent->sched;
+
+  mmu_reset(&child->mem);
+
+  if (!gpu_init(&child->g, child->gpu_init_cb, child->gpu_init_context))
+    {
+      return false;
+    }
+
+  child->g.clock = parent->g.clock;
+  child->g.color_correction = parent->g.color_correction;
+  gpu_select_core(&child->g, parent->mem.cgb_mode);
+
+  child->blocks = malloc(sizeof(block_cache));
+
+  if (!child->blocks)
+    {
+      return false;
+    }
+
+  block_cache_init(child->blocks);
+#ifdef AOT
+  child->blocks->program = parent->blocks->program;
+#endif
+
+  if (parent->bootloader)
+    {
+      child->bootloader = malloc(0x100);
+
+      if (!child->bootloader)
+        {
+          return false;
+        }
+
+      memcpy(child->bootloader, parent->bootloader, 0x100);
+    }
+
+  child->rom = shared_ref(parent->rom);
+
+  child->cpu_reg = parent->cpu_reg;
+  child->k = parent->k;
+
+  // Machine state is copied, except for RAM which gets shared, and the
+  // pointers in it are the child's own. That is about 17 KiB, 16 of it
+  // both VRAM banks. VRAM stays an array which the renderer indexes on
+  // every line, so it's copied rather than paged.
+  memcpy(&child->mem, &parent->mem, MEM_STATE_SIZE);
+  child->mem.rom.data = child->rom;
+  child->mem.bootloader = parent->mem.bootloader ? child->bootloader : NULL;
+  mmu_set_keys(&child->mem, &child->k);
+  mmu_set_io_sync(&child->mem, sync_peripherals, catch_up_timer, child);
+
+  mmu_share_ram(&child->mem, &parent->mem);
+  mmu_restore(&child->mem);
+
+  sync_init(&child->s, 100000, child->ticks_cb, child->ticks_context);
+
+  return true;
+}
+
+void register_keys_callback(chester *chester, keys_cb cb, void *context)
 {
   chester->k_cb = cb;
+  chester->k_context = context;
 }
 
-void register_get_ticks_callback(chester *chester, get_ticks_cb cb)
+void register_get_ticks_callback(chester *chester, get_ticks_cb cb, void *context)
 {
   chester->ticks_cb = cb;
+  chester->ticks_context = context;
 }
 
-void register_delay_callback(chester *chester, delay_cb cb)
+void register_delay_callback(chester *chester, delay_cb cb, void *context)
 {
   chester->delay_cb = cb;
+  chester->delay_context = context;
 }
 
-void register_gpu_init_callback(chester *chester, gpu_init_cb cb)
+void register_gpu_init_callback(chester *chester, gpu_init_cb cb, void *context)
 {
   chester->gpu_init_cb = cb;
+  chester->gpu_init_context = context;
 }
 
-void register_gpu_uninit_callback(chester *chester, gpu_uninit_cb cb)
+void register_gpu_uninit_callback(chester *chester, gpu_uninit_cb cb, void *context)
 {
   chester->gpu_uninit_cb = cb;
+  chester->gpu_uninit_context = context;
 }
 
-void register_gpu_alloc_image_buffer_callback(chester *chester, gpu_alloc_image_buffer_cb cb)
+void register_gpu_alloc_image_buffer_callback(chester *chester, gpu_alloc_image_buffer_cb cb, void *context)
 {
   chester->gpu_alloc_image_buffer_cb = cb;
+  chester->gpu_alloc_image_buffer_context = context;
 }
 
-void register_gpu_render_callback(chester *chester, gpu_render_cb cb)
+void register_gpu_render_callback(chester *chester, gpu_render_cb cb, void *context)
 {
   chester->gpu_render_cb = cb;
+  chester->gpu_render_context = context;
 }
 
-void register_serial_callback(chester *chester, serial_cb cb)
+void register_serial_callback(chester *chester, serial_cb cb, void *context)
 {
   chester->mem.serial_cb = cb;
+  chester->mem.serial_context = context;
 }
 
 void uninit(chester *chester)
 {
   save_if_needed(chester);
 
+  gb_log (INFO, "Skipped %llu of %llu cycles in idle loops",
+          (unsigned long long)chester->skipped_idle_cycles,
+          (unsigned long long)chester->cycles);
+
   if (chester->bootloader)
     {
       free(chester->bootloader);
@@ -172,26 +498,40 @@ void uninit(chester *chester)
 
   if (chester->rom)
     {
-      free(chester->rom);
+      shared_unref(chester->rom);
       chester->rom = NULL;
     }
 
-  chester->gpu_uninit_cb(&chester->g);
+  chester_rewind_disable(chester);
+  chester_drop_checkpoint(chester);
+
+  mmu_uninit(&chester->mem);
+
+  if (chester->blocks)
+    {
+      block_cache_uninit(chester->blocks);
+      free(chester->blocks);
+      chester->blocks = NULL;
+    }
 
-  gb_log_close_file();
+  chester->gpu_uninit_cb(chester->gpu_uninit_context, &chester->g);
 }
 
 void save_if_needed(chester *chester)
 {
     if (chester->save_supported && chester->mem.banks.ram.written)
       {
-        chester->mem.banks.ram.written = false;
+        mmu_clear_ram_written(&chester->mem);
 
         save_game(chester->save_game_file, &chester->mem);
       }
 }
 
-#if CGB
+uint64_t get_skipped_idle_cycles(chester *chester)
+{
+  return chester->skipped_idle_cycles;
+}
+
 bool get_color_correction(chester *chester)
 {
   return chester->g.color_correction;
@@ -200,13 +540,20 @@ bool get_color_correction(chester *chester)
 void set_color_correction(chester *chester, bool color_correction)
 {
   chester->g.color_correction = color_correction;
+
+  // Palettes get resolved to the colors of the new mode
+  chester->mem.palettes_resolved = false;
 }
-#endif
 
-int run(chester *chester)
+// Runs until the absolute cycle count reaches 'end', or right after a
+// frame got rendered if 'frame' is set
+static int run_loop(chester *chester, const uint64_t end, const bool frame)
 {
-  int run_cycles = 4194304 / 4;
-  while(run_cycles > 0)
+  registers *reg = &chester->cpu_reg;
+
+  chester->frame_rendered = false;
+
+  while (chester->cycles < end)
     {
       if (chester->bootloader && !chester->mem.bootloader_running)
         {
@@ -215,70 +562,137 @@ int run(chester *chester)
           free(chester->bootloader);
           chester->bootloader = NULL;
 
-          cpu_reset(&chester->cpu_reg);
+          cpu_reset(reg, chester->mem.cgb_mode);
+          schedule_all(chester);
         }
 
-      cpu_debug_print(&chester->cpu_reg, ALL);
-      mmu_debug_print(&chester->mem, ALL);
-      gpu_debug_print(&chester->g, ALL);
+      // Run instructions without updating peripherals until the next
+      // event is due, one of them is reconfigured or STOP is reached.
+      // STOP changes the way time passes, it is run on its own.
+      uint64_t deadline = scheduler_next_deadline(&chester->sched);
+      if (deadline > end)
+        deadline = end;
 
-      if (cpu_next_command(&chester->cpu_reg, &chester->mem))
-        {
-          gb_log (ERROR, "Could not process any longer");
-          cpu_debug_print(&chester->cpu_reg, ERROR);
-          mmu_debug_print(&chester->mem, ERROR);
-          return -1;
-        }
-
-      // STOP should be handled
-      if (gpu_update(&chester->g, &chester->mem, chester->cpu_reg.clock.last.t, chester->gpu_render_cb, chester->gpu_alloc_image_buffer_cb))
-        {
-          gb_log (ERROR, "GPU error");
-          gpu_debug_print(&chester->g, ERROR);
-          return -2;
-        }
+      const bool stopped = reg->stop;
+      block_batch batch = { &chester->cycles, &chester->batch_synced, deadline, 0, 0 };
+      unsigned int last_t;
+      int ret;
 
-      if (!chester->cpu_reg.stop)
-        timer_update(&chester->cpu_reg, &chester->mem);
+      chester->batch_synced = false;
+      chester->idle_loop.valid = false;
 
-      if (chester->keys_cumulative_ticks > chester->keys_ticks)
+      do
         {
-          if (chester->save_supported && chester->save_timer++ >= 10000)
+          // Only an event can end HALT or STOP, go right to the next one
+          if ((last_t = cpu_skip_idle(reg, &chester->mem, (unsigned int)(deadline - chester->cycles))))
             {
-              chester->save_timer = 0;
+              chester->cycles += last_t;
+              break;
+            }
 
-              if (chester->mem.banks.ram.written)
-                {
-                  chester->mem.banks.ram.written = false;
+          cpu_debug_print(reg, ALL);
+          mmu_debug_print(&chester->mem, ALL);
+          gpu_debug_print(&chester->g, ALL);
 
-                  save_game(chester->save_game_file, &chester->mem);
-                }
+          if (block_run(chester->blocks, reg, &chester->mem, &batch))
+            {
+              gb_log (ERROR, "Could not process any longer");
+              cpu_debug_print(reg, ERROR);
+              mmu_debug_print(&chester->mem, ERROR);
+              return -1;
             }
 
-          chester->keys_cumulative_ticks = 0;
+          last_t = reg->clock.last.t;
 
-          switch(chester->k_cb(&chester->k))
+          // A loop polling memory cannot see a change before the next
+          // event, go right to the last iteration before it. Jumping to
+          // itself is a loop too.
+          unsigned int iteration;
+          if (reg->pc <= batch.pc && chester->cycles < deadline &&
+              (iteration = cpu_check_idle_loop(reg, &chester->mem, &chester->idle_loop, batch.pc, chester->cycles)))
             {
-            case -1:
-              return 1;
-            case 1:
-              isr_set_if_flag(&chester->mem, MEM_IF_PIN_FLAG);
-              chester->cpu_reg.halt =  false;
-              chester->cpu_reg.stop =  false;
-              break;
-            default:
-              break;
+              const unsigned int iterations = (unsigned int)(deadline - chester->cycles) / iteration;
+              const uint64_t skipped = (uint64_t)iterations * iteration;
+
+              cpu_skip_idle_loop(reg, &chester->idle_loop, iterations);
+
+              chester->cycles += skipped;
+              chester->skipped_idle_cycles += skipped;
             }
         }
-      else
+      while (chester->cycles < deadline && !chester->batch_synced && !reg->stop && !stopped);
+
+      if (stopped)
+        {
+          if ((ret = update_all(chester, chester->cycles, !reg->stop)))
+            return ret;
+        }
+      else if (reg->stop)
+        {
+          // The timer does not run for the instruction entering STOP
+          if ((ret = update_all(chester, chester->cycles - last_t, true)) ||
+              (ret = update_all(chester, chester->cycles, false)))
+            return ret;
+        }
+      else if (chester->batch_synced)
         {
-          chester->keys_cumulative_ticks += chester->cpu_reg.clock.last.t;
+          // Deadlines depend on the registers just written
+          if ((ret = update_all(chester, chester->cycles, true)))
+            return ret;
+        }
+      else if ((ret = update_due(chester, chester->cycles)))
+        {
+          return ret;
         }
 
-      sync_time(&chester->s, chester->cpu_reg.clock.last.t, chester->ticks_cb, chester->delay_cb);
+      // Snapshots are taken between instructions
+      if (chester->rewind_pending)
+        {
+          chester->rewind_pending = false;
+          rewind_frame_done(chester);
+        }
 
-      run_cycles -= chester->cpu_reg.clock.last.t;
+      // Rendering is an event, so the batch ended right where it happened
+      if (frame && chester->frame_rendered)
+        {
+          chester->overshoot = 0;
+          return 0;
+        }
     }
 
+  chester->overshoot = chester->cycles - end;
+
   return 0;
 }
+
+int run(chester *chester)
+{
+  return run_until(chester, chester->cycles + 4194304 / 4);
+}
+
+int run_until(chester *chester, const uint64_t end)
+{
+  return run_loop(chester, end, false);
+}
+
+int run_cycles(chester *chester, const unsigned int cycles)
+{
+  // Cycles run over by the previous call are taken off this one
+  if (chester->overshoot >= cycles)
+    {
+      chester->overshoot -= cycles;
+      return 0;
+    }
+
+  return run_loop(chester, chester->cycles + cycles - chester->overshoot, false);
+}
+
+int run_frame(chester *chester)
+{
+  const bool lcd_on = read_io_byte(&chester->mem, MEM_LCDC_ADDR) & MEM_LCDC_SCREEN_ENABLED_FLAG;
+
+  // A frame isn't rendered while LCD is off, then a frame's worth of
+  // cycles is run instead. Otherwise frames can take a bit longer than
+  // FRAME_CYCLES, so only give up after two.
+  return run_loop(chester, chester->cycles + (lcd_on ? 2 * FRAME_CYCLES : FRAME_CYCLES), true);
+}
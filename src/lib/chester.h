@@ -3,34 +3,60 @@
 
 #include "chester_internal.h"
 
-void register_keys_callback(chester *chester, keys_cb cb);
+// Callbacks are called with the context given when registering them, and
+// only from the thread running the instance
 
-void register_get_ticks_callback(chester *chester, get_ticks_cb cb);
+void register_keys_callback(chester *chester, keys_cb cb, void *context);
 
-void register_delay_callback(chester *chester, delay_cb cb);
+void register_get_ticks_callback(chester *chester, get_ticks_cb cb, void *context);
 
-void register_gpu_init_callback(chester *chester, gpu_init_cb cb);
+void register_delay_callback(chester *chester, delay_cb cb, void *context);
 
-void register_gpu_uninit_callback(chester *chester, gpu_uninit_cb cb);
+void register_gpu_init_callback(chester *chester, gpu_init_cb cb, void *context);
 
-void register_gpu_alloc_image_buffer_callback(chester *chester, gpu_alloc_image_buffer_cb cb);
+void register_gpu_uninit_callback(chester *chester, gpu_uninit_cb cb, void *context);
 
-void register_gpu_render_callback(chester *chester, gpu_render_cb cb);
+void register_gpu_alloc_image_buffer_callback(chester *chester, gpu_alloc_image_buffer_cb cb, void *context);
 
-void register_serial_callback(chester *chester, serial_cb cb);
+void register_gpu_render_callback(chester *chester, gpu_render_cb cb, void *context);
+
+void register_serial_callback(chester *chester, serial_cb cb, void *context);
 
 void save_if_needed(chester *chester);
 
-#if CGB
+// Cycles fast-forwarded in loops which were only polling memory
+uint64_t get_skipped_idle_cycles(chester *chester);
+
 bool get_color_correction(chester *chester);
 
 void set_color_correction(chester *chester, bool color_correction);
-#endif
 
 bool init(chester *chester, const char* rom, const char* save_path, const char* bootloader);
 
 void uninit(chester *chester);
 
+// Makes the child, which has its callbacks registered as for init(), a
+// copy of the parent at the same point of emulation. The ROM and pages
+// of RAM are shared until either one writes to them, so forking is cheap
+// and both may then run on their own threads. The child doesn't save
+// battery RAM nor keep snapshots for rewinding or a checkpoint, and is
+// uninit() even if this returns false.
+bool chester_fork(chester *parent, chester *child);
+
+// Runs a quarter of a second
 int run(chester *chester);
 
+// Runs until the absolute cycle count reaches 'end', possibly overshooting
+// it by the rest of the last instruction
+int run_until(chester *chester, const uint64_t end);
+
+// Runs the given number of cycles. Cycles run over on the previous call
+// are taken off, so that consecutive calls keep to the budget.
+int run_cycles(chester *chester, const unsigned int cycles);
+
+// Runs until a frame has been rendered, returning right after the render
+// callback. Runs FRAME_CYCLES while LCD is off, and gives up after two
+// frames' worth of cycles when LCD was turned off meanwhile.
+int run_frame(chester *chester);
+
 #endif
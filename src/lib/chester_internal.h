@@ -1,10 +1,12 @@
 #ifndef CHESTER_INTERNAL_H
 #define CHESTER_INTERNAL_H
 
+#include "block.h"
 #include "cpu.h"
 #include "gpu.h"
 #include "keys.h"
 #include "mmu.h"
+#include "scheduler.h"
 #include "sync.h"
 
 struct chester_s {
@@ -15,20 +17,51 @@ struct chester_s {
   sync_timer s;
   uint8_t* bootloader;
   uint8_t* rom;
+  block_cache* blocks;
   int keys_cumulative_ticks;
   int keys_ticks;
   unsigned int save_timer;
   char* save_game_file;
   bool save_supported;
 
-  // callbacks
+  // Absolute number of cycles run, halved in CGB double speed so that
+  // it always follows the 4 MHz clock
+  uint64_t cycles;
+  scheduler sched;
+  bool batch_synced;
+
+  // Cycles the last run went past its end, and whether a frame got
+  // rendered during it
+  unsigned int overshoot;
+  bool frame_rendered;
+
+  // Snapshots for going back, and whether a frame was rendered since
+  // the last time they were looked at
+  struct rewind_buffer_s *rewind_buf;
+  bool rewind_pending;
+
+  // State to reset to, see checkpoint.h
+  struct checkpoint_s *checkpoint;
+
+  // Polling loop being watched, and the cycles it let skip
+  idle_loop idle_loop;
+  uint64_t skipped_idle_cycles;
+
+  // callbacks, each one is passed the context it was registered with
   keys_cb k_cb;
+  void *k_context;
   get_ticks_cb ticks_cb;
+  void *ticks_context;
   delay_cb delay_cb;
+  void *delay_context;
   gpu_init_cb gpu_init_cb;
+  void *gpu_init_context;
   gpu_uninit_cb gpu_uninit_cb;
+  void *gpu_uninit_context;
   gpu_alloc_image_buffer_cb gpu_alloc_image_buffer_cb;
+  void *gpu_alloc_image_buffer_context;
   gpu_render_cb gpu_render_cb;
+  void *gpu_render_context;
 };
 
 typedef struct chester_s chester;
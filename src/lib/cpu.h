@@ -7,6 +7,23 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define Z_BIT 0x80
+#define N_BIT 0x40
+#define H_BIT 0x20
+#define C_BIT 0x10
+
+// Last ALU operation, whose flags are only computed once something
+// reads F. F is up to date while it is FLAGS_NONE.
+typedef enum {
+  FLAGS_NONE,
+  FLAGS_ADD,
+  FLAGS_SUB,
+  FLAGS_AND,
+  FLAGS_OR,
+  FLAGS_INC,
+  FLAGS_DEC
+} flags_op;
+
 struct registers_s {
   union {
     struct {
@@ -48,14 +65,113 @@ struct registers_s {
   struct {
     unsigned int tick, div, t_timer;
   } timer;
-#ifdef CGB
+
+  // Operands of the pending flags operation: the result for AND/OR, the
+  // result and previous carry for INC/DEC, A and the operand otherwise
+  struct {
+    uint8_t op, x, y;
+  } flags;
   uint8_t speed_shifter;
-#endif
 };
 
 typedef struct registers_s registers;
 
-void cpu_reset(registers *reg);
+typedef int (*op_handler)(registers *reg, memory *mem, const uint16_t operand);
+
+typedef enum {
+  OPERAND_NONE,
+  OPERAND_D8,
+  OPERAND_S8,
+  OPERAND_D16
+} operand_kind;
+
+typedef enum {
+  EFFECTS_REG,
+  EFFECTS_MEM,
+  EFFECTS_CPU
+} effects_kind;
+
+// Decoded form of an entry in cpu_opcodes.h
+struct opcode_s {
+  op_handler handler;
+  operand_kind operand;
+  effects_kind effects;
+  uint8_t cycles;
+  const char *mnemonic;
+};
+
+typedef struct opcode_s opcode;
+
+extern const opcode cpu_opcodes[256];
+extern const opcode cpu_cb_opcodes[256];
+
+static inline uint8_t cpu_instruction_length(const opcode *op)
+{
+  switch (op->operand)
+    {
+    case OPERAND_D8:
+    case OPERAND_S8:
+      return 2;
+    case OPERAND_D16:
+      return 3;
+    default:
+      return 1;
+    }
+}
+
+// Brings F up to date and returns it
+static inline uint8_t cpu_flags(registers *reg)
+{
+  const uint8_t x = reg->flags.x, y = reg->flags.y;
+
+  switch (reg->flags.op)
+    {
+    case FLAGS_NONE:
+      return reg->f;
+    case FLAGS_ADD:
+      reg->f = (((x & 0x0F) + (y & 0x0F)) > 0x0F ? H_BIT : 0) |
+        (x + y > 0xFF ? C_BIT : 0) | ((uint8_t)(x + y) ? 0 : Z_BIT);
+      break;
+    case FLAGS_SUB:
+      reg->f = (x == y ? Z_BIT : 0) | N_BIT |
+        ((x & 0x0F) < (y & 0x0F) ? H_BIT : 0) | (x < y ? C_BIT : 0);
+      break;
+    case FLAGS_AND:
+      reg->f = (x ? 0 : Z_BIT) | H_BIT;
+      break;
+    case FLAGS_OR:
+      reg->f = x ? 0 : Z_BIT;
+      break;
+    case FLAGS_INC:
+      reg->f = (x ? 0 : Z_BIT) | ((x & 0x0F) ? 0 : H_BIT) | y;
+      break;
+    case FLAGS_DEC:
+      reg->f = (x ? 0 : Z_BIT) | N_BIT | ((x & 0x0F) == 0x0F ? H_BIT : 0) | y;
+      break;
+    }
+
+  reg->flags.op = FLAGS_NONE;
+
+  return reg->f;
+}
+
+// A short loop seen jumping back to its start with the CPU in a given
+// state, see cpu_check_idle_loop()
+struct idle_loop_s {
+  uint16_t start, end;
+  uint16_t af, bc, de, hl, sp;
+  bool ime;
+  bool valid;
+  uint64_t cycles;
+  uint16_t m, t;
+};
+
+typedef struct idle_loop_s idle_loop;
+
+#define IDLE_LOOP_MAX_LENGTH 32
+
+// Registers as left by the boot ROM of the DMG or CGB
+void cpu_reset(registers *reg, const bool cgb);
 
 #ifndef NDEBUG
 void cpu_debug_print(registers *reg, level l);
@@ -65,4 +181,27 @@ void cpu_debug_print(registers *reg, level l);
 
 int cpu_next_command(registers *reg, memory *mem);
 
+// Runs an instruction at PC which was already fetched and decoded
+int cpu_execute(registers *reg, memory *mem, const opcode *op, const uint16_t operand, const uint8_t length);
+
+// Jumps to the highest priority pending interrupt, if any. Only to be
+// called with IME set, after an instruction completed.
+void cpu_check_interrupts(registers *reg, memory *mem);
+
+// Runs HALT or STOP for at least the given cycles when nothing but a
+// peripheral event can end it. Returns the cycles run, or 0 when the
+// CPU has to be stepped normally.
+unsigned int cpu_skip_idle(registers *reg, memory *mem, const unsigned int cycles);
+
+// To be called when the instruction at 'from' moved PC backward or onto
+// itself, with the absolute cycle count after it. Returns the cycles of
+// one iteration if the loop is only polling memory and came back to the
+// state it had on the previous iteration, 0 otherwise. Nothing but an
+// event can change the outcome of such a loop, so iterations can be
+// skipped up to the next one with cpu_skip_idle_loop(). The loop must be
+// invalidated when peripherals get updated.
+unsigned int cpu_check_idle_loop(registers *reg, memory *mem, idle_loop *loop, const uint16_t from, const uint64_t cycles);
+
+void cpu_skip_idle_loop(registers *reg, idle_loop *loop, const unsigned int iterations);
+
 #endif // CPU_H
@@ -1,78 +1,88 @@
 #include "cpu.h"
 
-#define Z_BIT 0x80
-#define N_BIT 0x40
-#define H_BIT 0x20
-#define C_BIT 0x10
+// Condition flags read straight from the pending operation, without
+// bringing F up to date
+
+static inline bool flag_z(const registers *reg)
+{
+  const uint8_t x = reg->flags.x, y = reg->flags.y;
+
+  switch (reg->flags.op)
+    {
+    case FLAGS_ADD:
+      return !(uint8_t)(x + y);
+    case FLAGS_SUB:
+      return x == y;
+    case FLAGS_AND:
+    case FLAGS_OR:
+    case FLAGS_INC:
+    case FLAGS_DEC:
+      return !x;
+    default:
+      return reg->f & Z_BIT;
+    }
+}
+
+static inline bool flag_c(const registers *reg)
+{
+  const uint8_t x = reg->flags.x, y = reg->flags.y;
+
+  switch (reg->flags.op)
+    {
+    case FLAGS_ADD:
+      return x + y > 0xFF;
+    case FLAGS_SUB:
+      return x < y;
+    case FLAGS_AND:
+    case FLAGS_OR:
+      return false;
+    case FLAGS_INC:
+    case FLAGS_DEC:
+      return y;
+    default:
+      return reg->f & C_BIT;
+    }
+}
+
+static inline void lazy_flags(registers *reg, flags_op op, uint8_t x, uint8_t y)
+{
+  reg->flags.op = op;
+  reg->flags.x = x;
+  reg->flags.y = y;
+}
 
 static inline void or_flags(registers *reg)
 {
-  if(reg->a)
-    reg->f = 0;
-  else
-    reg->f = Z_BIT;
+  lazy_flags(reg, FLAGS_OR, reg->a, 0);
 }
 
 #define xor_flags(r) or_flags(r)
 
 static inline void and_flags(registers *reg)
 {
-  if(reg->a)
-    reg->f = 0;
-  else
-    reg->f = Z_BIT;
-  reg->f |= H_BIT;
+  lazy_flags(reg, FLAGS_AND, reg->a, 0);
 }
 
 static inline void cp_flags(registers *reg, uint8_t val)
 {
-  if(reg->a == val)
-    reg->f = Z_BIT;
-  else
-    reg->f = 0;
-  reg->f |= N_BIT;
-  if((0x0F & reg->a) < (0x0F & val))
-    reg->f |= H_BIT;
-  if(reg->a < val)
-    reg->f |= C_BIT;
+  lazy_flags(reg, FLAGS_SUB, reg->a, val);
 }
 
 #define sub_flags(r, val) cp_flags(r, val)
 
 static inline void dec_flags(registers* reg, uint8_t val)
 {
-  if(val)
-    reg->f &= ~Z_BIT;
-  else
-    reg->f |= Z_BIT;
-  reg->f |= N_BIT;
-  if((val & 0x0F) == 0x0F)
-    reg->f |= H_BIT;
-  else
-    reg->f &= ~H_BIT;
+  lazy_flags(reg, FLAGS_DEC, val, flag_c(reg) ? C_BIT : 0);
 }
 
 static inline void inc_flags(registers *reg, uint8_t val)
 {
-  if(val)
-    reg->f &= ~Z_BIT;
-  else
-    reg->f |= Z_BIT;
-  reg->f &= ~N_BIT;
-  if(val & 0x0F)
-    reg->f &= ~H_BIT;
-  else
-    reg->f |= H_BIT;
+  lazy_flags(reg, FLAGS_INC, val, flag_c(reg) ? C_BIT : 0);
 }
 
-static inline void add_flags_1(registers *reg, uint16_t val, uint16_t n)
+static inline void add_flags(registers *reg, uint8_t val, uint8_t n)
 {
-  if(((val & 0x0F) + (n & 0x0F)) > 0x0F)
-    reg->f = H_BIT;
-  else
-    reg->f = 0;
-  if((val + n) > 0x00FF)
-    reg->f |= C_BIT;
+  lazy_flags(reg, FLAGS_ADD, val, n);
 }
 
 static inline void add_flags_c(registers *reg, uint16_t val, uint16_t n,
@@ -88,6 +98,7 @@ static inline void add_flags_c(registers *reg, uint16_t val, uint16_t n,
 
 static inline void add_flags_16bit_1(registers *reg, uint16_t val, uint16_t n)
 {
+  cpu_flags(reg);
   reg->f &= ~N_BIT;
   if(((val & 0x0FFF) + (n & 0x0FFF)) > 0x0FFF)
     reg->f |= H_BIT;
@@ -107,6 +118,7 @@ static inline void add_flags_2(registers *reg, uint8_t val)
 
 static inline void bit_flags(registers *reg, uint8_t val, uint8_t n)
 {
+  cpu_flags(reg);
   if(val & (0x01 << n))
     reg->f &= ~Z_BIT;
   else
@@ -159,6 +171,8 @@ static inline void rrc_n(registers *reg, uint8_t *n)
 {
   *n = (*n << 7) | (*n >> 1);
 
+  reg->flags.op = FLAGS_NONE;
+
   if(*n)
     reg->f = 0;
   else
@@ -174,6 +188,7 @@ static inline void rrca(registers *reg)
 {
   reg->a = (reg->a << 7) | (reg->a >> 1);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = reg->a & 0x80 ? C_BIT : 0;
 
   reg->clock.last.t = 4;
@@ -185,6 +200,7 @@ static inline void rrc_hl(registers *reg, memory *mem)
 
   n = (n << 7) | (n >> 1);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = n ? 0 : Z_BIT;
 
   if(n & 0x80)
@@ -199,6 +215,7 @@ static inline void rlca(registers *reg)
 {
   reg->a = (reg->a >> 7) | (reg->a << 1);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = reg->a & 0x01 ? C_BIT : 0;
 
   reg->clock.last.t = 4;
@@ -208,6 +225,7 @@ static inline void rlc_n(registers *reg, uint8_t *n)
 {
   *n = (*n >> 7) | (*n << 1);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = *n ? 0 : Z_BIT;
 
   if(*n & 0x01)
@@ -222,6 +240,7 @@ static inline void rlc_hl(registers *reg, memory *mem)
 
   n = (n >> 7) | (n << 1);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = n ? 0 : Z_BIT;
 
   if(n & 0x01)
@@ -252,7 +271,7 @@ static inline void xor_n_slow(registers *reg, uint8_t n)
 
 static inline void ldh_n_a(registers *reg, memory *mem, uint8_t n)
 {
-  mmu_write_byte(mem, 0xFF00 + n, reg->a);
+  mmu_write_io(mem, n, reg->a);
 
   reg->clock.last.t = 12;
 }
@@ -413,22 +432,22 @@ static inline void jr_if(registers *reg, const int8_t n, const bool jump)
 
 static inline void jr_nc(registers *reg, const int8_t n)
 {
-  jr_if(reg, n, !(reg->f & C_BIT));
+  jr_if(reg, n, !flag_c(reg));
 }
 
 static inline void jr_c(registers *reg, const int8_t n)
 {
-  jr_if(reg, n, reg->f & C_BIT);
+  jr_if(reg, n, flag_c(reg));
 }
 
 static inline void jr_nz(registers *reg, const int8_t n)
 {
-  jr_if(reg, n, !(reg->f & Z_BIT));
+  jr_if(reg, n, !flag_z(reg));
 }
 
 static inline void jr_z(registers *reg, const int8_t n)
 {
-  jr_if(reg, n, reg->f & Z_BIT);
+  jr_if(reg, n, flag_z(reg));
 }
 
 static inline void jp_if(registers *reg, const uint16_t nn, const bool jump)
@@ -440,35 +459,34 @@ static inline void jp_if(registers *reg, const uint16_t nn, const bool jump)
     }
   else
     {
-      reg->pc += 2;
       reg->clock.last.t = 12;
     }
 }
 
 static inline void jp_nc(registers *reg, const uint16_t nn)
 {
-  jp_if(reg, nn, !(reg->f & C_BIT));
+  jp_if(reg, nn, !flag_c(reg));
 }
 
 static inline void jp_c(registers *reg, const uint16_t nn)
 {
-  jp_if(reg, nn, reg->f & C_BIT);
+  jp_if(reg, nn, flag_c(reg));
 }
 
 static inline void jp_nz(registers *reg, const uint16_t nn)
 {
-  jp_if(reg, nn, !(reg->f & Z_BIT));
+  jp_if(reg, nn, !flag_z(reg));
 }
 
 static inline void jp_z(registers *reg, const uint16_t nn)
 {
-  jp_if(reg, nn, reg->f & Z_BIT);
+  jp_if(reg, nn, flag_z(reg));
 }
 
 static inline void call_nn(registers *reg, memory *mem, const uint16_t nn)
 {
   reg->sp -= 2;
-  mmu_write_word(mem, reg->sp, reg->pc + 2);
+  mmu_write_word(mem, reg->sp, reg->pc);
   reg->pc = nn;
 
   gb_log(VERBOSE, "Calling %04X", nn);
@@ -485,29 +503,28 @@ static inline void call_if(registers *reg, memory *mem, const uint16_t nn,
     }
   else
     {
-      reg->pc += 2;
       reg->clock.last.t = 12;
     }
 }
 
 static inline void call_nc(registers *reg, memory *mem, const uint16_t nn)
 {
-  call_if(reg, mem, nn, !(reg->f & C_BIT));
+  call_if(reg, mem, nn, !flag_c(reg));
 }
 
 static inline void call_c(registers *reg, memory *mem, const uint16_t nn)
 {
-  call_if(reg, mem, nn, reg->f & C_BIT);
+  call_if(reg, mem, nn, flag_c(reg));
 }
 
 static inline void call_nz(registers *reg, memory *mem, const uint16_t nn)
 {
-  call_if(reg, mem, nn, !(reg->f & Z_BIT));
+  call_if(reg, mem, nn, !flag_z(reg));
 }
 
 static inline void call_z(registers *reg, memory *mem, const uint16_t nn)
 {
-  call_if(reg, mem, nn, reg->f & Z_BIT);
+  call_if(reg, mem, nn, flag_z(reg));
 }
 
 static inline void ret(registers *reg, memory *mem)
@@ -543,7 +560,7 @@ static inline void reti(registers *reg, memory *mem)
 
 static inline void ldh_a_n(registers *reg, memory *mem, uint8_t n)
 {
-  reg->a = mmu_read_byte(mem, 0xFF00 + n);
+  reg->a = mmu_read_io(mem, n);
 
   reg->clock.last.t = 12;
 }
@@ -577,6 +594,7 @@ static inline void pop_af(registers *reg, memory *mem)
   reg->sp += 2;
 
   reg->f &= 0xF0;
+  reg->flags.op = FLAGS_NONE;
 
   reg->clock.last.t = 12;
 }
@@ -590,14 +608,14 @@ static inline void bit_b_r(registers *reg, uint8_t r, uint8_t b)
 
 static inline void ld_a_c(registers *reg, memory *mem)
 {
-  reg->a = mmu_read_byte(mem, 0xFF00 + reg->c);
+  reg->a = mmu_read_io(mem, reg->c);
 
   reg->clock.last.t = 8;
 }
 
 static inline void ld_c_a(registers *reg, memory *mem)
 {
-  mmu_write_byte(mem, 0xFF00 + reg->c, reg->a);
+  mmu_write_io(mem, reg->c, reg->a);
 
   reg->clock.last.t = 8;
 }
@@ -665,6 +683,8 @@ static inline void inc_hl(registers *reg, memory *mem)
 
 static inline void daa(registers *reg)
 {
+  cpu_flags(reg);
+
   uint16_t a = reg->a;
 
   if (!(reg->f & N_BIT))
@@ -709,6 +729,8 @@ static inline void daa(registers *reg)
 
 static inline void cpl(registers *reg)
 {
+  cpu_flags(reg);
+
   reg->a = ~reg->a;
 
   reg->f |= N_BIT + H_BIT;
@@ -718,6 +740,8 @@ static inline void cpl(registers *reg)
 
 static inline void ccf(registers *reg)
 {
+  cpu_flags(reg);
+
   reg->f ^= C_BIT;
 
   reg->f &= ~(N_BIT + H_BIT);
@@ -727,6 +751,8 @@ static inline void ccf(registers *reg)
 
 static inline void scf(registers *reg)
 {
+  cpu_flags(reg);
+
   reg->f |= C_BIT;
 
   reg->f &= ~(N_BIT + H_BIT);
@@ -738,6 +764,7 @@ static inline void swap_n(registers *reg, uint8_t *n)
 {
   *n = (*n << 4) | (*n >> 4);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = *n ? 0x00 : Z_BIT;
 
   reg->clock.last.t = 8;
@@ -749,6 +776,7 @@ static inline void swap_hl(registers *reg, memory *mem)
   val = (val << 4) | (val >> 4);
   mmu_write_byte(mem, reg->hl, val);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = val ? 0x00 : Z_BIT;
 
   reg->clock.last.t = 16;
@@ -766,12 +794,10 @@ static inline void rst_n(registers *reg, memory *mem, const uint8_t n)
 
 static inline void add_n(registers *reg, const uint8_t n)
 {
-  add_flags_1(reg, reg->a, n);
+  add_flags(reg, reg->a, n);
 
   reg->a += n;
 
-  add_flags_2(reg, reg->a);
-
   reg->clock.last.t = 4;
 }
 
@@ -779,12 +805,10 @@ static inline void add_hl(registers *reg, memory *mem)
 {
   const uint8_t n = mmu_read_byte(mem, reg->hl);
 
-  add_flags_1(reg, reg->a, n);
+  add_flags(reg, reg->a, n);
 
   reg->a += n;
 
-  add_flags_2(reg, reg->a);
-
   reg->clock.last.t = 8;
 }
 
@@ -820,6 +844,8 @@ static inline void jr_n(registers *reg, int8_t n)
 
 static inline void adc_a_n(registers *reg, uint16_t n)
 {
+  cpu_flags(reg);
+
   const uint8_t carry = (reg->f & C_BIT) ? 1 : 0;
 
   add_flags_c(reg, reg->a, n, carry);
@@ -833,6 +859,8 @@ static inline void adc_a_n(registers *reg, uint16_t n)
 
 static inline void sbc_a_n(registers *reg, uint16_t n)
 {
+  cpu_flags(reg);
+
   const int carry = (reg->f & C_BIT) ? 1 :0;
   const int res = reg->a - (n + carry);
 
@@ -889,6 +917,7 @@ static inline void set_b_hl(registers *reg, memory *mem, const uint8_t b)
 
 static inline void sla_n(registers *reg, uint8_t *n)
 {
+  reg->flags.op = FLAGS_NONE;
   reg->f = (*n & 0x80) ? C_BIT : 0x00;
 
   *n = *n << 1;
@@ -903,6 +932,7 @@ static inline void sla_hl(registers *reg, memory *mem)
 {
   uint8_t n = mmu_read_byte(mem, reg->hl);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = (n & 0x80) ? C_BIT : 0x00;
 
   n = n << 1;
@@ -917,6 +947,7 @@ static inline void sla_hl(registers *reg, memory *mem)
 
 static inline void srl_n(registers *reg, uint8_t *n)
 {
+  reg->flags.op = FLAGS_NONE;
   reg->f = (*n & 0x01) ? C_BIT : 0x00;
 
   *n = *n >> 1;
@@ -931,6 +962,7 @@ static inline void srl_hl(registers *reg, memory *mem)
 {
   uint8_t n = mmu_read_byte(mem, reg->hl);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = (n & 0x01) ? C_BIT : 0x00;
 
   n = n >> 1;
@@ -945,6 +977,7 @@ static inline void srl_hl(registers *reg, memory *mem)
 
 static inline void sra_n(registers *reg, uint8_t *n)
 {
+  reg->flags.op = FLAGS_NONE;
   reg->f = (*n & 0x01) ? C_BIT : 0x00;
 
   *n = (*n & 0x80) | (*n >> 1);
@@ -959,6 +992,7 @@ static inline void sra_hl(registers *reg, memory *mem)
 {
   uint8_t n = mmu_read_byte(mem, reg->hl);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = (n & 0x01) ? C_BIT : 0x00;
 
   n = (n & 0x80) | (n >> 1);
@@ -973,6 +1007,8 @@ static inline void sra_hl(registers *reg, memory *mem)
 
 static inline void rr_n(registers *reg, uint8_t *n)
 {
+  cpu_flags(reg);
+
   uint8_t old_carry = (reg->f & C_BIT) << 3;
 
   reg->f = (*n & 0x01) ? C_BIT : 0x00;
@@ -987,6 +1023,8 @@ static inline void rr_n(registers *reg, uint8_t *n)
 
 static inline void rra(registers *reg)
 {
+  cpu_flags(reg);
+
   uint8_t old_carry = (reg->f & C_BIT) << 3;
 
   reg->f = (reg->a & 0x01) ? C_BIT : 0x00;
@@ -998,6 +1036,8 @@ static inline void rra(registers *reg)
 
 static inline void rr_hl(registers *reg, memory *mem)
 {
+  cpu_flags(reg);
+
   uint8_t n = mmu_read_byte(mem, reg->hl);
   uint8_t old_carry = (reg->f & C_BIT) << 3;
 
@@ -1015,6 +1055,8 @@ static inline void rr_hl(registers *reg, memory *mem)
 
 static inline void rl_n(registers *reg, uint8_t *n)
 {
+  cpu_flags(reg);
+
   uint8_t old_carry = (reg->f & C_BIT) >> 4;
 
   reg->f = (*n & 0x80) ? C_BIT : 0x00;
@@ -1029,6 +1071,8 @@ static inline void rl_n(registers *reg, uint8_t *n)
 
 static inline void rla(registers *reg)
 {
+  cpu_flags(reg);
+
   uint8_t old_carry = (reg->f & C_BIT) >> 4;
 
   reg->f = (reg->a & 0x80) ? C_BIT : 0x00;
@@ -1040,6 +1084,8 @@ static inline void rla(registers *reg)
 
 static inline void rl_hl(registers *reg, memory *mem)
 {
+  cpu_flags(reg);
+
   uint8_t n = mmu_read_byte(mem, reg->hl);
   uint8_t old_carry = (reg->f & C_BIT) >> 4;
 
@@ -1073,6 +1119,7 @@ static inline uint16_t sp_n(registers *reg, int8_t n)
 {
   const uint16_t res = (reg->sp + n);
 
+  reg->flags.op = FLAGS_NONE;
   reg->f = 0;
 
   if ((res & 0xFF) < (reg->sp & 0xFF))
@@ -0,0 +1,529 @@
+// CPU instruction table, included by cpu.c. Every instruction is
+// described once as
+//
+//   OPCODE(code, mnemonic, operand, cycles, effects, body)
+//   CB_OPCODE(code, mnemonic, cycles, effects, body)
+//
+// where operand is the kind of immediate following the opcode (NONE,
+// D8, S8 or D16) which is fetched before body runs and is available to
+// it as n or nn. Cycles is the cost of the instruction or 0 when it
+// depends on whether a branch is taken, in which case body sets it.
+// Effects is what body may change besides registers: nothing (REG),
+// memory including the stack and I/O registers (MEM), or how the CPU
+// runs for HALT, STOP and illegal opcodes (CPU).
+//
+// No include guard on purpose as the table is expanded several times.
+
+OPCODE(0x00, "NOP",           NONE,  4, REG, nop(reg))
+OPCODE(0x01, "LD BC, nn",     D16,  12, REG, ldh_bc_nn(reg, nn))
+OPCODE(0x02, "LD (BC), A",    NONE,  8, MEM, ld_nn_a(reg, mem, reg->bc))
+OPCODE(0x03, "INC BC",        NONE,  8, REG, inc_nn(reg, &reg->bc))
+OPCODE(0x04, "INC B",         NONE,  4, REG, inc_n(reg, &reg->b))
+OPCODE(0x05, "DEC B",         NONE,  4, REG, dec_n(reg, &reg->b))
+OPCODE(0x06, "LD B, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->b))
+OPCODE(0x07, "RLCA",          NONE,  4, REG, rlca(reg))
+OPCODE(0x08, "LD (nn), SP",   D16,  20, MEM, ld_nn_sp(reg, mem, nn))
+OPCODE(0x09, "ADD HL, BC",    NONE,  8, REG, add_hl_n(reg, reg->bc))
+OPCODE(0x0A, "LD A, (BC)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->a, mmu_read_byte(mem, reg->bc)))
+OPCODE(0x0B, "DEC BC",        NONE,  8, REG, dec_nn(reg, &reg->bc))
+OPCODE(0x0C, "INC C",         NONE,  4, REG, inc_n(reg, &reg->c))
+OPCODE(0x0D, "DEC C",         NONE,  4, REG, dec_n(reg, &reg->c))
+OPCODE(0x0E, "LD C, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->c))
+OPCODE(0x0F, "RRCA",          NONE,  4, REG, rrca(reg))
+OPCODE(0x10, "STOP",          NONE,  4, CPU, stop(reg))
+OPCODE(0x11, "LD DE, nn",     D16,  12, REG, ldh_de_nn(reg, nn))
+OPCODE(0x12, "LD (DE), A",    NONE,  8, MEM, ld_nn_a(reg, mem, reg->de))
+OPCODE(0x13, "INC DE",        NONE,  8, REG, inc_nn(reg, &reg->de))
+OPCODE(0x14, "INC D",         NONE,  4, REG, inc_n(reg, &reg->d))
+OPCODE(0x15, "DEC D",         NONE,  4, REG, dec_n(reg, &reg->d))
+OPCODE(0x16, "LD D, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->d))
+OPCODE(0x17, "RLA",           NONE,  4, REG, rla(reg))
+OPCODE(0x18, "JR e",          S8,   12, REG, jr_n(reg, n))
+OPCODE(0x19, "ADD HL, DE",    NONE,  8, REG, add_hl_n(reg, reg->de))
+OPCODE(0x1A, "LD A, (DE)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->a, mmu_read_byte(mem, reg->de)))
+OPCODE(0x1B, "DEC DE",        NONE,  8, REG, dec_nn(reg, &reg->de))
+OPCODE(0x1C, "INC E",         NONE,  4, REG, inc_n(reg, &reg->e))
+OPCODE(0x1D, "DEC E",         NONE,  4, REG, dec_n(reg, &reg->e))
+OPCODE(0x1E, "LD E, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->e))
+OPCODE(0x1F, "RRA",           NONE,  4, REG, rra(reg))
+OPCODE(0x20, "JR NZ, e",      S8,    0, REG, jr_nz(reg, n))
+OPCODE(0x21, "LD HL, nn",     D16,  12, REG, ldh_hl_nn(reg, nn))
+OPCODE(0x22, "LDI (HL), A",   NONE,  8, MEM, ldi_hl_a(reg, mem))
+OPCODE(0x23, "INC HL",        NONE,  8, REG, inc_nn(reg, &reg->hl))
+OPCODE(0x24, "INC H",         NONE,  4, REG, inc_n(reg, &reg->h))
+OPCODE(0x25, "DEC H",         NONE,  4, REG, dec_n(reg, &reg->h))
+OPCODE(0x26, "LD H, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->h))
+OPCODE(0x27, "DAA",           NONE,  4, REG, daa(reg))
+OPCODE(0x28, "JR Z, e",       S8,    0, REG, jr_z(reg, n))
+OPCODE(0x29, "ADD HL, HL",    NONE,  8, REG, add_hl_n(reg, reg->hl))
+OPCODE(0x2A, "LDI A, (HL)",   NONE,  8, MEM, ldi_a_hl(reg, mem))
+OPCODE(0x2B, "DEC HL",        NONE,  8, REG, dec_nn(reg, &reg->hl))
+OPCODE(0x2C, "INC L",         NONE,  4, REG, inc_n(reg, &reg->l))
+OPCODE(0x2D, "DEC L",         NONE,  4, REG, dec_n(reg, &reg->l))
+OPCODE(0x2E, "LD L, n",       D8,    8, REG, ld_nn_n(reg, n, &reg->l))
+OPCODE(0x2F, "CPL",           NONE,  4, REG, cpl(reg))
+OPCODE(0x30, "JR NC, e",      S8,    0, REG, jr_nc(reg, n))
+OPCODE(0x31, "LD SP, nn",     D16,  12, REG, ldh_sp_nn(reg, nn))
+OPCODE(0x32, "LDD (HL), A",   NONE,  8, MEM, ldd_hl_a(reg, mem))
+OPCODE(0x33, "INC SP",        NONE,  8, REG, inc_nn(reg, &reg->sp))
+OPCODE(0x34, "INC (HL)",      NONE, 12, MEM, inc_hl(reg, mem))
+OPCODE(0x35, "DEC (HL)",      NONE, 12, MEM, dec_hl(reg, mem))
+OPCODE(0x36, "LD (HL), n",    D8,   12, MEM, ld_r1_r2_hl(reg, mem, n))
+OPCODE(0x37, "SCF",           NONE,  4, REG, scf(reg))
+OPCODE(0x38, "JR C, e",       S8,    0, REG, jr_c(reg, n))
+OPCODE(0x39, "ADD HL, SP",    NONE,  8, REG, add_hl_n(reg, reg->sp))
+OPCODE(0x3A, "LDD A, (HL)",   NONE,  8, MEM, ldd_a_hl(reg, mem))
+OPCODE(0x3B, "DEC SP",        NONE,  8, REG, dec_nn(reg, &reg->sp))
+OPCODE(0x3C, "INC A",         NONE,  4, REG, inc_n(reg, &reg->a))
+OPCODE(0x3D, "DEC A",         NONE,  4, REG, dec_n(reg, &reg->a))
+OPCODE(0x3E, "LD A, n",       D8,    8, REG, ld_r1_r2(reg, &reg->a, n))
+OPCODE(0x3F, "CCF",           NONE,  4, REG, ccf(reg))
+OPCODE(0x40, "LD B, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->b))
+OPCODE(0x41, "LD B, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->c))
+OPCODE(0x42, "LD B, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->d))
+OPCODE(0x43, "LD B, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->e))
+OPCODE(0x44, "LD B, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->h))
+OPCODE(0x45, "LD B, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->b, reg->l))
+OPCODE(0x46, "LD B, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->b, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x47, "LD B, A",       NONE,  4, REG, ld_n_a(reg, &reg->b))
+OPCODE(0x48, "LD C, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->b))
+OPCODE(0x49, "LD C, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->c))
+OPCODE(0x4A, "LD C, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->d))
+OPCODE(0x4B, "LD C, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->e))
+OPCODE(0x4C, "LD C, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->h))
+OPCODE(0x4D, "LD C, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->c, reg->l))
+OPCODE(0x4E, "LD C, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->c, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x4F, "LD C, A",       NONE,  4, REG, ld_n_a(reg, &reg->c))
+OPCODE(0x50, "LD D, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->b))
+OPCODE(0x51, "LD D, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->c))
+OPCODE(0x52, "LD D, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->d))
+OPCODE(0x53, "LD D, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->e))
+OPCODE(0x54, "LD D, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->h))
+OPCODE(0x55, "LD D, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->d, reg->l))
+OPCODE(0x56, "LD D, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->d, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x57, "LD D, A",       NONE,  4, REG, ld_n_a(reg, &reg->d))
+OPCODE(0x58, "LD E, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->b))
+OPCODE(0x59, "LD E, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->c))
+OPCODE(0x5A, "LD E, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->d))
+OPCODE(0x5B, "LD E, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->e))
+OPCODE(0x5C, "LD E, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->h))
+OPCODE(0x5D, "LD E, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->e, reg->l))
+OPCODE(0x5E, "LD E, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->e, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x5F, "LD E, A",       NONE,  4, REG, ld_n_a(reg, &reg->e))
+OPCODE(0x60, "LD H, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->b))
+OPCODE(0x61, "LD H, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->c))
+OPCODE(0x62, "LD H, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->d))
+OPCODE(0x63, "LD H, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->e))
+OPCODE(0x64, "LD H, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->h))
+OPCODE(0x65, "LD H, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->h, reg->l))
+OPCODE(0x66, "LD H, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->h, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x67, "LD H, A",       NONE,  4, REG, ld_n_a(reg, &reg->h))
+OPCODE(0x68, "LD L, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->b))
+OPCODE(0x69, "LD L, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->c))
+OPCODE(0x6A, "LD L, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->d))
+OPCODE(0x6B, "LD L, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->e))
+OPCODE(0x6C, "LD L, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->h))
+OPCODE(0x6D, "LD L, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->l, reg->l))
+OPCODE(0x6E, "LD L, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->l, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x6F, "LD L, A",       NONE,  4, REG, ld_n_a(reg, &reg->l))
+OPCODE(0x70, "LD (HL), B",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->b))
+OPCODE(0x71, "LD (HL), C",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->c))
+OPCODE(0x72, "LD (HL), D",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->d))
+OPCODE(0x73, "LD (HL), E",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->e))
+OPCODE(0x74, "LD (HL), H",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->h))
+OPCODE(0x75, "LD (HL), L",    NONE,  8, MEM, ld_r1_r2_hl(reg, mem, reg->l))
+OPCODE(0x76, "HALT",          NONE,  4, CPU, halt(reg, mem))
+OPCODE(0x77, "LD (HL), A",    NONE,  8, MEM, ld_nn_a(reg, mem, reg->hl))
+OPCODE(0x78, "LD A, B",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->b))
+OPCODE(0x79, "LD A, C",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->c))
+OPCODE(0x7A, "LD A, D",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->d))
+OPCODE(0x7B, "LD A, E",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->e))
+OPCODE(0x7C, "LD A, H",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->h))
+OPCODE(0x7D, "LD A, L",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->l))
+OPCODE(0x7E, "LD A, (HL)",    NONE,  8, MEM, ld_r1_r2(reg, &reg->a, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x7F, "LD A, A",       NONE,  4, REG, ld_r1_r2(reg, &reg->a, reg->a))
+OPCODE(0x80, "ADD A, B",      NONE,  4, REG, add_n(reg, reg->b))
+OPCODE(0x81, "ADD A, C",      NONE,  4, REG, add_n(reg, reg->c))
+OPCODE(0x82, "ADD A, D",      NONE,  4, REG, add_n(reg, reg->d))
+OPCODE(0x83, "ADD A, E",      NONE,  4, REG, add_n(reg, reg->e))
+OPCODE(0x84, "ADD A, H",      NONE,  4, REG, add_n(reg, reg->h))
+OPCODE(0x85, "ADD A, L",      NONE,  4, REG, add_n(reg, reg->l))
+OPCODE(0x86, "ADD A, (HL)",   NONE,  8, MEM, add_hl(reg, mem))
+OPCODE(0x87, "ADD A, A",      NONE,  4, REG, add_n(reg, reg->a))
+OPCODE(0x88, "ADC A, B",      NONE,  4, REG, adc_a_n(reg, reg->b))
+OPCODE(0x89, "ADC A, C",      NONE,  4, REG, adc_a_n(reg, reg->c))
+OPCODE(0x8A, "ADC A, D",      NONE,  4, REG, adc_a_n(reg, reg->d))
+OPCODE(0x8B, "ADC A, E",      NONE,  4, REG, adc_a_n(reg, reg->e))
+OPCODE(0x8C, "ADC A, H",      NONE,  4, REG, adc_a_n(reg, reg->h))
+OPCODE(0x8D, "ADC A, L",      NONE,  4, REG, adc_a_n(reg, reg->l))
+OPCODE(0x8E, "ADC A, (HL)",   NONE,  8, MEM, adc_a_n(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x8F, "ADC A, A",      NONE,  4, REG, adc_a_n(reg, reg->a))
+OPCODE(0x90, "SUB B",         NONE,  4, REG, sub_n(reg, reg->b))
+OPCODE(0x91, "SUB C",         NONE,  4, REG, sub_n(reg, reg->c))
+OPCODE(0x92, "SUB D",         NONE,  4, REG, sub_n(reg, reg->d))
+OPCODE(0x93, "SUB E",         NONE,  4, REG, sub_n(reg, reg->e))
+OPCODE(0x94, "SUB H",         NONE,  4, REG, sub_n(reg, reg->h))
+OPCODE(0x95, "SUB L",         NONE,  4, REG, sub_n(reg, reg->l))
+OPCODE(0x96, "SUB (HL)",      NONE,  8, MEM, sub_n(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x97, "SUB A",         NONE,  4, REG, sub_n(reg, reg->a))
+OPCODE(0x98, "SBC A, B",      NONE,  4, REG, sbc_a_n(reg, reg->b))
+OPCODE(0x99, "SBC A, C",      NONE,  4, REG, sbc_a_n(reg, reg->c))
+OPCODE(0x9A, "SBC A, D",      NONE,  4, REG, sbc_a_n(reg, reg->d))
+OPCODE(0x9B, "SBC A, E",      NONE,  4, REG, sbc_a_n(reg, reg->e))
+OPCODE(0x9C, "SBC A, H",      NONE,  4, REG, sbc_a_n(reg, reg->h))
+OPCODE(0x9D, "SBC A, L",      NONE,  4, REG, sbc_a_n(reg, reg->l))
+OPCODE(0x9E, "SBC A, (HL)",   NONE,  8, MEM, sbc_a_n(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0x9F, "SBC A, A",      NONE,  4, REG, sbc_a_n(reg, reg->a))
+OPCODE(0xA0, "AND B",         NONE,  4, REG, and_n(reg, reg->b))
+OPCODE(0xA1, "AND C",         NONE,  4, REG, and_n(reg, reg->c))
+OPCODE(0xA2, "AND D",         NONE,  4, REG, and_n(reg, reg->d))
+OPCODE(0xA3, "AND E",         NONE,  4, REG, and_n(reg, reg->e))
+OPCODE(0xA4, "AND H",         NONE,  4, REG, and_n(reg, reg->h))
+OPCODE(0xA5, "AND L",         NONE,  4, REG, and_n(reg, reg->l))
+OPCODE(0xA6, "AND (HL)",      NONE,  8, MEM, and_n_slow(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0xA7, "AND A",         NONE,  4, REG, and_n(reg, reg->a))
+OPCODE(0xA8, "XOR B",         NONE,  4, REG, xor_n(reg, reg->b))
+OPCODE(0xA9, "XOR C",         NONE,  4, REG, xor_n(reg, reg->c))
+OPCODE(0xAA, "XOR D",         NONE,  4, REG, xor_n(reg, reg->d))
+OPCODE(0xAB, "XOR E",         NONE,  4, REG, xor_n(reg, reg->e))
+OPCODE(0xAC, "XOR H",         NONE,  4, REG, xor_n(reg, reg->h))
+OPCODE(0xAD, "XOR L",         NONE,  4, REG, xor_n(reg, reg->l))
+OPCODE(0xAE, "XOR (HL)",      NONE,  8, MEM, xor_n_slow(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0xAF, "XOR A",         NONE,  4, REG, xor_n(reg, reg->a))
+OPCODE(0xB0, "OR B",          NONE,  4, REG, or_n(reg, reg->b))
+OPCODE(0xB1, "OR C",          NONE,  4, REG, or_n(reg, reg->c))
+OPCODE(0xB2, "OR D",          NONE,  4, REG, or_n(reg, reg->d))
+OPCODE(0xB3, "OR E",          NONE,  4, REG, or_n(reg, reg->e))
+OPCODE(0xB4, "OR H",          NONE,  4, REG, or_n(reg, reg->h))
+OPCODE(0xB5, "OR L",          NONE,  4, REG, or_n(reg, reg->l))
+OPCODE(0xB6, "OR (HL)",       NONE,  8, MEM, or_n_slow(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0xB7, "OR A",          NONE,  4, REG, or_n(reg, reg->a))
+OPCODE(0xB8, "CP B",          NONE,  4, REG, cp_n(reg, reg->b))
+OPCODE(0xB9, "CP C",          NONE,  4, REG, cp_n(reg, reg->c))
+OPCODE(0xBA, "CP D",          NONE,  4, REG, cp_n(reg, reg->d))
+OPCODE(0xBB, "CP E",          NONE,  4, REG, cp_n(reg, reg->e))
+OPCODE(0xBC, "CP H",          NONE,  4, REG, cp_n(reg, reg->h))
+OPCODE(0xBD, "CP L",          NONE,  4, REG, cp_n(reg, reg->l))
+OPCODE(0xBE, "CP (HL)",       NONE,  8, MEM, cp_n_slow(reg, mmu_read_byte(mem, reg->hl)))
+OPCODE(0xBF, "CP A",          NONE,  4, REG, cp_n(reg, reg->a))
+OPCODE(0xC0, "RET NZ",        NONE,  0, MEM, ret_cc(reg, mem, !flag_z(reg)))
+OPCODE(0xC1, "POP BC",        NONE, 12, MEM, pop_nn(reg, mem, &reg->bc))
+OPCODE(0xC2, "JP NZ, nn",     D16,   0, REG, jp_nz(reg, nn))
+OPCODE(0xC3, "JP nn",         D16,  16, REG, jp_nn(reg, nn))
+OPCODE(0xC4, "CALL NZ, nn",   D16,   0, MEM, call_nz(reg, mem, nn))
+OPCODE(0xC5, "PUSH BC",       NONE, 16, MEM, push_nn(reg, mem, reg->bc))
+OPCODE(0xC6, "ADD A, n",      D8,    8, REG, add_n(reg, n))
+OPCODE(0xC7, "RST 00H",       NONE, 16, MEM, rst_n(reg, mem, 0x00))
+OPCODE(0xC8, "RET Z",         NONE,  0, MEM, ret_cc(reg, mem, flag_z(reg)))
+OPCODE(0xC9, "RET",           NONE, 16, MEM, ret(reg, mem))
+OPCODE(0xCA, "JP Z, nn",      D16,   0, REG, jp_z(reg, nn))
+OPCODE(0xCB, "PREFIX CB",     D8,    0, REG, return cb_command(reg, mem, n))
+OPCODE(0xCC, "CALL Z, nn",    D16,   0, MEM, call_z(reg, mem, nn))
+OPCODE(0xCD, "CALL nn",       D16,  24, MEM, call_nn(reg, mem, nn))
+OPCODE(0xCE, "ADC A, n",      D8,    8, REG, adc_a_n(reg, n))
+OPCODE(0xCF, "RST 08H",       NONE, 16, MEM, rst_n(reg, mem, 0x08))
+OPCODE(0xD0, "RET NC",        NONE,  0, MEM, ret_cc(reg, mem, !flag_c(reg)))
+OPCODE(0xD1, "POP DE",        NONE, 12, MEM, pop_nn(reg, mem, &reg->de))
+OPCODE(0xD2, "JP NC, nn",     D16,   0, REG, jp_nc(reg, nn))
+OPCODE(0xD3, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xD4, "CALL NC, nn",   D16,   0, MEM, call_nc(reg, mem, nn))
+OPCODE(0xD5, "PUSH DE",       NONE, 16, MEM, push_nn(reg, mem, reg->de))
+OPCODE(0xD6, "SUB n",         D8,    8, REG, sub_n(reg, n))
+OPCODE(0xD7, "RST 10H",       NONE, 16, MEM, rst_n(reg, mem, 0x10))
+OPCODE(0xD8, "RET C",         NONE,  0, MEM, ret_cc(reg, mem, flag_c(reg)))
+OPCODE(0xD9, "RETI",          NONE, 16, MEM, reti(reg, mem))
+OPCODE(0xDA, "JP C, nn",      D16,   0, REG, jp_c(reg, nn))
+OPCODE(0xDB, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xDC, "CALL C, nn",    D16,   0, MEM, call_c(reg, mem, nn))
+OPCODE(0xDD, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xDE, "SBC A, n",      D8,    8, REG, sbc_a_n(reg, n))
+OPCODE(0xDF, "RST 18H",       NONE, 16, MEM, rst_n(reg, mem, 0x18))
+OPCODE(0xE0, "LDH (n), A",    D8,   12, MEM, ldh_n_a(reg, mem, n))
+OPCODE(0xE1, "POP HL",        NONE, 12, MEM, pop_nn(reg, mem, &reg->hl))
+OPCODE(0xE2, "LD (C), A",     NONE,  8, MEM, ld_c_a(reg, mem))
+OPCODE(0xE3, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xE4, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xE5, "PUSH HL",       NONE, 16, MEM, push_nn(reg, mem, reg->hl))
+OPCODE(0xE6, "AND n",         D8,    8, REG, and_n_slow(reg, n))
+OPCODE(0xE7, "RST 20H",       NONE, 16, MEM, rst_n(reg, mem, 0x20))
+OPCODE(0xE8, "ADD SP, e",     S8,   16, REG, add_sp_n(reg, n))
+OPCODE(0xE9, "JP (HL)",       NONE,  4, REG, jp_hl(reg))
+OPCODE(0xEA, "LD (nn), A",    D16,  16, MEM, ld_nn_a_slow(reg, mem, nn))
+OPCODE(0xEB, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xEC, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xED, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xEE, "XOR n",         D8,    8, REG, xor_n_slow(reg, n))
+OPCODE(0xEF, "RST 28H",       NONE, 16, MEM, rst_n(reg, mem, 0x28))
+OPCODE(0xF0, "LDH A, (n)",    D8,   12, MEM, ldh_a_n(reg, mem, n))
+OPCODE(0xF1, "POP AF",        NONE, 12, MEM, pop_af(reg, mem))
+OPCODE(0xF2, "LD A, (C)",     NONE,  8, MEM, ld_a_c(reg, mem))
+OPCODE(0xF3, "DI",            NONE,  4, REG, di(reg))
+OPCODE(0xF4, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xF5, "PUSH AF",       NONE, 16, MEM, push_nn(reg, mem, (cpu_flags(reg), reg->af)))
+OPCODE(0xF6, "OR n",          D8,    8, REG, or_n_slow(reg, n))
+OPCODE(0xF7, "RST 30H",       NONE, 16, MEM, rst_n(reg, mem, 0x30))
+OPCODE(0xF8, "LDHL SP, e",    S8,   12, REG, ldhl_sp_n(reg, n))
+OPCODE(0xF9, "LD SP, HL",     NONE,  8, REG, ld_sp_hl(reg))
+OPCODE(0xFA, "LD A, (nn)",    D16,  16, MEM, ld_a_nn(reg, mem, nn))
+OPCODE(0xFB, "EI",            NONE,  4, REG, ei(reg))
+OPCODE(0xFC, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xFD, "-",             NONE,  0, CPU, return unknown_command(reg, mem))
+OPCODE(0xFE, "CP n",          D8,    8, REG, cp_n_slow(reg, n))
+OPCODE(0xFF, "RST 38H",       NONE, 16, MEM, rst_n(reg, mem, 0x38))
+
+CB_OPCODE(0x00, "RLC B",          8, REG, rlc_n(reg, &reg->b))
+CB_OPCODE(0x01, "RLC C",          8, REG, rlc_n(reg, &reg->c))
+CB_OPCODE(0x02, "RLC D",          8, REG, rlc_n(reg, &reg->d))
+CB_OPCODE(0x03, "RLC E",          8, REG, rlc_n(reg, &reg->e))
+CB_OPCODE(0x04, "RLC H",          8, REG, rlc_n(reg, &reg->h))
+CB_OPCODE(0x05, "RLC L",          8, REG, rlc_n(reg, &reg->l))
+CB_OPCODE(0x06, "RLC (HL)",      16, MEM, rlc_hl(reg, mem))
+CB_OPCODE(0x07, "RLC A",          8, REG, rlc_n(reg, &reg->a))
+CB_OPCODE(0x08, "RRC B",          8, REG, rrc_n(reg, &reg->b))
+CB_OPCODE(0x09, "RRC C",          8, REG, rrc_n(reg, &reg->c))
+CB_OPCODE(0x0A, "RRC D",          8, REG, rrc_n(reg, &reg->d))
+CB_OPCODE(0x0B, "RRC E",          8, REG, rrc_n(reg, &reg->e))
+CB_OPCODE(0x0C, "RRC H",          8, REG, rrc_n(reg, &reg->h))
+CB_OPCODE(0x0D, "RRC L",          8, REG, rrc_n(reg, &reg->l))
+CB_OPCODE(0x0E, "RRC (HL)",      16, MEM, rrc_hl(reg, mem))
+CB_OPCODE(0x0F, "RRC A",          8, REG, rrc_n(reg, &reg->a))
+CB_OPCODE(0x10, "RL B",           8, REG, rl_n(reg, &reg->b))
+CB_OPCODE(0x11, "RL C",           8, REG, rl_n(reg, &reg->c))
+CB_OPCODE(0x12, "RL D",           8, REG, rl_n(reg, &reg->d))
+CB_OPCODE(0x13, "RL E",           8, REG, rl_n(reg, &reg->e))
+CB_OPCODE(0x14, "RL H",           8, REG, rl_n(reg, &reg->h))
+CB_OPCODE(0x15, "RL L",           8, REG, rl_n(reg, &reg->l))
+CB_OPCODE(0x16, "RL (HL)",       16, MEM, rl_hl(reg, mem))
+CB_OPCODE(0x17, "RL A",           8, REG, rl_n(reg, &reg->a))
+CB_OPCODE(0x18, "RR B",           8, REG, rr_n(reg, &reg->b))
+CB_OPCODE(0x19, "RR C",           8, REG, rr_n(reg, &reg->c))
+CB_OPCODE(0x1A, "RR D",           8, REG, rr_n(reg, &reg->d))
+CB_OPCODE(0x1B, "RR E",           8, REG, rr_n(reg, &reg->e))
+CB_OPCODE(0x1C, "RR H",           8, REG, rr_n(reg, &reg->h))
+CB_OPCODE(0x1D, "RR L",           8, REG, rr_n(reg, &reg->l))
+CB_OPCODE(0x1E, "RR (HL)",       16, MEM, rr_hl(reg, mem))
+CB_OPCODE(0x1F, "RR A",           8, REG, rr_n(reg, &reg->a))
+CB_OPCODE(0x20, "SLA B",          8, REG, sla_n(reg, &reg->b))
+CB_OPCODE(0x21, "SLA C",          8, REG, sla_n(reg, &reg->c))
+CB_OPCODE(0x22, "SLA D",          8, REG, sla_n(reg, &reg->d))
+CB_OPCODE(0x23, "SLA E",          8, REG, sla_n(reg, &reg->e))
+CB_OPCODE(0x24, "SLA H",          8, REG, sla_n(reg, &reg->h))
+CB_OPCODE(0x25, "SLA L",          8, REG, sla_n(reg, &reg->l))
+CB_OPCODE(0x26, "SLA (HL)",      16, MEM, sla_hl(reg, mem))
+CB_OPCODE(0x27, "SLA A",          8, REG, sla_n(reg, &reg->a))
+CB_OPCODE(0x28, "SRA B",          8, REG, sra_n(reg, &reg->b))
+CB_OPCODE(0x29, "SRA C",          8, REG, sra_n(reg, &reg->c))
+CB_OPCODE(0x2A, "SRA D",          8, REG, sra_n(reg, &reg->d))
+CB_OPCODE(0x2B, "SRA E",          8, REG, sra_n(reg, &reg->e))
+CB_OPCODE(0x2C, "SRA H",          8, REG, sra_n(reg, &reg->h))
+CB_OPCODE(0x2D, "SRA L",          8, REG, sra_n(reg, &reg->l))
+CB_OPCODE(0x2E, "SRA (HL)",      16, MEM, sra_hl(reg, mem))
+CB_OPCODE(0x2F, "SRA A",          8, REG, sra_n(reg, &reg->a))
+CB_OPCODE(0x30, "SWAP B",         8, REG, swap_n(reg, &reg->b))
+CB_OPCODE(0x31, "SWAP C",         8, REG, swap_n(reg, &reg->c))
+CB_OPCODE(0x32, "SWAP D",         8, REG, swap_n(reg, &reg->d))
+CB_OPCODE(0x33, "SWAP E",         8, REG, swap_n(reg, &reg->e))
+CB_OPCODE(0x34, "SWAP H",         8, REG, swap_n(reg, &reg->h))
+CB_OPCODE(0x35, "SWAP L",         8, REG, swap_n(reg, &reg->l))
+CB_OPCODE(0x36, "SWAP (HL)",     16, MEM, swap_hl(reg, mem))
+CB_OPCODE(0x37, "SWAP A",         8, REG, swap_n(reg, &reg->a))
+CB_OPCODE(0x38, "SRL B",          8, REG, srl_n(reg, &reg->b))
+CB_OPCODE(0x39, "SRL C",          8, REG, srl_n(reg, &reg->c))
+CB_OPCODE(0x3A, "SRL D",          8, REG, srl_n(reg, &reg->d))
+CB_OPCODE(0x3B, "SRL E",          8, REG, srl_n(reg, &reg->e))
+CB_OPCODE(0x3C, "SRL H",          8, REG, srl_n(reg, &reg->h))
+CB_OPCODE(0x3D, "SRL L",          8, REG, srl_n(reg, &reg->l))
+CB_OPCODE(0x3E, "SRL (HL)",      16, MEM, srl_hl(reg, mem))
+CB_OPCODE(0x3F, "SRL A",          8, REG, srl_n(reg, &reg->a))
+CB_OPCODE(0x40, "BIT 0, B",       8, REG, bit_b_r(reg, reg->b, 0))
+CB_OPCODE(0x41, "BIT 0, C",       8, REG, bit_b_r(reg, reg->c, 0))
+CB_OPCODE(0x42, "BIT 0, D",       8, REG, bit_b_r(reg, reg->d, 0))
+CB_OPCODE(0x43, "BIT 0, E",       8, REG, bit_b_r(reg, reg->e, 0))
+CB_OPCODE(0x44, "BIT 0, H",       8, REG, bit_b_r(reg, reg->h, 0))
+CB_OPCODE(0x45, "BIT 0, L",       8, REG, bit_b_r(reg, reg->l, 0))
+CB_OPCODE(0x46, "BIT 0, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 0))
+CB_OPCODE(0x47, "BIT 0, A",       8, REG, bit_b_r(reg, reg->a, 0))
+CB_OPCODE(0x48, "BIT 1, B",       8, REG, bit_b_r(reg, reg->b, 1))
+CB_OPCODE(0x49, "BIT 1, C",       8, REG, bit_b_r(reg, reg->c, 1))
+CB_OPCODE(0x4A, "BIT 1, D",       8, REG, bit_b_r(reg, reg->d, 1))
+CB_OPCODE(0x4B, "BIT 1, E",       8, REG, bit_b_r(reg, reg->e, 1))
+CB_OPCODE(0x4C, "BIT 1, H",       8, REG, bit_b_r(reg, reg->h, 1))
+CB_OPCODE(0x4D, "BIT 1, L",       8, REG, bit_b_r(reg, reg->l, 1))
+CB_OPCODE(0x4E, "BIT 1, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 1))
+CB_OPCODE(0x4F, "BIT 1, A",       8, REG, bit_b_r(reg, reg->a, 1))
+CB_OPCODE(0x50, "BIT 2, B",       8, REG, bit_b_r(reg, reg->b, 2))
+CB_OPCODE(0x51, "BIT 2, C",       8, REG, bit_b_r(reg, reg->c, 2))
+CB_OPCODE(0x52, "BIT 2, D",       8, REG, bit_b_r(reg, reg->d, 2))
+CB_OPCODE(0x53, "BIT 2, E",       8, REG, bit_b_r(reg, reg->e, 2))
+CB_OPCODE(0x54, "BIT 2, H",       8, REG, bit_b_r(reg, reg->h, 2))
+CB_OPCODE(0x55, "BIT 2, L",       8, REG, bit_b_r(reg, reg->l, 2))
+CB_OPCODE(0x56, "BIT 2, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 2))
+CB_OPCODE(0x57, "BIT 2, A",       8, REG, bit_b_r(reg, reg->a, 2))
+CB_OPCODE(0x58, "BIT 3, B",       8, REG, bit_b_r(reg, reg->b, 3))
+CB_OPCODE(0x59, "BIT 3, C",       8, REG, bit_b_r(reg, reg->c, 3))
+CB_OPCODE(0x5A, "BIT 3, D",       8, REG, bit_b_r(reg, reg->d, 3))
+CB_OPCODE(0x5B, "BIT 3, E",       8, REG, bit_b_r(reg, reg->e, 3))
+CB_OPCODE(0x5C, "BIT 3, H",       8, REG, bit_b_r(reg, reg->h, 3))
+CB_OPCODE(0x5D, "BIT 3, L",       8, REG, bit_b_r(reg, reg->l, 3))
+CB_OPCODE(0x5E, "BIT 3, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 3))
+CB_OPCODE(0x5F, "BIT 3, A",       8, REG, bit_b_r(reg, reg->a, 3))
+CB_OPCODE(0x60, "BIT 4, B",       8, REG, bit_b_r(reg, reg->b, 4))
+CB_OPCODE(0x61, "BIT 4, C",       8, REG, bit_b_r(reg, reg->c, 4))
+CB_OPCODE(0x62, "BIT 4, D",       8, REG, bit_b_r(reg, reg->d, 4))
+CB_OPCODE(0x63, "BIT 4, E",       8, REG, bit_b_r(reg, reg->e, 4))
+CB_OPCODE(0x64, "BIT 4, H",       8, REG, bit_b_r(reg, reg->h, 4))
+CB_OPCODE(0x65, "BIT 4, L",       8, REG, bit_b_r(reg, reg->l, 4))
+CB_OPCODE(0x66, "BIT 4, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 4))
+CB_OPCODE(0x67, "BIT 4, A",       8, REG, bit_b_r(reg, reg->a, 4))
+CB_OPCODE(0x68, "BIT 5, B",       8, REG, bit_b_r(reg, reg->b, 5))
+CB_OPCODE(0x69, "BIT 5, C",       8, REG, bit_b_r(reg, reg->c, 5))
+CB_OPCODE(0x6A, "BIT 5, D",       8, REG, bit_b_r(reg, reg->d, 5))
+CB_OPCODE(0x6B, "BIT 5, E",       8, REG, bit_b_r(reg, reg->e, 5))
+CB_OPCODE(0x6C, "BIT 5, H",       8, REG, bit_b_r(reg, reg->h, 5))
+CB_OPCODE(0x6D, "BIT 5, L",       8, REG, bit_b_r(reg, reg->l, 5))
+CB_OPCODE(0x6E, "BIT 5, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 5))
+CB_OPCODE(0x6F, "BIT 5, A",       8, REG, bit_b_r(reg, reg->a, 5))
+CB_OPCODE(0x70, "BIT 6, B",       8, REG, bit_b_r(reg, reg->b, 6))
+CB_OPCODE(0x71, "BIT 6, C",       8, REG, bit_b_r(reg, reg->c, 6))
+CB_OPCODE(0x72, "BIT 6, D",       8, REG, bit_b_r(reg, reg->d, 6))
+CB_OPCODE(0x73, "BIT 6, E",       8, REG, bit_b_r(reg, reg->e, 6))
+CB_OPCODE(0x74, "BIT 6, H",       8, REG, bit_b_r(reg, reg->h, 6))
+CB_OPCODE(0x75, "BIT 6, L",       8, REG, bit_b_r(reg, reg->l, 6))
+CB_OPCODE(0x76, "BIT 6, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 6))
+CB_OPCODE(0x77, "BIT 6, A",       8, REG, bit_b_r(reg, reg->a, 6))
+CB_OPCODE(0x78, "BIT 7, B",       8, REG, bit_b_r(reg, reg->b, 7))
+CB_OPCODE(0x79, "BIT 7, C",       8, REG, bit_b_r(reg, reg->c, 7))
+CB_OPCODE(0x7A, "BIT 7, D",       8, REG, bit_b_r(reg, reg->d, 7))
+CB_OPCODE(0x7B, "BIT 7, E",       8, REG, bit_b_r(reg, reg->e, 7))
+CB_OPCODE(0x7C, "BIT 7, H",       8, REG, bit_b_r(reg, reg->h, 7))
+CB_OPCODE(0x7D, "BIT 7, L",       8, REG, bit_b_r(reg, reg->l, 7))
+CB_OPCODE(0x7E, "BIT 7, (HL)",   12, MEM, bit_b_r(reg, mmu_read_byte(mem, reg->hl), 7))
+CB_OPCODE(0x7F, "BIT 7, A",       8, REG, bit_b_r(reg, reg->a, 7))
+CB_OPCODE(0x80, "RES 0, B",       8, REG, res_b_r(reg, &reg->b, 0))
+CB_OPCODE(0x81, "RES 0, C",       8, REG, res_b_r(reg, &reg->c, 0))
+CB_OPCODE(0x82, "RES 0, D",       8, REG, res_b_r(reg, &reg->d, 0))
+CB_OPCODE(0x83, "RES 0, E",       8, REG, res_b_r(reg, &reg->e, 0))
+CB_OPCODE(0x84, "RES 0, H",       8, REG, res_b_r(reg, &reg->h, 0))
+CB_OPCODE(0x85, "RES 0, L",       8, REG, res_b_r(reg, &reg->l, 0))
+CB_OPCODE(0x86, "RES 0, (HL)",   16, MEM, res_b_hl(reg, mem, 0))
+CB_OPCODE(0x87, "RES 0, A",       8, REG, res_b_r(reg, &reg->a, 0))
+CB_OPCODE(0x88, "RES 1, B",       8, REG, res_b_r(reg, &reg->b, 1))
+CB_OPCODE(0x89, "RES 1, C",       8, REG, res_b_r(reg, &reg->c, 1))
+CB_OPCODE(0x8A, "RES 1, D",       8, REG, res_b_r(reg, &reg->d, 1))
+CB_OPCODE(0x8B, "RES 1, E",       8, REG, res_b_r(reg, &reg->e, 1))
+CB_OPCODE(0x8C, "RES 1, H",       8, REG, res_b_r(reg, &reg->h, 1))
+CB_OPCODE(0x8D, "RES 1, L",       8, REG, res_b_r(reg, &reg->l, 1))
+CB_OPCODE(0x8E, "RES 1, (HL)",   16, MEM, res_b_hl(reg, mem, 1))
+CB_OPCODE(0x8F, "RES 1, A",       8, REG, res_b_r(reg, &reg->a, 1))
+CB_OPCODE(0x90, "RES 2, B",       8, REG, res_b_r(reg, &reg->b, 2))
+CB_OPCODE(0x91, "RES 2, C",       8, REG, res_b_r(reg, &reg->c, 2))
+CB_OPCODE(0x92, "RES 2, D",       8, REG, res_b_r(reg, &reg->d, 2))
+CB_OPCODE(0x93, "RES 2, E",       8, REG, res_b_r(reg, &reg->e, 2))
+CB_OPCODE(0x94, "RES 2, H",       8, REG, res_b_r(reg, &reg->h, 2))
+CB_OPCODE(0x95, "RES 2, L",       8, REG, res_b_r(reg, &reg->l, 2))
+CB_OPCODE(0x96, "RES 2, (HL)",   16, MEM, res_b_hl(reg, mem, 2))
+CB_OPCODE(0x97, "RES 2, A",       8, REG, res_b_r(reg, &reg->a, 2))
+CB_OPCODE(0x98, "RES 3, B",       8, REG, res_b_r(reg, &reg->b, 3))
+CB_OPCODE(0x99, "RES 3, C",       8, REG, res_b_r(reg, &reg->c, 3))
+CB_OPCODE(0x9A, "RES 3, D",       8, REG, res_b_r(reg, &reg->d, 3))
+CB_OPCODE(0x9B, "RES 3, E",       8, REG, res_b_r(reg, &reg->e, 3))
+CB_OPCODE(0x9C, "RES 3, H",       8, REG, res_b_r(reg, &reg->h, 3))
+CB_OPCODE(0x9D, "RES 3, L",       8, REG, res_b_r(reg, &reg->l, 3))
+CB_OPCODE(0x9E, "RES 3, (HL)",   16, MEM, res_b_hl(reg, mem, 3))
+CB_OPCODE(0x9F, "RES 3, A",       8, REG, res_b_r(reg, &reg->a, 3))
+CB_OPCODE(0xA0, "RES 4, B",       8, REG, res_b_r(reg, &reg->b, 4))
+CB_OPCODE(0xA1, "RES 4, C",       8, REG, res_b_r(reg, &reg->c, 4))
+CB_OPCODE(0xA2, "RES 4, D",       8, REG, res_b_r(reg, &reg->d, 4))
+CB_OPCODE(0xA3, "RES 4, E",       8, REG, res_b_r(reg, &reg->e, 4))
+CB_OPCODE(0xA4, "RES 4, H",       8, REG, res_b_r(reg, &reg->h, 4))
+CB_OPCODE(0xA5, "RES 4, L",       8, REG, res_b_r(reg, &reg->l, 4))
+CB_OPCODE(0xA6, "RES 4, (HL)",   16, MEM, res_b_hl(reg, mem, 4))
+CB_OPCODE(0xA7, "RES 4, A",       8, REG, res_b_r(reg, &reg->a, 4))
+CB_OPCODE(0xA8, "RES 5, B",       8, REG, res_b_r(reg, &reg->b, 5))
+CB_OPCODE(0xA9, "RES 5, C",       8, REG, res_b_r(reg, &reg->c, 5))
+CB_OPCODE(0xAA, "RES 5, D",       8, REG, res_b_r(reg, &reg->d, 5))
+CB_OPCODE(0xAB, "RES 5, E",       8, REG, res_b_r(reg, &reg->e, 5))
+CB_OPCODE(0xAC, "RES 5, H",       8, REG, res_b_r(reg, &reg->h, 5))
+CB_OPCODE(0xAD, "RES 5, L",       8, REG, res_b_r(reg, &reg->l, 5))
+CB_OPCODE(0xAE, "RES 5, (HL)",   16, MEM, res_b_hl(reg, mem, 5))
+CB_OPCODE(0xAF, "RES 5, A",       8, REG, res_b_r(reg, &reg->a, 5))
+CB_OPCODE(0xB0, "RES 6, B",       8, REG, res_b_r(reg, &reg->b, 6))
+CB_OPCODE(0xB1, "RES 6, C",       8, REG, res_b_r(reg, &reg->c, 6))
+CB_OPCODE(0xB2, "RES 6, D",       8, REG, res_b_r(reg, &reg->d, 6))
+CB_OPCODE(0xB3, "RES 6, E",       8, REG, res_b_r(reg, &reg->e, 6))
+CB_OPCODE(0xB4, "RES 6, H",       8, REG, res_b_r(reg, &reg->h, 6))
+CB_OPCODE(0xB5, "RES 6, L",       8, REG, res_b_r(reg, &reg->l, 6))
+CB_OPCODE(0xB6, "RES 6, (HL)",   16, MEM, res_b_hl(reg, mem, 6))
+CB_OPCODE(0xB7, "RES 6, A",       8, REG, res_b_r(reg, &reg->a, 6))
+CB_OPCODE(0xB8, "RES 7, B",       8, REG, res_b_r(reg, &reg->b, 7))
+CB_OPCODE(0xB9, "RES 7, C",       8, REG, res_b_r(reg, &reg->c, 7))
+CB_OPCODE(0xBA, "RES 7, D",       8, REG, res_b_r(reg, &reg->d, 7))
+CB_OPCODE(0xBB, "RES 7, E",       8, REG, res_b_r(reg, &reg->e, 7))
+CB_OPCODE(0xBC, "RES 7, H",       8, REG, res_b_r(reg, &reg->h, 7))
+CB_OPCODE(0xBD, "RES 7, L",       8, REG, res_b_r(reg, &reg->l, 7))
+CB_OPCODE(0xBE, "RES 7, (HL)",   16, MEM, res_b_hl(reg, mem, 7))
+CB_OPCODE(0xBF, "RES 7, A",       8, REG, res_b_r(reg, &reg->a, 7))
+CB_OPCODE(0xC0, "SET 0, B",       8, REG, set_b_r(reg, &reg->b, 0))
+CB_OPCODE(0xC1, "SET 0, C",       8, REG, set_b_r(reg, &reg->c, 0))
+CB_OPCODE(0xC2, "SET 0, D",       8, REG, set_b_r(reg, &reg->d, 0))
+CB_OPCODE(0xC3, "SET 0, E",       8, REG, set_b_r(reg, &reg->e, 0))
+CB_OPCODE(0xC4, "SET 0, H",       8, REG, set_b_r(reg, &reg->h, 0))
+CB_OPCODE(0xC5, "SET 0, L",       8, REG, set_b_r(reg, &reg->l, 0))
+CB_OPCODE(0xC6, "SET 0, (HL)",   16, MEM, set_b_hl(reg, mem, 0))
+CB_OPCODE(0xC7, "SET 0, A",       8, REG, set_b_r(reg, &reg->a, 0))
+CB_OPCODE(0xC8, "SET 1, B",       8, REG, set_b_r(reg, &reg->b, 1))
+CB_OPCODE(0xC9, "SET 1, C",       8, REG, set_b_r(reg, &reg->c, 1))
+CB_OPCODE(0xCA, "SET 1, D",       8, REG, set_b_r(reg, &reg->d, 1))
+CB_OPCODE(0xCB, "SET 1, E",       8, REG, set_b_r(reg, &reg->e, 1))
+CB_OPCODE(0xCC, "SET 1, H",       8, REG, set_b_r(reg, &reg->h, 1))
+CB_OPCODE(0xCD, "SET 1, L",       8, REG, set_b_r(reg, &reg->l, 1))
+CB_OPCODE(0xCE, "SET 1, (HL)",   16, MEM, set_b_hl(reg, mem, 1))
+CB_OPCODE(0xCF, "SET 1, A",       8, REG, set_b_r(reg, &reg->a, 1))
+CB_OPCODE(0xD0, "SET 2, B",       8, REG, set_b_r(reg, &reg->b, 2))
+CB_OPCODE(0xD1, "SET 2, C",       8, REG, set_b_r(reg, &reg->c, 2))
+CB_OPCODE(0xD2, "SET 2, D",       8, REG, set_b_r(reg, &reg->d, 2))
+CB_OPCODE(0xD3, "SET 2, E",       8, REG, set_b_r(reg, &reg->e, 2))
+CB_OPCODE(0xD4, "SET 2, H",       8, REG, set_b_r(reg, &reg->h, 2))
+CB_OPCODE(0xD5, "SET 2, L",       8, REG, set_b_r(reg, &reg->l, 2))
+CB_OPCODE(0xD6, "SET 2, (HL)",   16, MEM, set_b_hl(reg, mem, 2))
+CB_OPCODE(0xD7, "SET 2, A",       8, REG, set_b_r(reg, &reg->a, 2))
+CB_OPCODE(0xD8, "SET 3, B",       8, REG, set_b_r(reg, &reg->b, 3))
+CB_OPCODE(0xD9, "SET 3, C",       8, REG, set_b_r(reg, &reg->c, 3))
+CB_OPCODE(0xDA, "SET 3, D",       8, REG, set_b_r(reg, &reg->d, 3))
+CB_OPCODE(0xDB, "SET 3, E",       8, REG, set_b_r(reg, &reg->e, 3))
+CB_OPCODE(0xDC, "SET 3, H",       8, REG, set_b_r(reg, &reg->h, 3))
+CB_OPCODE(0xDD, "SET 3, L",       8, REG, set_b_r(reg, &reg->l, 3))
+CB_OPCODE(0xDE, "SET 3, (HL)",   16, MEM, set_b_hl(reg, mem, 3))
+CB_OPCODE(0xDF, "SET 3, A",       8, REG, set_b_r(reg, &reg->a, 3))
+CB_OPCODE(0xE0, "SET 4, B",       8, REG, set_b_r(reg, &reg->b, 4))
+CB_OPCODE(0xE1, "SET 4, C",       8, REG, set_b_r(reg, &reg->c, 4))
+CB_OPCODE(0xE2, "SET 4, D",       8, REG, set_b_r(reg, &reg->d, 4))
+CB_OPCODE(0xE3, "SET 4, E",       8, REG, set_b_r(reg, &reg->e, 4))
+CB_OPCODE(0xE4, "SET 4, H",       8, REG, set_b_r(reg, &reg->h, 4))
+CB_OPCODE(0xE5, "SET 4, L",       8, REG, set_b_r(reg, &reg->l, 4))
+CB_OPCODE(0xE6, "SET 4, (HL)",   16, MEM, set_b_hl(reg, mem, 4))
+CB_OPCODE(0xE7, "SET 4, A",       8, REG, set_b_r(reg, &reg->a, 4))
+CB_OPCODE(0xE8, "SET 5, B",       8, REG, set_b_r(reg, &reg->b, 5))
+CB_OPCODE(0xE9, "SET 5, C",       8, REG, set_b_r(reg, &reg->c, 5))
+CB_OPCODE(0xEA, "SET 5, D",       8, REG, set_b_r(reg, &reg->d, 5))
+CB_OPCODE(0xEB, "SET 5, E",       8, REG, set_b_r(reg, &reg->e, 5))
+CB_OPCODE(0xEC, "SET 5, H",       8, REG, set_b_r(reg, &reg->h, 5))
+CB_OPCODE(0xED, "SET 5, L",       8, REG, set_b_r(reg, &reg->l, 5))
+CB_OPCODE(0xEE, "SET 5, (HL)",   16, MEM, set_b_hl(reg, mem, 5))
+CB_OPCODE(0xEF, "SET 5, A",       8, REG, set_b_r(reg, &reg->a, 5))
+CB_OPCODE(0xF0, "SET 6, B",       8, REG, set_b_r(reg, &reg->b, 6))
+CB_OPCODE(0xF1, "SET 6, C",       8, REG, set_b_r(reg, &reg->c, 6))
+CB_OPCODE(0xF2, "SET 6, D",       8, REG, set_b_r(reg, &reg->d, 6))
+CB_OPCODE(0xF3, "SET 6, E",       8, REG, set_b_r(reg, &reg->e, 6))
+CB_OPCODE(0xF4, "SET 6, H",       8, REG, set_b_r(reg, &reg->h, 6))
+CB_OPCODE(0xF5, "SET 6, L",       8, REG, set_b_r(reg, &reg->l, 6))
+CB_OPCODE(0xF6, "SET 6, (HL)",   16, MEM, set_b_hl(reg, mem, 6))
+CB_OPCODE(0xF7, "SET 6, A",       8, REG, set_b_r(reg, &reg->a, 6))
+CB_OPCODE(0xF8, "SET 7, B",       8, REG, set_b_r(reg, &reg->b, 7))
+CB_OPCODE(0xF9, "SET 7, C",       8, REG, set_b_r(reg, &reg->c, 7))
+CB_OPCODE(0xFA, "SET 7, D",       8, REG, set_b_r(reg, &reg->d, 7))
+CB_OPCODE(0xFB, "SET 7, E",       8, REG, set_b_r(reg, &reg->e, 7))
+CB_OPCODE(0xFC, "SET 7, H",       8, REG, set_b_r(reg, &reg->h, 7))
+CB_OPCODE(0xFD, "SET 7, L",       8, REG, set_b_r(reg, &reg->l, 7))
+CB_OPCODE(0xFE, "SET 7, (HL)",   16, MEM, set_b_hl(reg, mem, 7))
+CB_OPCODE(0xFF, "SET 7, A",       8, REG, set_b_r(reg, &reg->a, 7))
@@ -3,29 +3,42 @@
 #include "logger.h"
 #include "memory_inline.h"
 
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
 
-int gpu_init(gpu *g, gpu_init_cb cb)
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <stdlib.h>
+#endif
+
+#if defined(AVX2)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SSE2
+#endif
+
+int gpu_init(gpu *g, gpu_init_cb cb, void *context)
 {
   g->app_data = NULL;
   g->pixel_data = NULL;
 
-  if (!cb(g))
+  if (!cb(context, g))
     {
       return 0;
     }
 
   gpu_reset(g);
 
-#ifdef CGB
+  gpu_select_core(g, false);
+
   g->color_correction =
 #ifdef COLOR_CORRECTION
     true;
 #else
     false;
-#endif
 #endif
 
   return 1;
@@ -34,6 +47,7 @@ int gpu_init(gpu *g, gpu_init_cb cb)
 void gpu_reset(gpu *g)
 {
   g->clock.t = 0;
+  g->sprites_height = 0;
 }
 
 #ifndef NDEBUG
@@ -44,7 +58,6 @@ void gpu_debug_print(gpu *g, level l)
 }
 #endif
 
-#ifdef CGB
 // Adaptation of http://alienryderflex.com/saturation.html by Darel Rex Finley
 static inline void change_saturation(uint8_t *r, uint8_t *g, uint8_t *b, const double change)
 {
@@ -82,13 +95,10 @@ static inline uint8_t convert_color(const uint8_t color)
   return (uint8_t)((uint32_t)(color) * 0xFF / 0x1F);
 }
 
-static inline const uint8_t *get_color(const unsigned int raw_color,
-                                       const uint8_t *palette,
-                                       bool color_correction)
+static void get_color(uint8_t *colors,
+                      const uint16_t p_colors,
+                      bool color_correction)
 {
-  static uint8_t colors[3];
-  const uint16_t p_colors = palette[raw_color * 2] + (palette[raw_color * 2 + 1] << 8);
-
 #if defined (RGBA8888)
   const uint8_t r_index = 0;
   const uint8_t g_index = 1;
@@ -116,266 +126,401 @@ static inline const uint8_t *get_color(const unsigned int raw_color,
       colors[b_index] = convert_color((p_colors >> 10) & 0x1F);
     }
 
-  return colors;
+  colors[3] = 255;
 }
 
-static inline uint8_t *get_palette_address(memory *mem,
-                                           const uint8_t palette_index,
-                                           const uint8_t bg_palette_num)
-{
-  return &mem->palette[palette_index][bg_palette_num * 8];
-}
-#endif
+#define COLOR_TABLE_SIZE 0x8000
+
+// Pixels of every RGB555 color, without and with color correction. Built
+// once for all instances, by whichever gets to it first.
+static uint32_t color_tables[2][COLOR_TABLE_SIZE];
+static volatile long color_tables_state[2];
+
+enum {
+  COLOR_TABLE_EMPTY,
+  COLOR_TABLE_BUILDING,
+  COLOR_TABLE_BUILT
+};
 
-static inline const uint8_t *get_mono_color(const unsigned int raw_color,
-                                            const unsigned int palette)
+static const uint32_t *get_color_table(const bool color_correction)
 {
-  static const uint8_t colors[] = { 255, 255, 255, 192, 192, 192, 96, 96, 96, 0, 0, 0 };
-  return &colors[((palette >> (raw_color * 2)) & 0x03) * 3];
-}
+  volatile long *state = &color_tables_state[color_correction];
+
+#ifdef _MSC_VER
+  if (_InterlockedCompareExchange(state, COLOR_TABLE_BUILT, COLOR_TABLE_BUILT) == COLOR_TABLE_BUILT)
+    return color_tables[color_correction];
+
+  if (_InterlockedCompareExchange(state, COLOR_TABLE_BUILDING, COLOR_TABLE_EMPTY) == COLOR_TABLE_EMPTY)
+#else
+  if (__atomic_load_n(state, __ATOMIC_ACQUIRE) == COLOR_TABLE_BUILT)
+    return color_tables[color_correction];
 
-static inline const uint8_t *get_color_data(const unsigned int raw_color,
-                                            const uint8_t mono_palette
-#ifdef CGB
-                                            , const uint8_t *color_palette,
-                                            bool color_correction
+  long expected = COLOR_TABLE_EMPTY;
+  if (__atomic_compare_exchange_n(state, &expected, COLOR_TABLE_BUILDING, false,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
 #endif
-                                            )
-{
-    return
-#ifdef CGB
-      color_palette ?
-      get_color(raw_color, color_palette, color_correction) :
+    {
+      for (uint32_t color = 0; color < COLOR_TABLE_SIZE; ++color)
+        {
+          uint8_t pixel[4];
+          get_color(pixel, (uint16_t)color, color_correction);
+          memcpy(&color_tables[color_correction][color], pixel, sizeof pixel);
+        }
+
+#ifdef _MSC_VER
+      _InterlockedExchange(state, COLOR_TABLE_BUILT);
+#else
+      __atomic_store_n(state, COLOR_TABLE_BUILT, __ATOMIC_RELEASE);
+#endif
+    }
+  else
+    {
+      // Another instance is building it
+#ifdef _MSC_VER
+      while (_InterlockedCompareExchange(state, COLOR_TABLE_BUILT, COLOR_TABLE_BUILT) != COLOR_TABLE_BUILT)
+        ;
+#else
+      while (__atomic_load_n(state, __ATOMIC_ACQUIRE) != COLOR_TABLE_BUILT)
+        ;
 #endif
-      get_mono_color(raw_color, mono_palette);
+    }
+
+  return color_tables[color_correction];
 }
 
-void write_texture(uint8_t y,
-                   int16_t x,
-                   uint16_t raw_tile_data,
-                   uint8_t *texture,
-                   uint8_t *row_data,
-                   bool transparent,
-                   bool priority,
-                   bool x_flip,
-                   uint8_t mono_palette
-#ifdef CGB
-                   , const uint8_t *color_palette,
-                   bool bg_priority,
-                   bool color_correction
-#endif
-                   )
+static inline uint32_t get_mono_color(const unsigned int raw_color,
+                                      const unsigned int palette)
 {
-  static const unsigned int per_line_offset = 256 * 4;
-  const unsigned int line_offset = per_line_offset * y;
+  static const uint8_t levels[] = { 255, 192, 96, 0 };
+  const uint8_t level = levels[(palette >> (raw_color * 2)) & 0x03];
+  const uint8_t pixel[4] = { level, level, level, 255 };
 
-  int i;
+  uint32_t color;
+  memcpy(&color, pixel, sizeof color);
 
-  for(i = 0; i < 8; ++i)
-    {
-      const unsigned int bit_offset = x_flip ? i : (7 - i);
-      int16_t x_position = x + bit_offset;
+  return color;
+}
 
-      if (x_position < 0)
-        {
-          x_position += 256;
-        }
-      else if (x_position >= 256)
-        {
-          x_position -= 256;
-        }
+// Palettes are resolved to pixels only after having been written
+static void resolve_palettes(gpu *g, memory *mem)
+{
+  static const uint16_t mono_palettes[] = {
+    MEM_BGP_ADDR, MEM_OBP0_ADDR, MEM_OBP1_ADDR
+  };
 
-      if (x_position < 160)
-        {
-          const unsigned int raw_color_1 = (raw_tile_data >> i) & 0x0001;
-          const unsigned int raw_color_2 = (raw_tile_data >> (i + 7)) & 0x0002;
-          const unsigned int raw_color = raw_color_1 + raw_color_2;
+  for (unsigned int p = 0; p < 3; ++p)
+    {
+      const uint8_t palette = read_io_byte(mem, mono_palettes[p]);
+
+      for (unsigned int c = 0; c < 4; ++c)
+        g->mono_colors[p][c] = get_mono_color(c, palette);
+    }
 
-          const unsigned int output_pixel_offset =
-            line_offset + (x_position * 4);
+  // Color palettes are only used by CGB games
+  if (mem->cgb_mode)
+    {
+      const uint32_t *table = get_color_table(g->color_correction);
 
-          if (transparent)
+      for (unsigned int i = 0; i < 2; ++i)
+        for (unsigned int p = 0; p < 8; ++p)
+          for (unsigned int c = 0; c < 4; ++c)
             {
-              if (raw_color &&
-#ifdef CGB
-                  row_data[x_position] != PRIORITY_COLOR &&
-#endif
-                  (priority ||
-                   (!row_data[x_position])))
-                {
-                  memcpy(texture + output_pixel_offset, get_color_data(raw_color, mono_palette
-#ifdef CGB
-                      , color_palette,
-                      color_correction
-#endif
-                  ), 3);
-                  texture[output_pixel_offset + 3] = 255;
-                  if (row_data)
-                    {
-                      row_data[x_position] = (uint8_t)raw_color;
-                    }
-                }
+              const uint8_t *data = &mem->palette[i][p * 8 + c * 2];
+              g->colors[i][p][c] = table[(data[0] | data[1] << 8) & 0x7FFF];
             }
-          else
-            {
-              memcpy(texture + output_pixel_offset, get_color_data(raw_color, mono_palette
-#ifdef CGB
-                  , color_palette,
-                  color_correction
-#endif
-              ), 3);
-              texture[output_pixel_offset + 3] = 255;
-              if (row_data)
-                {
-                  row_data[x_position] =
-#ifdef CGB
-                    bg_priority && raw_color ?
-                    PRIORITY_COLOR :
-#endif
-                    (uint8_t)raw_color;
-                }
-            }
-        }
     }
+
+  mem->palettes_resolved = true;
 }
 
-static inline uint16_t get_tile_data(memory *mem,
-                                     const uint16_t address
-#ifdef CGB
-                                     , const uint8_t tile_vram_bank_number
+// Layers of a line are drawn with room for the tiles and sprites cut by
+// either edge of the screen
+#define LINE_PADDING 8
+#define LINE_SIZE (LINE_PADDING + X_RES + LINE_PADDING)
+
+// Attributes of a background pixel, a sprite pixel being hidden by those
+// it shares
+#define BG_OPAQUE 0x01
+#define BG_PRIORITY 0x02
+
+#define PIXEL_BYTES(b) (0x0101010101010101ULL * (uint8_t)(b))
+
+static inline uint64_t reverse_pixels(const uint64_t pixels)
+{
+#ifdef _MSC_VER
+  return _byteswap_uint64(pixels);
+#else
+  return __builtin_bswap64(pixels);
 #endif
-                                     )
+}
+
+// 0xFF for each pixel of another color than 0
+static inline uint64_t opaque_pixels(const uint64_t pixels)
+{
+  return ((pixels | pixels >> 1) & PIXEL_BYTES(0x01)) * 0xFF;
+}
+
+// Writes the 8 pixels of a tile row as indices of the colors from
+// first_color on, those of color 0 being kept if transparent
+static inline void write_layer(uint8_t *layer,
+                               uint8_t *layer_attr,
+                               const int16_t x,
+                               const uint8_t *tile_row,
+                               const bool transparent,
+                               const bool x_flip,
+                               const uint8_t first_color,
+                               const uint8_t attr)
+{
+  uint64_t pixels, indices, attrs;
+  memcpy(&pixels, tile_row, 8);
+
+  if (x_flip)
+    pixels = reverse_pixels(pixels);
+
+  const uint64_t opaque = opaque_pixels(pixels);
+  const uint64_t mask = transparent ? opaque : ~(uint64_t)0;
+
+  memcpy(&indices, layer + LINE_PADDING + x, 8);
+  memcpy(&attrs, layer_attr + LINE_PADDING + x, 8);
+
+  indices = (indices & ~mask) | ((pixels + PIXEL_BYTES(first_color)) & mask);
+  attrs = (attrs & ~mask) | (PIXEL_BYTES(attr) & opaque);
+
+  memcpy(layer + LINE_PADDING + x, &indices, 8);
+  memcpy(layer_attr + LINE_PADDING + x, &attrs, 8);
+}
+
+// Resolves the line to the color of the sprite where one is drawn and not
+// hidden by the background, or else to that of the background
+static inline void compose_line(uint8_t *output,
+                                const uint32_t *colors,
+                                const uint8_t *bg,
+                                const uint8_t *bg_attr,
+                                const uint8_t *obj,
+                                const uint8_t *obj_attr)
 {
-  uint16_t tile_data = mem->video_ram
-#ifdef CGB
-    [tile_vram_bank_number]
+  uint8_t indices[X_RES];
+  unsigned int x = 0;
+
+#if defined(AVX2)
+  for (; x + 32 <= X_RES; x += 32)
+    {
+      const __m256i b = _mm256_loadu_si256((const __m256i *)(bg + x));
+      const __m256i o = _mm256_loadu_si256((const __m256i *)(obj + x));
+      const __m256i hidden = _mm256_and_si256(
+        _mm256_loadu_si256((const __m256i *)(bg_attr + x)),
+        _mm256_loadu_si256((const __m256i *)(obj_attr + x)));
+      const __m256i zero = _mm256_setzero_si256();
+      const __m256i shown = _mm256_andnot_si256(_mm256_cmpeq_epi8(o, zero),
+                                                _mm256_cmpeq_epi8(hidden, zero));
+
+      _mm256_storeu_si256((__m256i *)(indices + x), _mm256_blendv_epi8(b, o, shown));
+    }
+#elif defined(SSE2)
+  for (; x + 16 <= X_RES; x += 16)
+    {
+      const __m128i b = _mm_loadu_si128((const __m128i *)(bg + x));
+      const __m128i o = _mm_loadu_si128((const __m128i *)(obj + x));
+      const __m128i hidden = _mm_and_si128(
+        _mm_loadu_si128((const __m128i *)(bg_attr + x)),
+        _mm_loadu_si128((const __m128i *)(obj_attr + x)));
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i shown = _mm_andnot_si128(_mm_cmpeq_epi8(o, zero),
+                                             _mm_cmpeq_epi8(hidden, zero));
+
+      _mm_storeu_si128((__m128i *)(indices + x),
+                       _mm_or_si128(_mm_and_si128(shown, o),
+                                    _mm_andnot_si128(shown, b)));
+    }
 #endif
-    [address];
 
-  tile_data += mem->video_ram
-#ifdef CGB
-    [tile_vram_bank_number]
+  for (; x < X_RES; ++x)
+    {
+      const bool shown = obj[x] && !(bg_attr[x] & obj_attr[x]);
+      indices[x] = shown ? obj[x] : bg[x];
+    }
+
+  x = 0;
+
+#ifdef AVX2
+  for (; x + 8 <= X_RES; x += 8)
+    {
+      const __m256i i = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(indices + x)));
+      _mm256_storeu_si256((__m256i *)(output + x * 4),
+                          _mm256_i32gather_epi32((const int *)colors, i, 4));
+    }
 #endif
-    [address + 1] << 8;
 
-  return tile_data;
+  for (; x < X_RES; ++x)
+    memcpy(output + x * 4, &colors[indices[x]], 4);
+}
+
+static void decode_tile(gpu *g, memory *mem, const uint8_t bank, const uint16_t tile)
+{
+  const uint8_t *data = &mem->video_ram[bank][tile * 16];
+
+  for (unsigned int row = 0; row < 8; ++row)
+    {
+      const uint8_t low = data[row * 2];
+      const uint8_t high = data[row * 2 + 1];
+
+      for (unsigned int x = 0; x < 8; ++x)
+        {
+          g->tiles[bank][tile][row][x] =
+            ((low >> (7 - x)) & 0x01) | (((high >> (7 - x)) & 0x01) << 1);
+        }
+    }
+
+  mem->tiles_decoded[bank][tile] = true;
+}
+
+// Tiles are decoded once, until their data gets written
+static inline const uint8_t *get_tile_row(gpu *g,
+                                          memory *mem,
+                                          const uint16_t tile,
+                                          const uint8_t row,
+                                          const uint8_t bank)
+{
+  if (!mem->tiles_decoded[bank][tile])
+    decode_tile(g, mem, bank, tile);
+
+  return g->tiles[bank][tile][row];
 }
 
-static inline void process_background_tiles(memory *mem,
+// Draws tile_count tiles of the map row from first_column on, the first
+// one at x, only those on screen needing to be drawn
+static inline void process_background_tiles(gpu *g,
+                                            memory *mem,
                                             const uint8_t line,
                                             uint8_t line_data_offset,
                                             const uint16_t tile_map_addr,
                                             const uint16_t tile_data_addr,
-                                            const int16_t offset,
-                                            uint8_t *output,
-                                            uint8_t *row_data
-#ifdef CGB
-                                            , bool color_correction
-#endif
-                                            )
+                                            const uint8_t first_column,
+                                            const int16_t x,
+                                            const uint8_t tile_count,
+                                            uint8_t *layer,
+                                            uint8_t *layer_attr,
+                                            const bool cgb)
 {
-  size_t tile_pos;
-  uint16_t tile_data;
+  uint8_t tile_pos;
 
   uint16_t input_line = line + line_data_offset;
   if (input_line >= 256)
     input_line -= 256;
   const uint8_t line_offset = input_line / 8;
   const uint8_t line_modulo = (input_line % 8);
-  const uint16_t tile_base_addr = tile_data_addr + (line_modulo * 2);
-  uint16_t addr =
+  const uint16_t tile_base = (tile_data_addr - 0x8000) / 16;
+  const uint16_t base_addr =
     tile_map_addr + (line_offset * 32) - 0x8000;
-#ifdef CGB
-  const uint16_t base_addr = addr;
-  const uint8_t* color_palette = NULL;
   bool horizontal_flip = false;
-  int8_t vertical_flip_data_offset = 0;
+  bool vertical_flip = false;
   uint8_t tile_vram_bank_number = 0;
   bool priority = false;
-#endif
 
-  const uint8_t mono_palette =
-#ifdef CGB
-    mem->cgb_mode ? 0 :
-#endif
-    read_io_byte(mem, MEM_BGP_ADDR);
+  uint8_t first_color = 0;
 
-  for(tile_pos=0; tile_pos<32; ++tile_pos)
+  for(tile_pos=0; tile_pos<tile_count; ++tile_pos)
     {
-      uint8_t id = mem->video_ram
-#ifdef CGB
-        [MEM_CHARACTER_CODE_BANK_INDEX]
-#endif
-        [addr++];
+      // Map rows wrap around
+      const uint16_t addr = base_addr + ((first_column + tile_pos) & 31);
+
+      uint8_t id = mem->video_ram[MEM_CHARACTER_CODE_BANK_INDEX][addr];
 
       // TODO: fix properly
       if (tile_data_addr == MEM_TILE_ADDR_1)
         id += 128;
 
-#ifdef CGB
-      if (mem->cgb_mode)
+      if (cgb)
         {
-          const uint8_t bg_map = mem->video_ram[MEM_ATTRIBUTES_CODE_BANK_INDEX][base_addr + tile_pos];
+          const uint8_t bg_map = mem->video_ram[MEM_ATTRIBUTES_CODE_BANK_INDEX][addr];
           const uint8_t palette_num = bg_map & PALETTE_NUM_MASK;
           tile_vram_bank_number = (bg_map >> 3) & 0x01;
           horizontal_flip = (bg_map >> 5) & 0x01;
-          vertical_flip_data_offset = (bg_map >> 6) & 0x01 ?
-            14 - line_modulo * 4
-            : 0;
+          vertical_flip = (bg_map >> 6) & 0x01;
           priority = (bg_map >> 7) & 0x01;
 
-          color_palette = get_palette_address(mem, MEM_PALETTE_BG_INDEX, palette_num);
+          first_color = (MEM_PALETTE_BG_INDEX * 8 + palette_num) * 4;
         }
-#endif
 
-      const uint16_t tile_base_addr_final = tile_base_addr + (id * 16) - 0x8000;
+      const uint8_t *tile_row = get_tile_row(g, mem,
+        tile_base + id,
+        vertical_flip ? 7 - line_modulo : line_modulo,
+        tile_vram_bank_number);
+
+      write_layer(layer,
+                  layer_attr,
+                  (int16_t)(x + tile_pos * 8),
+                  tile_row,
+                  false,
+                  horizontal_flip,
+                  first_color,
+                  priority ? BG_OPAQUE | BG_PRIORITY :
+                  BG_OPAQUE);
+    }
+}
 
-      tile_data = get_tile_data(mem,
-        tile_base_addr_final
-#ifdef CGB
-          + vertical_flip_data_offset
-        , tile_vram_bank_number
-#endif
-      );
-
-      write_texture(line,
-                    (uint16_t)(tile_pos * 8 + offset),
-                    tile_data,
-                    output,
-                    row_data,
-                    false,
-                    true,
-#ifdef CGB
-                    horizontal_flip,
-#else
-                    false,
-#endif
-                    mono_palette
-#ifdef CGB
-                    , color_palette,
-                    priority,
-                    color_correction
-#endif
-      );
+// Selects the sprites of each line like the OAM search does, the first
+// ones in OAM covering it up to the limit, in order of priority
+static void select_sprites(gpu *g,
+                           memory *mem,
+                           const uint16_t attribute_map_addr,
+                           const uint8_t height,
+                           const bool cgb)
+{
+  static const uint8_t number_of_sprites = 40;
+  const unsigned int sprite_attributes_len = 4;
+  uint8_t i;
+
+  memset(g->line_sprite_count, 0, sizeof g->line_sprite_count);
+
+  for (i = 0; i < number_of_sprites; ++i)
+    {
+      const uint16_t addr = attribute_map_addr + i * sprite_attributes_len;
+      const int16_t y = read_oam_byte(mem, addr) - 16;
+      const uint8_t x = read_oam_byte(mem, addr + 1);
+      int16_t line = y < 0 ? 0 : y;
+      const int16_t end = y + height < Y_RES ? y + height : Y_RES;
+
+      for (; line < end; ++line)
+        {
+          uint8_t *sprites = g->line_sprites[line];
+          unsigned int pos = g->line_sprite_count[line];
+
+          if (pos == MAX_LINE_SPRITES)
+            continue;
+
+          // On DMG sprites further left are in front, ties and CGB going
+          // by the order in OAM
+          if (!cgb)
+            while (pos &&
+                   read_oam_byte(mem, attribute_map_addr +
+                                 sprites[pos - 1] * sprite_attributes_len + 1) > x)
+              {
+                sprites[pos] = sprites[pos - 1];
+                --pos;
+              }
+
+          sprites[pos] = i;
+          ++g->line_sprite_count[line];
+        }
     }
+
+  g->sprites_height = height;
+  mem->sprites_selected = true;
 }
 
-static inline void process_sprite_attributes(memory *mem,
+static inline void process_sprite_attributes(gpu *g,
+                                             memory *mem,
                                              const uint8_t line,
-                                             uint16_t attribute_map_addr,
+                                             const uint16_t attribute_map_addr,
                                              const bool high,
                                              const uint16_t sprite_data_addr,
-                                             uint8_t *output,
-                                             uint8_t *row_data
-#ifdef CGB
-                                             , bool color_correction
-#endif
-                                             )
+                                             uint8_t *layer,
+                                             uint8_t *layer_attr,
+                                             const bool cgb)
 {
-  static const int number_of_sprites = 40;
   const unsigned int sprite_attributes_len = 4;
   int i;
-  uint16_t tile_data;
   const uint8_t height = high ? 16 : 8;
   struct{
     struct{
@@ -383,187 +528,230 @@ static inline void process_sprite_attributes(memory *mem,
     }pos;
     uint8_t pattern, flags;
   }sprite_attributes;
-  // Read sprites back to front to get priority correct
-  attribute_map_addr += number_of_sprites * sprite_attributes_len - 1;
-#ifdef CGB
-  const uint8_t* color_palette = NULL;
   uint8_t tile_vram_bank_number = 0;
-#endif
 
-  for(i=0; i<number_of_sprites; ++i)
+  // Sprites are selected once, until OAM gets written
+  if (!mem->sprites_selected || g->sprites_height != height)
+    select_sprites(g, mem, attribute_map_addr, height, cgb);
+
+  const uint8_t *sprites = g->line_sprites[line];
+
+  // Read sprites back to front to get priority correct
+  for(i=g->line_sprite_count[line] - 1; i>=0; --i)
     {
-      sprite_attributes.flags = read_oam_byte(mem, attribute_map_addr--);
-      sprite_attributes.pattern = read_oam_byte(mem, attribute_map_addr--);
-      sprite_attributes.pos.x = read_oam_byte(mem, attribute_map_addr--);
-      sprite_attributes.pos.y = read_oam_byte(mem, attribute_map_addr--);
+      const uint16_t addr = attribute_map_addr + sprites[i] * sprite_attributes_len;
 
-      if (sprite_attributes.pos.x || sprite_attributes.pos.y)
-        {
-          sprite_attributes.pos.x -= 8;
-          sprite_attributes.pos.y -= 16;
+      sprite_attributes.pos.y = read_oam_byte(mem, addr) - 16;
+      sprite_attributes.pos.x = read_oam_byte(mem, addr + 1) - 8;
+      sprite_attributes.pattern = read_oam_byte(mem, addr + 2);
+      sprite_attributes.flags = read_oam_byte(mem, addr + 3);
 
-          if (line >= sprite_attributes.pos.y &&
-              line < (sprite_attributes.pos.y + height))
-            {
-              const bool priority = !(sprite_attributes.flags & OBJ_PRIORITY_FLAG);
-              uint8_t mono_palette = 0;
-              const bool x_flip = sprite_attributes.flags & OBJ_X_FLIP_FLAG;
-              const bool y_flip = sprite_attributes.flags & OBJ_Y_FLIP_FLAG;
-              uint8_t sprite_line = (line - sprite_attributes.pos.y) % height;
-
-#ifdef CGB
-              if (mem->cgb_mode)
-                {
-                  const uint8_t palette_num = sprite_attributes.flags & PALETTE_NUM_MASK;
-                  color_palette = get_palette_address(mem, MEM_PALETTE_SPRITE_INDEX, palette_num);
-                  tile_vram_bank_number = sprite_attributes.flags & OBJ_TILE_VRAM_BANK_FLAG ? 1 : 0;
-                }
-              else
-                {
-#endif
-                  const uint16_t mono_palette_address =
-                    sprite_attributes.flags & OBJ_PALETTE_FLAG ?
-                    MEM_OBP1_ADDR : MEM_OBP0_ADDR;
-                  mono_palette = read_io_byte(mem, mono_palette_address);
-#ifdef CGB
-                }
-#endif
+      // Sprites off screen still count towards the limit
+      if (sprite_attributes.pos.x <= -8 ||
+          sprite_attributes.pos.x >= X_RES)
+        continue;
 
-              if (high)
-                {
-                  sprite_attributes.pattern &= ~0x01;
-                }
+      const bool priority = !(sprite_attributes.flags & OBJ_PRIORITY_FLAG);
+      uint8_t first_color;
+      const bool x_flip = sprite_attributes.flags & OBJ_X_FLIP_FLAG;
+      const bool y_flip = sprite_attributes.flags & OBJ_Y_FLIP_FLAG;
+      uint8_t sprite_line = line - sprite_attributes.pos.y;
 
-              if (y_flip)
-                {
-                  sprite_line = (height - 1) - sprite_line;
-                }
+      if (cgb)
+        {
+          const uint8_t palette_num = sprite_attributes.flags & PALETTE_NUM_MASK;
+          first_color = (MEM_PALETTE_SPRITE_INDEX * 8 + palette_num) * 4;
+          tile_vram_bank_number = sprite_attributes.flags & OBJ_TILE_VRAM_BANK_FLAG ? 1 : 0;
+        }
+      else
+        {
+          first_color = (sprite_attributes.flags & OBJ_PALETTE_FLAG ? 2 : 1) * 4;
+        }
 
-              const uint16_t tile_base_addr_final = sprite_data_addr +
-                (sprite_attributes.pattern * 16) +
-                (sprite_line * 2) - 0x8000;
+      if (high)
+        {
+          sprite_attributes.pattern &= ~0x01;
+        }
 
-              tile_data = get_tile_data(mem,
-                tile_base_addr_final
-#ifdef CGB
-                , tile_vram_bank_number
-#endif
-              );
-
-              write_texture(line,
-                            sprite_attributes.pos.x,
-                            tile_data,
-                            output,
-                            row_data,
-                            true,
-                            priority,
-                            x_flip,
-                            mono_palette
-#ifdef CGB
-                            , color_palette,
-                            false,
-                            color_correction
-#endif
-              );
-            }
+      if (y_flip)
+        {
+          sprite_line = (height - 1) - sprite_line;
         }
+
+      // Tall sprites go on to the next tile
+      const uint8_t *tile_row = get_tile_row(g, mem,
+        (sprite_data_addr - 0x8000) / 16 +
+        sprite_attributes.pattern + sprite_line / 8,
+        sprite_line % 8,
+        tile_vram_bank_number);
+
+      // Sprites in front are drawn over those behind, then over the
+      // background unless hidden by it when composing
+      write_layer(layer,
+                  layer_attr,
+                  sprite_attributes.pos.x,
+                  tile_row,
+                  true,
+                  x_flip,
+                  first_color,
+                  priority ? BG_PRIORITY : BG_PRIORITY | BG_OPAQUE);
     }
 }
 
-static inline void scanline(gpu *g, memory *mem, const uint8_t line, gpu_alloc_image_buffer_cb a_cb)
+static inline void render_line(gpu *g, memory *mem, const uint8_t line,
+                               const bool cgb)
 {
-  if (!g->pixel_data)
+  const uint8_t lcdc = read_io_byte(mem, MEM_LCDC_ADDR);
+  const bool bg_enabled = lcdc & MEM_LCDC_BG_WINDOW_ENABLED_FLAG;
+
+  // Indices of the colors of each layer, the sprite one being 0 where
+  // there is none, and the attributes of their pixels
+  uint8_t bg[LINE_SIZE], bg_attr[LINE_SIZE];
+  uint8_t obj[LINE_SIZE], obj_attr[LINE_SIZE];
+  memset(obj, 0, sizeof(obj));
+  memset(obj_attr, 0, sizeof(obj_attr));
+
+  if (!mem->palettes_resolved)
+    resolve_palettes(g, mem);
+
+  if (bg_enabled)
     {
-      if (a_cb) a_cb(g);
+      const uint16_t tile_map_address =
+        lcdc & MEM_LCDC_TILEMAP_SELECT_FLAG ?
+        MEM_TILE_MAP_ADDR_2 :
+        MEM_TILE_MAP_ADDR_1;
+
+      const uint16_t tile_data_address =
+        lcdc & MEM_LCDC_TILEMAP_DATA_FLAG ?
+        MEM_TILE_ADDR_2 :
+        MEM_TILE_ADDR_1;
+
+      // From the tile under SCX, 21 tiles when the first one is cut
+      const uint8_t scroll_x = read_io_byte(mem, MEM_SCX_ADDR);
+
+      process_background_tiles(g, mem,
+                               line,
+                               read_io_byte(mem, MEM_SCY_ADDR),
+                               tile_map_address,
+                               tile_data_address,
+                               scroll_x / 8,
+                               -(int16_t)(scroll_x % 8),
+                               scroll_x % 8 ? X_RES / 8 + 1 : X_RES / 8,
+                               bg,
+                               bg_attr,
+                               cgb);
     }
 
-  if (g->pixel_data)
+  if (bg_enabled &&
+      lcdc & MEM_LCDC_WINDOW_ENABLED_FLAG)
     {
-      const uint8_t lcdc = read_io_byte(mem, MEM_LCDC_ADDR);
-      uint8_t row[160];
-      memset(row, 0, sizeof(row));
+      const uint8_t window_y = read_io_byte(mem, MEM_WY_ADDR);
 
-      if (lcdc & MEM_LCDC_BG_WINDOW_ENABLED_FLAG)
+      if (line >= window_y && window_y < 144)
         {
-          const uint16_t tile_map_address =
-            lcdc & MEM_LCDC_TILEMAP_SELECT_FLAG ?
-            MEM_TILE_MAP_ADDR_2 :
-            MEM_TILE_MAP_ADDR_1;
-
-          const uint16_t tile_data_address =
-            lcdc & MEM_LCDC_TILEMAP_DATA_FLAG ?
-            MEM_TILE_ADDR_2 :
-            MEM_TILE_ADDR_1;
-
-          process_background_tiles(mem,
-                                   line,
-                                   read_io_byte(mem, MEM_SCY_ADDR),
-                                   tile_map_address,
-                                   tile_data_address,
-                                   (int16_t)read_io_byte(mem, MEM_SCX_ADDR) *
-                                   -1,
-                                   g->pixel_data,
-                                   row
-#ifdef CGB
-                                   , g->color_correction
-#endif
-          );
-        }
-
-      if (lcdc & MEM_LCDC_BG_WINDOW_ENABLED_FLAG &&
-          lcdc & MEM_LCDC_WINDOW_ENABLED_FLAG)
-        {
-          const uint8_t window_y = read_io_byte(mem, MEM_WY_ADDR);
+          const int16_t window_x = read_io_byte(mem, MEM_WX_ADDR);
 
-          if (line >= window_y && window_y < 144)
+          if (window_x < 167)
             {
-              const int16_t window_x = read_io_byte(mem, MEM_WX_ADDR);
-
-              if (window_x < 167)
-                {
-                  const uint16_t tile_map_address =
-                    lcdc & MEM_LCDC_WINDOW_TILEMAP_SELECT_FLAG ?
-                    MEM_TILE_MAP_ADDR_2 :
-                    MEM_TILE_MAP_ADDR_1;
-
-                  const uint16_t tile_data_address =
-                    lcdc & MEM_LCDC_TILEMAP_DATA_FLAG ?
-                    MEM_TILE_ADDR_2 :
-                    MEM_TILE_ADDR_1;
-
-                  process_background_tiles(mem,
-                                           line,
-                                           256 - window_y,
-                                           tile_map_address,
-                                           tile_data_address,
-                                           256 + (window_x - 7),
-                                           g->pixel_data,
-                                           row
-#ifdef CGB
-                                           , g->color_correction
-#endif
-                  );
-                }
+              const uint16_t tile_map_address =
+                lcdc & MEM_LCDC_WINDOW_TILEMAP_SELECT_FLAG ?
+                MEM_TILE_MAP_ADDR_2 :
+                MEM_TILE_MAP_ADDR_1;
+
+              const uint16_t tile_data_address =
+                lcdc & MEM_LCDC_TILEMAP_DATA_FLAG ?
+                MEM_TILE_ADDR_2 :
+                MEM_TILE_ADDR_1;
+
+              // From WX - 7 to the end of the line
+              const int16_t x = window_x - 7;
+
+              process_background_tiles(g, mem,
+                                       line,
+                                       256 - window_y,
+                                       tile_map_address,
+                                       tile_data_address,
+                                       0,
+                                       x,
+                                       (X_RES - x + 7) / 8,
+                                       bg,
+                                       bg_attr,
+                                       cgb);
             }
         }
+    }
 
-      if (lcdc & MEM_LCDC_SPRITES_ENABLED_FLAG)
+  if (lcdc & MEM_LCDC_SPRITES_ENABLED_FLAG)
+    {
+      process_sprite_attributes(g, mem,
+                                line,
+                                MEM_SPRITE_ATTRIBUTE_TABLE,
+                                lcdc & MEM_LCDC_SPRITES_SIZE_FLAG,
+                                MEM_SPRITE_ADDR,
+                                obj,
+                                obj_attr,
+                                cgb);
+    }
+
+  uint8_t *output = (uint8_t *)g->pixel_data + line * 256 * 4;
+  const uint32_t *colors = cgb ? g->colors[0][0] : g->mono_colors[0];
+
+  if (bg_enabled)
+    {
+      compose_line(output,
+                   colors,
+                   bg + LINE_PADDING,
+                   bg_attr + LINE_PADDING,
+                   obj + LINE_PADDING,
+                   obj_attr + LINE_PADDING);
+    }
+  else
+    {
+      // Only sprites are drawn
+      for (unsigned int x = 0; x < X_RES; ++x)
         {
-          process_sprite_attributes(mem,
-                                    line,
-                                    MEM_SPRITE_ATTRIBUTE_TABLE,
-                                    lcdc & MEM_LCDC_SPRITES_SIZE_FLAG,
-                                    MEM_SPRITE_ADDR,
-                                    g->pixel_data,
-                                    row
-#ifdef CGB
-                                    , g->color_correction
-#endif
-          );
+          const uint8_t index = obj[LINE_PADDING + x];
+
+          if (index)
+            memcpy(output + x * 4, &colors[index], 4);
         }
     }
 }
 
+// Renderers specialized for each core, see gpu_select_core()
+
+static void render_line_dmg(gpu *g, memory *mem, const uint8_t line)
+{
+  render_line(g, mem, line, false);
+}
+
+static void render_line_cgb(gpu *g, memory *mem, const uint8_t line)
+{
+  render_line(g, mem, line, true);
+}
+
+void gpu_select_core(gpu *g, const bool cgb)
+{
+  g->render_line = cgb ? render_line_cgb : render_line_dmg;
+
+  // Sprites are ordered differently on each
+  g->sprites_height = 0;
+}
+
+static inline void scanline(gpu *g, memory *mem, const uint8_t line,
+                            gpu_alloc_image_buffer_cb a_cb, void *a_context)
+{
+  if (!g->pixel_data)
+    {
+      if (a_cb) a_cb(a_context, g);
+    }
+
+  if (g->pixel_data)
+    {
+      g->render_line(g, mem, line);
+    }
+}
+
 static inline state get_mode(memory *mem)
 {
   // Optimize a bit by not reading through mmu_read_byte
@@ -579,7 +767,28 @@ static void set_mode(memory *mem, const state mode)
   write_io_byte(mem, MEM_LCD_STAT, stat);
 }
 
-int gpu_update(gpu *g, memory *mem, const uint8_t last_t, gpu_render_cb r_cb, gpu_alloc_image_buffer_cb a_cb)
+unsigned int gpu_cycles_to_event(gpu *g, memory *mem)
+{
+  // A pending reset is handled by the next update
+  if (mem->lcd_stopped)
+    return 1;
+
+  const uint8_t lcdc = read_io_byte(mem, MEM_LCDC_ADDR);
+  if (!(lcdc & MEM_LCDC_SCREEN_ENABLED_FLAG))
+    return UINT_MAX;
+
+  // Indexed by mode
+  static const uint16_t mode_cycles[] = {
+    HBLANK_CYCLES, VBLANK_CYCLES, READ_OAM_CYCLES, READ_VRAM_CYCLES
+  };
+  const uint16_t cycles = mode_cycles[get_mode(mem)];
+
+  return g->clock.t < cycles ? cycles - g->clock.t : 1;
+}
+
+int gpu_update(gpu *g, memory *mem, const unsigned int cycles,
+               gpu_render_cb r_cb, void *r_context,
+               gpu_alloc_image_buffer_cb a_cb, void *a_context)
 {
   // Reset GPU state if LCD got disabled
   if (mem->lcd_stopped)
@@ -595,7 +804,7 @@ int gpu_update(gpu *g, memory *mem, const uint8_t last_t, gpu_render_cb r_cb, gp
   if (!(lcdc & MEM_LCDC_SCREEN_ENABLED_FLAG))
     return 0;
 
-  g->clock.t += last_t;
+  g->clock.t += cycles;
 
   uint8_t line = read_io_byte(mem, MEM_LY_ADDR);
 
@@ -618,13 +827,11 @@ int gpu_update(gpu *g, memory *mem, const uint8_t last_t, gpu_render_cb r_cb, gp
         {
           g->clock.t = 0;
 
-#ifdef CGB
           if (mem->cgb_mode)
             {
               mmu_hblank_dma(mem);
             }
-#endif
-          scanline(g, mem, line, a_cb);
+          scanline(g, mem, line, a_cb, a_context);
 
           isr_set_lcdc_isr_if_enabled(mem, MEM_LCDC_HBLANK_ISR_ENABLED_FLAG);
 
@@ -674,7 +881,7 @@ int gpu_update(gpu *g, memory *mem, const uint8_t last_t, gpu_render_cb r_cb, gp
 
               isr_set_lcdc_isr_if_enabled(mem, MEM_LCDC_OAM_ISR_ENABLED_FLAG);
 
-              r_cb(g);
+              r_cb(r_context, g);
 
               gb_log (VERBOSE, "GPU RENDER - OAM");
             }
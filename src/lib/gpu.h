@@ -12,6 +12,11 @@ typedef enum state_e {
   VBLANK = 0x01
 } state;
 
+#define X_RES 160
+#define Y_RES 144
+
+#define MAX_LINE_SPRITES 10
+
 struct gpu_s {
   struct {
     uint16_t t;
@@ -20,26 +25,43 @@ struct gpu_s {
   void *app_data;
   void *pixel_data;
 
-#ifdef CGB
+  // Rows of tiles decoded to the color of each pixel from left to right,
+  // valid for the tiles memory flags in tiles_decoded
+  uint8_t tiles[MEM_VIDEO_RAM_BANKS][MEM_TILES][8][8];
+
+  // Pixels of the colors of BGP, OBP0 and OBP1, and on CGB of the
+  // background and sprite palettes, valid while memory flags palettes as
+  // resolved. Lines are composed looking them up by palette * 4 + color.
+  uint32_t mono_colors[3][4];
+  uint32_t colors[2][8][4];
+
+  // OAM indices of the sprites drawn on each line, front to back, valid
+  // while memory flags sprites as selected and for sprites of the height
+  // they were selected for, 0 if none
+  uint8_t line_sprites[Y_RES][MAX_LINE_SPRITES];
+  uint8_t line_sprite_count[Y_RES];
+  uint8_t sprites_height;
+
   bool color_correction;
-#endif
+
+  // Scanline renderer of the DMG or CGB core
+  void (*render_line)(struct gpu_s *g, memory *mem, const uint8_t line);
 };
 
 typedef struct gpu_s gpu;
 
-typedef bool (*gpu_init_cb)(gpu*);
-typedef void (*gpu_uninit_cb)(gpu*);
-typedef bool (*gpu_alloc_image_buffer_cb)(gpu*);
-typedef void (*gpu_render_cb)(gpu*);
-
-#define X_RES 160
-#define Y_RES 144
+typedef bool (*gpu_init_cb)(void *context, gpu*);
+typedef void (*gpu_uninit_cb)(void *context, gpu*);
+typedef bool (*gpu_alloc_image_buffer_cb)(void *context, gpu*);
+typedef void (*gpu_render_cb)(void *context, gpu*);
 
 #define READ_OAM_CYCLES 80
 #define READ_VRAM_CYCLES 172
 #define HBLANK_CYCLES 204
 #define VBLANK_CYCLES 456
 
+#define FRAME_CYCLES 70224
+
 #define LCD_STAT_MODE_MASK 0x03
 
 #define OBJ_PALETTE_FLAG 0x10
@@ -50,20 +72,26 @@ typedef void (*gpu_render_cb)(gpu*);
 
 #define PALETTE_NUM_MASK 0x07
 
-#define PRIORITY_COLOR 0xFF
-
 #define WINDOW_SCALE 2
 
-int gpu_init(gpu *g, gpu_init_cb cb);
+int gpu_init(gpu *g, gpu_init_cb cb, void *context);
 
 void gpu_reset(gpu *g);
 
+// Selects code specialized for running DMG or CGB games
+void gpu_select_core(gpu *g, const bool cgb);
+
 #ifndef NDEBUG
 void gpu_debug_print(gpu *g, level l);
 #else
 #define gpu_debug_print(g, l) ;
 #endif
 
-int gpu_update(gpu *g, memory *mem, const uint8_t last_t, gpu_render_cb r_cb, gpu_alloc_image_buffer_cb l_cb);
+// Number of CPU cycles before the next mode transition, UINT_MAX if LCD is off
+unsigned int gpu_cycles_to_event(gpu *g, memory *mem);
+
+int gpu_update(gpu *g, memory *mem, const unsigned int cycles,
+               gpu_render_cb r_cb, void *r_context,
+               gpu_alloc_image_buffer_cb a_cb, void *a_context);
 
 #endif
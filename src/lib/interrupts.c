@@ -34,6 +34,8 @@ void isr_compare_ly_lyc(memory *mem, const uint8_t ly, const uint8_t lyc)
 
 void isr_set_if_flag(memory *mem, const uint8_t flag)
 {
-  const uint8_t if_flag = read_io_byte(mem, MEM_IF_ADDR);
-  write_io_byte(mem, MEM_IF_ADDR, if_flag | flag);
+  const uint8_t if_flag = read_io_byte(mem, MEM_IF_ADDR) | flag;
+  write_io_byte(mem, MEM_IF_ADDR, if_flag);
+
+  mem->irq_pending = if_flag & mem->ie_register;
 }
@@ -0,0 +1,547 @@
+#include "jit.h"
+
+#ifdef JIT_ENABLED
+
+#include "block.h"
+#include "logger.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+// Largest code emitted for one instruction, with room to spare
+#define JIT_MAX_OP_SIZE 256
+
+// Host registers holding state while compiled code runs
+#define RAX 0
+#define RCX 1
+#define RBX 3
+#define R12 12
+#define R13 13
+#define R15 15
+
+#define REG_OFFSET(field) ((int32_t)offsetof(registers, field))
+#define MEM_OFFSET(field) ((int32_t)offsetof(memory, field))
+#define BATCH_OFFSET(field) ((int32_t)offsetof(block_batch, field))
+
+// Jumps to the exits, patched once the function is complete
+#define JIT_MAX_FIXUPS (BLOCK_MAX_LENGTH * 5)
+
+typedef struct emitter_s {
+  uint8_t *p;
+
+  // Returning 0, or 1 when a handler or step() returned a positive value
+  uint8_t *exit_fixups[JIT_MAX_FIXUPS];
+  uint8_t *step_fixups[JIT_MAX_FIXUPS];
+  unsigned int exit_count, step_count;
+} emitter;
+
+static inline void emit8(emitter *e, const uint8_t b)
+{
+  *e->p++ = b;
+}
+
+static inline void emit16(emitter *e, const uint16_t w)
+{
+  memcpy(e->p, &w, sizeof w);
+  e->p += sizeof w;
+}
+
+static inline void emit32(emitter *e, const uint32_t d)
+{
+  memcpy(e->p, &d, sizeof d);
+  e->p += sizeof d;
+}
+
+static inline void emit64(emitter *e, const uint64_t q)
+{
+  memcpy(e->p, &q, sizeof q);
+  e->p += sizeof q;
+}
+
+// REX prefix for a register operand and a memory base, if needed
+static inline void emit_rex(emitter *e, const bool w, const uint8_t reg, const uint8_t base)
+{
+  const uint8_t rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+
+  if (rex != 0x40)
+    emit8(e, rex);
+}
+
+// ModRM addressing [base + disp32]
+static inline void emit_mem(emitter *e, const uint8_t reg, const uint8_t base, const int32_t disp)
+{
+  emit8(e, 0x80 | ((reg & 7) << 3) | (base & 7));
+
+  if ((base & 7) == 4)
+    emit8(e, 0x24);
+
+  emit32(e, (uint32_t)disp);
+}
+
+static inline void emit_jcc(emitter *e, const uint8_t cc, const bool step)
+{
+  emit8(e, 0x0F);
+  emit8(e, cc);
+
+  if (step)
+    e->step_fixups[e->step_count++] = e->p;
+  else
+    e->exit_fixups[e->exit_count++] = e->p;
+
+  emit32(e, 0);
+}
+
+static inline void emit_jmp(emitter *e)
+{
+  emit8(e, 0xE9);
+  e->exit_fixups[e->exit_count++] = e->p;
+  emit32(e, 0);
+}
+
+#define JCC_JAE 0x83
+#define JCC_JNE 0x85
+
+// mov word [base + disp], imm16
+static void emit_store16(emitter *e, const uint8_t base, const int32_t disp, const uint16_t value)
+{
+  emit8(e, 0x66);
+  emit_rex(e, false, 0, base);
+  emit8(e, 0xC7);
+  emit_mem(e, 0, base, disp);
+  emit16(e, value);
+}
+
+// mov byte [base + disp], imm8
+static void emit_store8(emitter *e, const uint8_t base, const int32_t disp, const uint8_t value)
+{
+  emit_rex(e, false, 0, base);
+  emit8(e, 0xC6);
+  emit_mem(e, 0, base, disp);
+  emit8(e, value);
+}
+
+// cmp byte [base + disp], 0
+static void emit_test8(emitter *e, const uint8_t base, const int32_t disp)
+{
+  emit_rex(e, false, 0, base);
+  emit8(e, 0x80);
+  emit_mem(e, 7, base, disp);
+  emit8(e, 0);
+}
+
+// mov rax, imm64 ; call rax
+static void emit_call(emitter *e, const void *function)
+{
+  emit8(e, 0x48);
+  emit8(e, 0xB8);
+  emit64(e, (uint64_t)(uintptr_t)function);
+  emit8(e, 0xFF);
+  emit8(e, 0xD0);
+}
+
+// mov rdi, rbx ; mov rsi, r12
+static void emit_reg_mem_args(emitter *e)
+{
+  emit8(e, 0x48);
+  emit8(e, 0x89);
+  emit8(e, 0xDF);
+  emit8(e, 0x4C);
+  emit8(e, 0x89);
+  emit8(e, 0xE6);
+}
+
+static int32_t register8_offset(const uint8_t index)
+{
+  // Order used by opcodes, 6 is (HL)
+  switch (index)
+    {
+    case 0: return REG_OFFSET(b);
+    case 1: return REG_OFFSET(c);
+    case 2: return REG_OFFSET(d);
+    case 3: return REG_OFFSET(e);
+    case 4: return REG_OFFSET(h);
+    case 5: return REG_OFFSET(l);
+    case 7: return REG_OFFSET(a);
+    default: return -1;
+    }
+}
+
+static int32_t register16_offset(const uint8_t index)
+{
+  switch (index)
+    {
+    case 0: return REG_OFFSET(bc);
+    case 1: return REG_OFFSET(de);
+    case 2: return REG_OFFSET(hl);
+    default: return REG_OFFSET(sp);
+    }
+}
+
+static inline bool is_ld_r_r(const uint8_t code)
+{
+  return code >= 0x40 && code < 0x80 && code != 0x76 &&
+    (code & 0x07) != 6 && ((code >> 3) & 0x07) != 6;
+}
+
+static inline bool is_ld_r_n(const uint8_t code)
+{
+  return code < 0x40 && (code & 0x07) == 0x06 && code != 0x36;
+}
+
+static inline bool is_ld_rr_nn(const uint8_t code)
+{
+  return code < 0x40 && (code & 0x0F) == 0x01;
+}
+
+static inline bool is_inc_dec_rr(const uint8_t code)
+{
+  return code < 0x40 && ((code & 0x0F) == 0x03 || (code & 0x0F) == 0x0B);
+}
+
+// Whether an instruction only works on registers, so that it cannot
+// write memory, reconfigure a peripheral or stop the CPU
+static bool is_register_only(const block_op *o)
+{
+  const opcode *op = o->op;
+
+  if (op == &cpu_opcodes[0xCB])
+    op = &cpu_cb_opcodes[(uint8_t)o->operand];
+
+  return op->effects == EFFECTS_REG;
+}
+
+// Body of instructions simple enough to be translated, returns false for
+// the others
+static bool emit_body(emitter *e, const uint8_t code, const uint16_t operand)
+{
+  if (code == 0x00)
+    {
+      // NOP
+    }
+  else if (is_ld_r_r(code))
+    {
+      // mov al, [rbx + src] ; mov [rbx + dst], al
+      emit8(e, 0x8A);
+      emit_mem(e, RAX, RBX, register8_offset(code & 0x07));
+      emit8(e, 0x88);
+      emit_mem(e, RAX, RBX, register8_offset((code >> 3) & 0x07));
+    }
+  else if (is_ld_r_n(code))
+    {
+      emit_store8(e, RBX, register8_offset((code >> 3) & 0x07), (uint8_t)operand);
+    }
+  else if (is_ld_rr_nn(code))
+    {
+      emit_store16(e, RBX, register16_offset(code >> 4), operand);
+    }
+  else if (is_inc_dec_rr(code))
+    {
+      // inc word [rbx + rr] or dec word [rbx + rr]
+      emit8(e, 0x66);
+      emit8(e, 0xFF);
+      emit_mem(e, (code & 0x08) ? 1 : 0, RBX, register16_offset(code >> 4));
+    }
+  else
+    {
+      return false;
+    }
+
+  return true;
+}
+
+// Emits instructions working on registers only, with the checks the run
+// loop would make after them. Simple ones are translated, the others
+// call their handler. Returns false for anything else.
+static bool emit_register_op(emitter *e, const block_op *o)
+{
+  const uint8_t code = (uint8_t)(o->op - cpu_opcodes);
+  const uint16_t next = o->pc + o->length;
+
+  if (!is_register_only(o))
+    return false;
+
+  emit_store16(e, R13, BATCH_OFFSET(pc), o->pc);
+
+  // JR n, the target is known
+  if (code == 0x18)
+    {
+      emit_store16(e, RBX, REG_OFFSET(pc), (uint16_t)(next + (int8_t)o->operand));
+    }
+  else
+    {
+      emit_store16(e, RBX, REG_OFFSET(pc), next);
+
+      if (!emit_body(e, code, o->operand))
+        {
+          const opcode *op = o->op;
+          uint16_t operand = o->operand;
+
+          if (code == 0xCB)
+            {
+              op = &cpu_cb_opcodes[(uint8_t)operand];
+              operand = 0;
+            }
+
+          // mov edx, operand ; call handler ; test eax, eax
+          emit_reg_mem_args(e);
+          emit8(e, 0xBA);
+          emit32(e, operand);
+          emit_call(e, (const void *)op->handler);
+          emit8(e, 0x85);
+          emit8(e, 0xC0);
+          emit_jcc(e, JCC_JNE, true);
+        }
+    }
+
+  // Same timing as cpu_execute(), HALT cannot be set here. Branches set
+  // their own cycles.
+  const uint8_t cycles = code == 0xCB ? cpu_cb_opcodes[(uint8_t)o->operand].cycles : o->op->cycles;
+
+  if (cycles)
+    {
+      // mov eax, cycles
+      emit8(e, 0xB8);
+      emit32(e, cycles);
+    }
+  else
+    {
+      // movzx eax, byte [rbx + last.t]
+      emit8(e, 0x0F);
+      emit8(e, 0xB6);
+      emit_mem(e, RAX, RBX, REG_OFFSET(clock.last.t));
+    }
+  // movzx ecx, byte [rbx + speed_shifter] ; shr eax, cl
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit_mem(e, RCX, RBX, REG_OFFSET(speed_shifter));
+  emit8(e, 0xD3);
+  emit8(e, 0xE8);
+  // mov [rbx + last.t], al ; add [rbx + clock.t], ax
+  emit8(e, 0x88);
+  emit_mem(e, RAX, RBX, REG_OFFSET(clock.last.t));
+  emit8(e, 0x66);
+  emit8(e, 0x01);
+  emit_mem(e, RAX, RBX, REG_OFFSET(clock.t));
+  // add [r15], rax ; shr eax, 2 ; add [rbx + clock.m], ax
+  emit8(e, 0x49);
+  emit8(e, 0x01);
+  emit8(e, 0x07);
+  emit8(e, 0xC1);
+  emit8(e, 0xE8);
+  emit8(e, 0x02);
+  emit8(e, 0x66);
+  emit8(e, 0x01);
+  emit_mem(e, RAX, RBX, REG_OFFSET(clock.m));
+
+  // Interrupts, skipped unless enabled and pending. Jumping to one always
+  // leaves the block.
+  emit_test8(e, RBX, REG_OFFSET(ime));
+  emit8(e, 0x74);
+  uint8_t *skip_ime = e->p++;
+  emit_test8(e, R12, MEM_OFFSET(irq_pending));
+  emit8(e, 0x74);
+  uint8_t *skip_pending = e->p++;
+  emit_reg_mem_args(e);
+  emit_call(e, (const void *)cpu_check_interrupts);
+  emit_jmp(e);
+  *skip_ime = (uint8_t)(e->p - skip_ime - 1);
+  *skip_pending = (uint8_t)(e->p - skip_pending - 1);
+
+  if (code == 0x18)
+    {
+      emit_jmp(e);
+      return true;
+    }
+
+  // mov rax, [r15] ; cmp rax, [r13 + deadline]
+  emit8(e, 0x49);
+  emit8(e, 0x8B);
+  emit8(e, 0x07);
+  emit_rex(e, true, RAX, R13);
+  emit8(e, 0x3B);
+  emit_mem(e, RAX, R13, BATCH_OFFSET(deadline));
+  emit_jcc(e, JCC_JAE, false);
+
+  if (!cycles || code == 0xC3)
+    {
+      // Branch taken: cmp word [rbx + pc], next
+      emit8(e, 0x66);
+      emit8(e, 0x81);
+      emit_mem(e, 7, RBX, REG_OFFSET(pc));
+      emit16(e, next);
+      emit_jcc(e, JCC_JNE, false);
+    }
+
+  return true;
+}
+
+// Runs an instruction left to the interpreter, then tells whether the
+// compiled code has to return: 0 to go on, -1 to return and 1 on error
+static int step(registers *reg, memory *mem, block_batch *batch, const block_op *o)
+{
+  batch->pc = o->pc;
+
+  if (cpu_execute(reg, mem, o->op, o->operand, o->length))
+    return 1;
+
+  *batch->cycles += reg->clock.last.t;
+
+  if (*batch->cycles >= batch->deadline || *batch->synced ||
+      reg->stop || reg->halt || reg->pc != (uint16_t)(o->pc + o->length) ||
+      mem->code_generation != batch->generation)
+    return -1;
+
+  return 0;
+}
+
+static void emit_interpreted(emitter *e, const block_op *o)
+{
+  emit_reg_mem_args(e);
+
+  // mov rdx, r13 ; mov rcx, o
+  emit8(e, 0x4C);
+  emit8(e, 0x89);
+  emit8(e, 0xEA);
+  emit8(e, 0x48);
+  emit8(e, 0xB9);
+  emit64(e, (uint64_t)(uintptr_t)o);
+
+  emit_call(e, (const void *)step);
+
+  // test eax, eax
+  emit8(e, 0x85);
+  emit8(e, 0xC0);
+  emit_jcc(e, JCC_JNE, true);
+}
+
+static void patch(uint8_t **fixups, const unsigned int count, const uint8_t *target)
+{
+  for (unsigned int i = 0; i < count; ++i)
+    {
+      const int32_t rel = (int32_t)(target - (fixups[i] + 4));
+      memcpy(fixups[i], &rel, sizeof rel);
+    }
+}
+
+bool jit_init(jit *j)
+{
+  j->used = 0;
+  j->generation = 0;
+
+  void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (code == MAP_FAILED)
+    {
+      gb_log (WARNING, "Could not allocate JIT code, interpreting only");
+      j->code = NULL;
+      return false;
+    }
+
+  j->code = code;
+
+  return true;
+}
+
+void jit_uninit(jit *j)
+{
+  if (j->code)
+    {
+      munmap(j->code, JIT_CODE_SIZE);
+      j->code = NULL;
+    }
+}
+
+jit_fn jit_compile(jit *j, const block_op *ops, const uint8_t length, uint16_t *entries)
+{
+  if (!j->code)
+    return NULL;
+
+  if (j->used + (length + 2) * JIT_MAX_OP_SIZE > JIT_CODE_SIZE)
+    {
+      j->used = 0;
+      ++j->generation;
+    }
+
+  emitter e;
+  uint8_t *start = j->code + j->used;
+
+  e.p = start;
+  e.exit_count = 0;
+  e.step_count = 0;
+
+  // push rbx, r12, r13, r14, r15, r14 is unused but aligns the stack
+  // for calls
+  emit8(&e, 0x53);
+  emit8(&e, 0x41);
+  emit8(&e, 0x54);
+  emit8(&e, 0x41);
+  emit8(&e, 0x55);
+  emit8(&e, 0x41);
+  emit8(&e, 0x56);
+  emit8(&e, 0x41);
+  emit8(&e, 0x57);
+  // mov rbx, rdi ; mov r12, rsi ; mov r13, rdx
+  emit8(&e, 0x48);
+  emit8(&e, 0x89);
+  emit8(&e, 0xFB);
+  emit8(&e, 0x49);
+  emit8(&e, 0x89);
+  emit8(&e, 0xF4);
+  emit8(&e, 0x49);
+  emit8(&e, 0x89);
+  emit8(&e, 0xD5);
+  // mov r15, [r13 + cycles] ; jmp rcx
+  emit_rex(&e, true, R15, R13);
+  emit8(&e, 0x8B);
+  emit_mem(&e, R15, R13, BATCH_OFFSET(cycles));
+  emit8(&e, 0xFF);
+  emit8(&e, 0xE1);
+
+  for (uint8_t i = 0; i < length; ++i)
+    {
+      const block_op *o = &ops[i];
+
+      entries[i] = (uint16_t)(e.p - start);
+
+      if (!emit_register_op(&e, o))
+        emit_interpreted(&e, o);
+    }
+
+  // Exits, the end of the block falls through the first one. Then
+  // xor eax, eax or setg after a call, and restore registers.
+  uint8_t *exit = e.p;
+  emit8(&e, 0x31);
+  emit8(&e, 0xC0);
+  emit8(&e, 0xEB);
+  emit8(&e, 0x08);
+  uint8_t *step_exit = e.p;
+  // test eax, eax ; setg al ; movzx eax, al
+  emit8(&e, 0x85);
+  emit8(&e, 0xC0);
+  emit8(&e, 0x0F);
+  emit8(&e, 0x9F);
+  emit8(&e, 0xC0);
+  emit8(&e, 0x0F);
+  emit8(&e, 0xB6);
+  emit8(&e, 0xC0);
+  emit8(&e, 0x41);
+  emit8(&e, 0x5F);
+  emit8(&e, 0x41);
+  emit8(&e, 0x5E);
+  emit8(&e, 0x41);
+  emit8(&e, 0x5D);
+  emit8(&e, 0x41);
+  emit8(&e, 0x5C);
+  emit8(&e, 0x5B);
+  emit8(&e, 0xC3);
+
+  patch(e.exit_fixups, e.exit_count, exit);
+  patch(e.step_fixups, e.step_count, step_exit);
+
+  j->used += (size_t)(e.p - start);
+
+  return (jit_fn)(void *)start;
+}
+
+#endif
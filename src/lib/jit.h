@@ -0,0 +1,64 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "cpu.h"
+#include "mmu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(JIT) && defined(__x86_64__) && !defined(_WIN32)
+#define JIT_ENABLED
+#endif
+
+// Batch of instructions being run, compiled code keeps it up to date and
+// returns as soon as the run loop has to look at it
+struct block_batch_s {
+  uint64_t *cycles;
+  const bool *synced;
+  uint64_t deadline;
+
+  // Code generation compiled code was entered with
+  uint32_t generation;
+
+  // Address of the last instruction run
+  uint16_t pc;
+};
+
+typedef struct block_batch_s block_batch;
+
+// Compiled code is entered at the instruction the CPU is at
+typedef int (*jit_fn)(registers *reg, memory *mem, block_batch *batch, const uint8_t *entry);
+
+#ifdef JIT_ENABLED
+
+// Blocks entered this many times get compiled
+#define JIT_THRESHOLD 256
+
+#define JIT_CODE_SIZE (1024 * 1024)
+
+struct jit_s {
+  uint8_t *code;
+  size_t used;
+
+  // Bumped when the code buffer is recycled, older functions are gone
+  uint32_t generation;
+};
+
+typedef struct jit_s jit;
+
+struct block_op_s;
+
+bool jit_init(jit *j);
+
+void jit_uninit(jit *j);
+
+// Compiles a run of decoded instructions, the offset of each of them in
+// the code goes to entries. When the code buffer is full it gets
+// recycled, so functions from an older generation must be dropped.
+jit_fn jit_compile(jit *j, const struct block_op_s *ops, const uint8_t length, uint16_t *entries);
+
+#endif
+
+#endif // JIT_H
@@ -10,7 +10,7 @@ struct keys_s {
 
 typedef struct keys_s keys;
 
-typedef int (*keys_cb)(keys*);
+typedef int (*keys_cb)(void *context, keys*);
 
 #define P15 0x20
 #define P14 0x10
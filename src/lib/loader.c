@@ -1,4 +1,5 @@
 #include "loader.h"
+#include "shared.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,7 +33,10 @@ uint8_t* read_file(const char* path, uint32_t *size, const bool is_rom)
 
       rewind (file);
 
-      buffer = (char*) malloc (sizeof(char)*file_size);
+      // ROMs are shared by forked instances
+      buffer = is_rom ?
+        (char*) shared_alloc (sizeof(char)*file_size) :
+        (char*) malloc (sizeof(char)*file_size);
       if (buffer == NULL)
         {
           gb_log(ERROR, "Memory error");
@@ -44,7 +48,10 @@ uint8_t* read_file(const char* path, uint32_t *size, const bool is_rom)
       if ((long)read_size != file_size)
         {
           gb_log(ERROR, "Reading error");
-          free (buffer);
+          if (is_rom)
+            shared_unref (buffer);
+          else
+            free (buffer);
           fclose (file);
           return NULL;
         }
@@ -105,3 +112,25 @@ mbc get_type(uint8_t* rom)
       return NOT_SUPPORTED;
     }
 }
+
+uint32_t get_ram_size(uint8_t* rom)
+{
+  switch(rom[0x0149])
+    {
+    case 0x00: // None
+      return 0;
+    case 0x01: // 2 KBytes
+      return 2048;
+    case 0x02: // 8 KBytes
+      return 8192;
+    case 0x03: // 4 banks of 8 KBytes
+      return 4 * 8192;
+    case 0x04: // 16 banks of 8 KBytes
+      return 16 * 8192;
+    case 0x05: // 8 banks of 8 KBytes
+      return 8 * 8192;
+    default:
+      gb_log(WARNING, "Unknown RAM size, assuming 16 banks");
+      return MEM_CART_RAM_SIZE;
+    }
+}
@@ -7,8 +7,12 @@
 #include "logger.h"
 #include "mmu.h"
 
+// ROMs are read to buffers from shared_alloc(), others need free()
 uint8_t* read_file(const char* path, uint32_t *size, const bool is_rom);
 
 mbc get_type(uint8_t* rom);
 
+// Bytes of RAM the cartridge declares in its header, 0 when it has none
+uint32_t get_ram_size(uint8_t* rom);
+
 #endif // LOADER_H
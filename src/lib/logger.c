@@ -1,9 +1,51 @@
 #include "logger.h"
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
-#ifdef LOG_FILE
-FILE *f = NULL;
+#if !defined(NDEBUG) && defined(LOG_FILE)
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Opened once for the whole process, by whichever instance logs first.
+// Each line is written with one call, which stdio locks.
+static FILE *log_file;
+
+static FILE *get_log_file(void)
+{
+#ifdef _MSC_VER
+  FILE *f = _InterlockedCompareExchangePointer((void *volatile *)&log_file, NULL, NULL);
+#else
+  FILE *f = __atomic_load_n(&log_file, __ATOMIC_ACQUIRE);
+#endif
+
+  if (f)
+    return f;
+
+  FILE *opened = fopen("log.txt", "a");
+
+  if (!opened)
+    return NULL;
+
+#ifdef _MSC_VER
+  f = _InterlockedCompareExchangePointer((void *volatile *)&log_file, opened, NULL);
+#else
+  f = NULL;
+  __atomic_compare_exchange_n(&log_file, &f, opened, false,
+                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+
+  // Another thread got to open it first
+  if (f)
+    {
+      fclose(opened);
+      return f;
+    }
+
+  return opened;
+}
 #endif
 
 #ifndef NDEBUG
@@ -14,13 +56,14 @@ void gb_log(const level l, const char *fmt, ...)
       va_list args;
       va_start(args, fmt);
 #ifdef LOG_FILE
-      if (!f)
-        f = fopen("log.txt", "a");
+      // Whole line is written with one call, so that lines of instances
+      // on different threads don't get mixed
+      char line[1024];
+      FILE *f = get_log_file();
+      vsnprintf(line, sizeof(line) - sizeof(NEWLINE), fmt, args);
+      strcat(line, NEWLINE);
       if (f != NULL)
-        {
-          vfprintf(f, fmt, args);
-          fprintf(f, NEWLINE);
-        }
+        fputs(line, f);
 #else
       vfprintf(stdout, fmt, args);
       printf(NEWLINE);
@@ -29,38 +72,24 @@ void gb_log(const level l, const char *fmt, ...)
     }
 }
 
-void gb_log_stream(const level l, const char c)
+void gb_log_stream(log_stream *s, const level l, const char c)
 {
   if (l <= ERROR_LEVEL)
     {
-      static char buf[1024];
-      static unsigned int ptr = 0;
-
-      buf[ptr] = c;
+      s->buf[s->ptr] = c;
 
       if (c != '\n')
         {
-          if (ptr < sizeof (buf) - 1)
-            ++ptr;
+          if (s->ptr < sizeof (s->buf) - 1)
+            ++s->ptr;
         }
       else
         {
-          printf("%.*s", ptr + 1, buf);
-          ptr = 0;
+          printf("%.*s", s->ptr + 1, s->buf);
+          s->ptr = 0;
         }
     }
 }
-
-void gb_log_close_file()
-{
-#ifdef LOG_FILE
-  if (f)
-    {
-      fclose(f);
-      f = NULL;
-    }
-#endif
-}
 #endif
 
 void gb_log_print_rom_info(uint8_t *rom)
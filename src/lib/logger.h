@@ -23,18 +23,23 @@ typedef level_e level;
 
 //#define LOG_FILE
 
+// Line buffer for gb_log_stream(), owned by the caller so that instances
+// on different threads don't share it
+struct log_stream_s {
+  char buf[1024];
+  unsigned int ptr;
+};
+
+typedef struct log_stream_s log_stream;
+
 #ifndef NDEBUG
 void gb_log(const level l, const char *fmt, ...);
 
-void gb_log_stream(const level l, const char c);
-
-void gb_log_close_file();
+void gb_log_stream(log_stream *s, const level l, const char c);
 #else
 #define gb_log(l, ...) ;
 
-#define gb_logstream(l, c) ;
-
-#define gb_log_close_file() ;
+#define gb_log_stream(s, l, c) ;
 #endif
 
 void gb_log_print_rom_info(uint8_t *rom);
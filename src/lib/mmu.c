@@ -1,31 +1,265 @@
 #include "mmu.h"
 #include "interrupts.h"
 #include "logger.h"
+#include "shared.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+// DMG games only see the first banks of video and internal RAM, what
+// they write to VBK and SVBK is just stored
+static inline uint8_t get_video_ram_bank(memory* mem)
+{
+  if (!mem->cgb_mode)
+    return 0;
+
+  return mem->high_empty[MEM_VBK_ADDR - MEM_HIGH_EMPTY_START_ADDR];
+}
+
+static inline uint16_t get_internal_bank_offset(memory* mem)
+{
+  if (!mem->cgb_mode)
+    return 0;
+
+  const uint8_t bank = mem->high_empty[MEM_SVBK_ADDR - MEM_HIGH_EMPTY_START_ADDR];
+  return (bank - 1) * 4096;
+}
+
+// Never written, RAM reads as zeroes from it until a page gets written
+static uint8_t zero_page[MEM_RAM_PAGE_SIZE];
+
+static inline uint32_t internal_ram_offset(memory *mem, const uint16_t address)
+{
+  uint32_t offset = address - 0xC000;
+
+  // Only the second 4k is switchable
+  if (offset >= 0x1000)
+    offset += get_internal_bank_offset(mem);
+
+  return offset;
+}
+
+static inline uint32_t cart_ram_offset(memory *mem, const uint16_t address)
+{
+  return ((uint32_t)mem->banks.ram.selected * 8192 + address - 0xA000) &
+    (mem->banks.ram.size - 1);
+}
+
+static inline uint8_t *ram_byte(uint8_t *const *pages, const uint32_t offset)
+{
+  return &pages[offset >> MEM_RAM_PAGE_SHIFT][offset & (MEM_RAM_PAGE_SIZE - 1)];
+}
+
+static inline bool page_writable(const uint8_t *page)
+{
+  return page != zero_page && shared_exclusive(page);
+}
+
+static inline uint8_t *ref_page(uint8_t *page)
+{
+  return page == zero_page ? page : shared_ref(page);
+}
+
+static inline void release_page(uint8_t *page)
+{
+  if (page != zero_page)
+    shared_unref(page);
+}
+
+// Numbers of the first tracked page of cartridge and video RAM
+#define TRACKED_CART_RAM (MEM_INTERNAL_RAM_SIZE >> MEM_PAGE_SHIFT)
+#define TRACKED_VIDEO_RAM ((MEM_INTERNAL_RAM_SIZE + MEM_CART_RAM_SIZE) >> MEM_PAGE_SHIFT)
+
+// Whether writes to a page may go straight to memory as far as tracking
+// them is concerned
+static inline bool write_tracked(memory *mem, const unsigned int tracked)
+{
+  return !mem->track_writes || mem->written[tracked];
+}
+
+static inline void mark_written(memory *mem, const unsigned int tracked)
+{
+  if (mem->track_writes && !mem->written[tracked])
+    {
+      mem->written[tracked] = 1;
+      mem->written_list[mem->written_count++] = (uint16_t)tracked;
+    }
+}
+
+static void mark_all_written(memory *mem)
+{
+  for (unsigned int tracked = 0; tracked < MEM_TRACKED_PAGES; ++tracked)
+    mark_written(mem, tracked);
+}
+
+// Gives the instance a page of its own to write to, copying the one it
+// has unless nobody else holds it. Returns false when out of memory.
+static bool own_page(uint8_t **page)
+{
+  if (page_writable(*page))
+    return true;
+
+  uint8_t *copy = shared_alloc(MEM_RAM_PAGE_SIZE);
+
+  if (!copy)
+    {
+      gb_log(ERROR, "Out of memory for a page of RAM");
+      return false;
+    }
+
+  memcpy(copy, *page, MEM_RAM_PAGE_SIZE);
+  release_page(*page);
+  *page = copy;
+
+  return true;
+}
+
+static inline bool page_has_code(memory *mem, const unsigned int page)
+{
+  const unsigned int chunks = 1 << (MEM_PAGE_SHIFT - MEM_CODE_CHUNK_SHIFT);
+
+  for (unsigned int i = 0; i < chunks; ++i)
+    if (mem->code_chunks[page * chunks + i])
+      return true;
+
+  return false;
+}
+
+static void map_rom(memory *mem)
+{
+  for (unsigned int page = 0x00; page < 0x80; ++page)
+    {
+      const uint32_t address = page << MEM_PAGE_SHIFT;
+
+      if (!mem->rom.data)
+        mem->read_map[page] = NULL;
+      else if (page >= 0x40)
+        mem->read_map[page] = &mem->rom.data[(uint32_t)(address + mem->banks.rom.offset)];
+      else
+        mem->read_map[page] = &mem->rom.data[address];
+    }
+
+  if (mem->bootloader_running)
+    mem->read_map[0x00] = mem->bootloader;
+}
+
+// Drops decoded tiles overlapping bytes of video RAM, by offset in bank
+static inline void invalidate_tiles(memory *mem, const uint8_t bank,
+                                    const uint16_t offset, const uint16_t length)
+{
+  if (offset >= MEM_TILE_DATA_SIZE)
+    return;
+
+  const uint16_t end = offset + length < MEM_TILE_DATA_SIZE ?
+    offset + length : MEM_TILE_DATA_SIZE;
+
+  for (uint16_t tile = offset / 16; tile < (end + 15) / 16; ++tile)
+    mem->tiles_decoded[bank][tile] = false;
+}
+
+static void map_video_ram(memory *mem)
+{
+  for (unsigned int page = 0x80; page < 0xA0; ++page)
+    {
+      const uint16_t address = (page << MEM_PAGE_SHIFT) - 0x8000;
+
+      const uint8_t bank = get_video_ram_bank(mem);
+      uint8_t *ram = &mem->video_ram[bank][address];
+      const unsigned int tracked = TRACKED_VIDEO_RAM + ((bank * 8192 + address) >> MEM_PAGE_SHIFT);
+
+      mem->read_map[page] = ram;
+      mem->write_map[page] = address >= MEM_TILE_DATA_SIZE &&
+        write_tracked(mem, tracked) ? ram : NULL;
+    }
+}
+
+static void map_cart_ram(memory *mem)
+{
+  // Without RAM accesses go through the handlers
+  if (!mem->banks.ram.size)
+    return;
+
+  for (unsigned int page = 0xA0; page < 0xC0; ++page)
+    {
+      const uint32_t offset = cart_ram_offset(mem, page << MEM_PAGE_SHIFT);
+      const uint8_t *ram_page = mem->cart_ram_pages[offset >> MEM_RAM_PAGE_SHIFT];
+      uint8_t *ram = ram_byte(mem->cart_ram_pages, offset);
+
+      // Writes go through the handler until one marks RAM to be saved
+      mem->read_map[page] = mem->banks.ram.enabled ? ram : NULL;
+      mem->write_map[page] = mem->banks.ram.enabled && mem->banks.ram.written &&
+        page_writable(ram_page) &&
+        write_tracked(mem, TRACKED_CART_RAM + (offset >> MEM_PAGE_SHIFT)) ? ram : NULL;
+    }
+}
+
+static void map_internal_ram(memory *mem)
+{
+  for (unsigned int page = 0xC0; page < 0xFE; ++page)
+    {
+      // Echo pages share code flags with the page they mirror
+      const unsigned int source = page < 0xE0 ? page : page - 0x20;
+      const uint32_t offset = internal_ram_offset(mem, source << MEM_PAGE_SHIFT);
+      const uint8_t *ram_page = mem->internal_ram_pages[offset >> MEM_RAM_PAGE_SHIFT];
+      uint8_t *ram = ram_byte(mem->internal_ram_pages, offset);
+
+      mem->read_map[page] = ram;
+      mem->write_map[page] = page_has_code(mem, source) || !page_writable(ram_page) ||
+        !write_tracked(mem, offset >> MEM_PAGE_SHIFT) ? NULL : ram;
+    }
+}
+
+// Points pages of the memory map to host memory of the current banks
+static void map_all(memory *mem)
+{
+  memset(mem->read_map, 0, sizeof mem->read_map);
+  memset(mem->write_map, 0, sizeof mem->write_map);
+
+  map_rom(mem);
+  map_video_ram(mem);
+  map_cart_ram(mem);
+  map_internal_ram(mem);
+}
+
+static void init_io_handlers(memory *mem);
+
 void mmu_reset(memory *mem)
 {
   mem->ie_register = 0x00;
+  mem->irq_pending = 0x00;
+
+  mem->io_sync_cb = NULL;
+  mem->timer_sync_cb = NULL;
+  mem->io_sync_data = NULL;
+
+  mem->code_generation = 0;
+  memset(mem->code_chunks, 0, sizeof mem->code_chunks);
+
+  mem->track_writes = false;
+  memset(mem->written, 0, sizeof mem->written);
+  mem->written_count = 0;
+
+  memset(mem->read_map, 0, sizeof mem->read_map);
+  memset(mem->write_map, 0, sizeof mem->write_map);
+  init_io_handlers(mem);
 
   memset(mem->working_ram, 0, sizeof mem->working_ram);
+  memset(mem->internal_ram, 0, sizeof mem->internal_ram);
   memset(mem->high_empty, 0, sizeof mem->high_empty);
   memset(mem->io_registers, 0, sizeof mem->io_registers);
   memset(mem->low_empty, 0, sizeof mem->low_empty);
-  memset(mem->internal_8k_ram, 0, sizeof mem->internal_8k_ram);
   memset(mem->oam, 0, sizeof mem->oam);
   memset(mem->video_ram, 0, sizeof mem->video_ram);
-#if CGB
+  memset(mem->tiles_decoded, 0, sizeof mem->tiles_decoded);
+  mem->palettes_resolved = false;
+  mem->sprites_selected = false;
   memset(mem->palette, 0, sizeof mem->palette);
   mem->cgb_mode = false;
 
   mem->dma.h_blank.src = 0;
   mem->dma.h_blank.dst = 0;
-  mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = 0xFF;
-#endif
 
   mem->rom.data = NULL;
   mem->rom.type = NONE;
@@ -42,9 +276,16 @@ void mmu_reset(memory *mem)
   mem->banks.rom.blocks = 1;
 
   mem->banks.ram.selected = 0;
+  mem->banks.ram.blocks = 0;
+  mem->banks.ram.size = 0;
   mem->banks.ram.enabled = true;
   mem->banks.ram.written = false;
-  memset(mem->banks.ram.data, 0, sizeof mem->banks.ram.data);
+
+  // RAM starts out zeroed, pages get allocated once written
+  for (unsigned int i = 0; i < MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    mem->internal_ram_pages[i] = zero_page;
+  for (unsigned int i = 0; i < MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    mem->cart_ram_pages[i] = zero_page;
 
   mem->div_modified = false;
   mem->lcd_stopped = false;
@@ -69,9 +310,25 @@ void mmu_reset(memory *mem)
   mmu_write_byte(mem, MEM_BGP_ADDR, 0xFC);
   mmu_write_byte(mem, MEM_OBP0_ADDR, 0xFF);
   mmu_write_byte(mem, MEM_OBP1_ADDR, 0xFF);
-#if CGB
-  mmu_write_byte(mem, MEM_SVBK_ADDR, 0x01);
-#endif
+
+  map_all(mem);
+}
+
+void mmu_uninit(memory *mem)
+{
+  for (unsigned int i = 0; i < MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    {
+      release_page(mem->internal_ram_pages[i]);
+      mem->internal_ram_pages[i] = zero_page;
+    }
+
+  for (unsigned int i = 0; i < MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    {
+      release_page(mem->cart_ram_pages[i]);
+      mem->cart_ram_pages[i] = zero_page;
+    }
+
+  map_all(mem);
 }
 
 #ifndef NDEBUG
@@ -94,17 +351,313 @@ void mmu_debug_print(memory *mem, level l)
 }
 #endif
 
-void mmu_set_rom(memory *mem, uint8_t *rom, mbc type, uint32_t rom_size)
+void mmu_set_rom(memory *mem, uint8_t *rom, mbc type, uint32_t rom_size, uint32_t ram_size)
 {
   mem->rom.type = type;
   mem->rom.data = rom;
   mem->banks.rom.blocks = rom_size / 0x4000;
+
+  // Pages past the size are never reached, they stay on the zero page
+  if (ram_size > MEM_CART_RAM_SIZE)
+    ram_size = MEM_CART_RAM_SIZE;
+  mem->banks.ram.size = ram_size;
+  mem->banks.ram.blocks = ram_size > 8192 ? ram_size / 8192 : (ram_size ? 1 : 0);
+
+  map_rom(mem);
+  map_cart_ram(mem);
+}
+
+void mmu_set_cgb_mode(memory *mem, const bool cgb_mode)
+{
+  mem->cgb_mode = cgb_mode;
+
+  if (cgb_mode)
+    {
+      mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = 0xFF;
+      mmu_write_byte(mem, MEM_SVBK_ADDR, 0x01);
+    }
 }
 
 void mmu_set_bootloader(memory *mem, uint8_t *bootloader)
 {
   mem->bootloader_running = bootloader ? true : false;
   mem->bootloader = bootloader;
+
+  ++mem->code_generation;
+
+  map_rom(mem);
+}
+
+void mmu_clear_ram_written(memory *mem)
+{
+  mem->banks.ram.written = false;
+
+  map_cart_ram(mem);
+}
+
+void mmu_restore(memory *mem)
+{
+  ++mem->code_generation;
+  memset(mem->code_chunks, 0, sizeof mem->code_chunks);
+  memset(mem->tiles_decoded, 0, sizeof mem->tiles_decoded);
+  mem->palettes_resolved = false;
+  mem->sprites_selected = false;
+
+  // Nothing is known of what changed
+  if (mem->track_writes)
+    mark_all_written(mem);
+
+  map_all(mem);
+}
+
+void mmu_mark_checkpoint(memory *mem, mem_checkpoint *cp)
+{
+  memcpy(cp->state, mem, MEM_STATE_SIZE);
+
+  for (unsigned int i = 0; i < MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    cp->internal_ram_pages[i] = ref_page(mem->internal_ram_pages[i]);
+
+  for (unsigned int i = 0; i < MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    cp->cart_ram_pages[i] = ref_page(mem->cart_ram_pages[i]);
+
+  for (unsigned int i = 0; i < mem->written_count; ++i)
+    mem->written[mem->written_list[i]] = 0;
+
+  mem->written_count = 0;
+  mem->track_writes = true;
+
+  map_all(mem);
+}
+
+// Copies a page of work or cartridge RAM back from the checkpoint
+static bool reset_ram_page(uint8_t **pages, uint8_t *const *cp_pages, const uint32_t offset)
+{
+  uint8_t **page = &pages[offset >> MEM_RAM_PAGE_SHIFT];
+  const uint8_t *cp_page = cp_pages[offset >> MEM_RAM_PAGE_SHIFT];
+
+  if (*page == cp_page)
+    return true;
+
+  if (!own_page(page))
+    return false;
+
+  memcpy(ram_byte(pages, offset), ram_byte((uint8_t**)cp_pages, offset), 1 << MEM_PAGE_SHIFT);
+
+  return true;
+}
+
+bool mmu_reset_to_checkpoint(memory *mem, mem_checkpoint *cp)
+{
+  const size_t video_ram = offsetof(memory, video_ram);
+  const size_t video_ram_end = video_ram + sizeof mem->video_ram;
+  unsigned int failed = 0;
+
+  for (unsigned int i = 0; i < mem->written_count; ++i)
+    {
+      const unsigned int tracked = mem->written_list[i];
+      bool reset = true;
+
+      if (tracked >= TRACKED_VIDEO_RAM)
+        {
+          const size_t offset = (size_t)(tracked - TRACKED_VIDEO_RAM) << MEM_PAGE_SHIFT;
+
+          memcpy((uint8_t*)mem->video_ram + offset, cp->state + video_ram + offset, 1 << MEM_PAGE_SHIFT);
+          invalidate_tiles(mem, offset / 8192, offset % 8192, 1 << MEM_PAGE_SHIFT);
+        }
+      else if (tracked >= TRACKED_CART_RAM)
+        {
+          reset = reset_ram_page(mem->cart_ram_pages, cp->cart_ram_pages,
+                                 (tracked - TRACKED_CART_RAM) << MEM_PAGE_SHIFT);
+        }
+      else
+        {
+          reset = reset_ram_page(mem->internal_ram_pages, cp->internal_ram_pages,
+                                 tracked << MEM_PAGE_SHIFT);
+        }
+
+      // Pages which couldn't be copied back stay flagged for another try
+      if (reset)
+        mem->written[tracked] = 0;
+      else
+        mem->written_list[failed++] = tracked;
+    }
+
+  mem->written_count = failed;
+
+  if (failed)
+    return false;
+
+  // The rest of the state is small enough to copy whole
+  memcpy(mem, cp->state, video_ram);
+  memcpy((uint8_t*)mem + video_ram_end, cp->state + video_ram_end, MEM_STATE_SIZE - video_ram_end);
+
+  ++mem->code_generation;
+  memset(mem->code_chunks, 0, sizeof mem->code_chunks);
+  mem->palettes_resolved = false;
+  mem->sprites_selected = false;
+
+  map_all(mem);
+
+  return true;
+}
+
+void mmu_drop_checkpoint(memory *mem, mem_checkpoint *cp)
+{
+  for (unsigned int i = 0; i < MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    release_page(cp->internal_ram_pages[i]);
+
+  for (unsigned int i = 0; i < MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    release_page(cp->cart_ram_pages[i]);
+
+  mem->track_writes = false;
+
+  map_all(mem);
+}
+
+// Number of pages holding size bytes, the last one may be partly used
+static inline unsigned int page_count(const uint32_t size)
+{
+  return (size + MEM_RAM_PAGE_SIZE - 1) >> MEM_RAM_PAGE_SHIFT;
+}
+
+static inline uint32_t page_bytes(const uint32_t size, const unsigned int page)
+{
+  const uint32_t left = size - (page << MEM_RAM_PAGE_SHIFT);
+  return left < MEM_RAM_PAGE_SIZE ? left : MEM_RAM_PAGE_SIZE;
+}
+
+static void get_pages(uint8_t *const *pages, const uint32_t size, uint8_t *buffer)
+{
+  for (unsigned int i = 0; i < page_count(size); ++i)
+    memcpy(buffer + (i << MEM_RAM_PAGE_SHIFT), pages[i], page_bytes(size, i));
+}
+
+// Pages of zeroes are left to the zero page, as is the rest of a page
+// partly used. Returns false, having allocated nothing, when out of memory.
+static bool copy_to_pages(uint8_t **copies, const uint32_t size, const uint8_t *buffer)
+{
+  for (unsigned int i = 0; i < page_count(size); ++i)
+    {
+      const uint8_t *data = buffer + (i << MEM_RAM_PAGE_SHIFT);
+      const uint32_t bytes = page_bytes(size, i);
+
+      if (!memcmp(data, zero_page, bytes))
+        {
+          copies[i] = zero_page;
+          continue;
+        }
+
+      copies[i] = shared_alloc(MEM_RAM_PAGE_SIZE);
+
+      if (!copies[i])
+        {
+          gb_log(ERROR, "Out of memory for RAM");
+
+          while (i--)
+            release_page(copies[i]);
+
+          return false;
+        }
+
+      memcpy(copies[i], data, bytes);
+      memset(copies[i] + bytes, 0, MEM_RAM_PAGE_SIZE - bytes);
+    }
+
+  return true;
+}
+
+static void replace_pages(uint8_t **pages, uint8_t *const *copies, const unsigned int count)
+{
+  for (unsigned int i = 0; i < count; ++i)
+    {
+      release_page(pages[i]);
+      pages[i] = copies[i];
+    }
+}
+
+#define COPY_STATE_MEMBER(m) \
+  memcpy(state + offsetof(memory, m), &mem->m, sizeof mem->m)
+
+void mmu_get_state(memory *mem, uint8_t *state)
+{
+  const size_t arrays_size = offsetof(memory, palette) + sizeof mem->palette;
+
+  // Arrays of bytes at the start, the rest member by member leaving out
+  // the pointers and padding
+  memcpy(state, mem, arrays_size);
+  memset(state + arrays_size, 0, MEM_STATE_SIZE - arrays_size);
+
+  COPY_STATE_MEMBER(rom.type);
+  COPY_STATE_MEMBER(bootloader_running);
+  COPY_STATE_MEMBER(div_modified);
+  COPY_STATE_MEMBER(lcd_stopped);
+  COPY_STATE_MEMBER(banks.mode);
+  COPY_STATE_MEMBER(banks.rom.selected);
+  COPY_STATE_MEMBER(banks.rom.offset);
+  COPY_STATE_MEMBER(banks.rom.blocks);
+  COPY_STATE_MEMBER(banks.ram.enabled);
+  COPY_STATE_MEMBER(banks.ram.written);
+  COPY_STATE_MEMBER(banks.ram.selected);
+  COPY_STATE_MEMBER(banks.ram.blocks);
+  COPY_STATE_MEMBER(banks.ram.size);
+  COPY_STATE_MEMBER(cgb_mode);
+  COPY_STATE_MEMBER(dma.h_blank.src);
+  COPY_STATE_MEMBER(dma.h_blank.dst);
+}
+
+void mmu_get_ram(memory *mem, uint8_t *internal, uint8_t *cart)
+{
+  if (internal)
+    get_pages(mem->internal_ram_pages, MEM_INTERNAL_RAM_SIZE, internal);
+  if (cart)
+    get_pages(mem->cart_ram_pages, mem->banks.ram.size, cart);
+}
+
+bool mmu_set_ram(memory *mem, const uint8_t *internal, const uint8_t *cart)
+{
+  const uint32_t internal_size = internal ? MEM_INTERNAL_RAM_SIZE : 0;
+  const uint32_t cart_size = cart ? mem->banks.ram.size : 0;
+  const unsigned int internal_count = page_count(internal_size);
+  const unsigned int cart_count = page_count(cart_size);
+  uint8_t *internal_copies[MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+  uint8_t *cart_copies[MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+
+  if (!copy_to_pages(internal_copies, internal_size, internal))
+    return false;
+
+  if (!copy_to_pages(cart_copies, cart_size, cart))
+    {
+      for (unsigned int i = 0; i < internal_count; ++i)
+        release_page(internal_copies[i]);
+
+      return false;
+    }
+
+  replace_pages(mem->internal_ram_pages, internal_copies, internal_count);
+  replace_pages(mem->cart_ram_pages, cart_copies, cart_count);
+
+  map_all(mem);
+
+  return true;
+}
+
+void mmu_share_ram(memory *mem, memory *from)
+{
+  for (unsigned int i = 0; i < MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    {
+      release_page(mem->internal_ram_pages[i]);
+      mem->internal_ram_pages[i] = ref_page(from->internal_ram_pages[i]);
+    }
+
+  for (unsigned int i = 0; i < MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT; ++i)
+    {
+      release_page(mem->cart_ram_pages[i]);
+      mem->cart_ram_pages[i] = ref_page(from->cart_ram_pages[i]);
+    }
+
+  // Neither may write to the pages any more without copying them first
+  map_all(mem);
+  map_all(from);
 }
 
 void mmu_set_keys(memory *mem, keys *k)
@@ -112,25 +665,69 @@ void mmu_set_keys(memory *mem, keys *k)
   mem->k = k;
 }
 
-static inline void mmu_select_rom_bank(memory *mem, const uint16_t bank)
+void mmu_set_io_sync(memory *mem, io_sync_cb cb, io_sync_cb timer_cb, void *data)
 {
-  mem->banks.rom.selected = bank;
-  mem->banks.rom.selected &= mem->banks.rom.blocks - 1;
-  mem->banks.rom.offset = 0x4000 * (mem->banks.rom.selected - 1);
+  mem->io_sync_cb = cb;
+  mem->timer_sync_cb = timer_cb;
+  mem->io_sync_data = data;
+}
 
-  gb_log(VERBOSE, "Selected ROM bank %d", mem->banks.rom.selected);
+static inline void sync_io(memory *mem)
+{
+  if (mem->io_sync_cb)
+    mem->io_sync_cb(mem->io_sync_data);
 }
 
-#if CGB
-static inline uint8_t get_video_ram_bank(memory* mem)
+static inline void sync_timer(memory *mem)
 {
-  return mem->high_empty[MEM_VBK_ADDR - MEM_HIGH_EMPTY_START_ADDR];
+  if (mem->timer_sync_cb)
+    mem->timer_sync_cb(mem->io_sync_data);
 }
 
-static inline uint16_t get_internal_bank_offset(memory* mem)
+void mmu_mark_code(memory *mem, const uint16_t start, const uint16_t end)
 {
-  const uint8_t bank = mem->high_empty[MEM_SVBK_ADDR - MEM_HIGH_EMPTY_START_ADDR];
-  return (bank - 1) * 4096;
+  for (unsigned int chunk = start >> MEM_CODE_CHUNK_SHIFT;
+       chunk <= (unsigned int)(end >> MEM_CODE_CHUNK_SHIFT);
+       ++chunk)
+    mem->code_chunks[chunk] = 1;
+
+  // Writes to these pages, and their echo, need to go through
+  // check_code_write()
+  for (unsigned int page = start >> MEM_PAGE_SHIFT;
+       page <= (unsigned int)(end >> MEM_PAGE_SHIFT);
+       ++page)
+    {
+      mem->write_map[page] = NULL;
+      if (page >= 0xC0 && page < 0xDE)
+        mem->write_map[page + 0x20] = NULL;
+    }
+}
+
+static inline void code_changed(memory *mem)
+{
+  ++mem->code_generation;
+}
+
+static inline void check_code_write(memory *mem, const uint16_t address)
+{
+  if (mem->code_chunks[address >> MEM_CODE_CHUNK_SHIFT])
+    {
+      memset(mem->code_chunks, 0, sizeof mem->code_chunks);
+      code_changed(mem);
+      map_internal_ram(mem);
+    }
+}
+
+static inline void mmu_select_rom_bank(memory *mem, const uint16_t bank)
+{
+  mem->banks.rom.selected = bank;
+  mem->banks.rom.selected &= mem->banks.rom.blocks - 1;
+  mem->banks.rom.offset = 0x4000 * (mem->banks.rom.selected - 1);
+
+  code_changed(mem);
+  map_rom(mem);
+
+  gb_log(VERBOSE, "Selected ROM bank %d", mem->banks.rom.selected);
 }
 
 static void color_palette_data(memory* mem, const uint16_t index_addr, const uint8_t palette_index, const uint8_t input)
@@ -138,10 +735,10 @@ static void color_palette_data(memory* mem, const uint16_t index_addr, const uin
   uint8_t* bcps_bgpi = &mem->high_empty[index_addr - MEM_HIGH_EMPTY_START_ADDR];
   const uint8_t index = *bcps_bgpi & 0x3F;
   mem->palette[palette_index][index] = input;
+  mem->palettes_resolved = false;
   if (*bcps_bgpi & MEM_PALETTE_INDEX_INCREMENT_FLAG)
     (*bcps_bgpi)++;
 }
-#endif
 
 static uint8_t* get_dma_input_addr(memory* mem, const uint16_t input_addr)
 {
@@ -159,16 +756,10 @@ static uint8_t* get_dma_input_addr(memory* mem, const uint16_t input_addr)
     return &mem->rom.data[input_addr + mem->banks.rom.offset];
   case 0xA000:
   case 0xB000:
-    return &mem->banks.ram.data[mem->banks.ram.selected][input_addr - 0xA000];
+    return ram_byte(mem->cart_ram_pages, cart_ram_offset(mem, input_addr));
   case 0xC000:
-#ifndef CGB
-  case 0xD000:
-#endif
-    return &mem->internal_8k_ram[input_addr - 0xC000];
-#ifdef CGB
   case 0xD000:
-    return &mem->internal_8k_ram[input_addr - 0xC000 + get_internal_bank_offset(mem)];
-#endif
+    return ram_byte(mem->internal_ram_pages, internal_ram_offset(mem, input_addr));
   default:
     assert(!"Unexpected DMA input address");
     return NULL;
@@ -181,165 +772,353 @@ static inline void dma(memory* mem, const uint8_t input)
   const uint8_t *input_ptr = get_dma_input_addr(mem, input_addr);
 
   memcpy(mem->oam, input_ptr, 160);
+  mem->sprites_selected = false;
 }
 
-static inline void write_high(memory *mem,
-                              const uint16_t address,
-                              const uint8_t input)
+// I/O register handlers, indexed by the low byte of the address
+
+static uint8_t read_io(memory *mem, const uint8_t reg)
 {
-  if (address < 0xFE00)
+  return mem->io_registers[reg];
+}
+
+static uint8_t read_high_empty(memory *mem, const uint8_t reg)
+{
+  return mem->high_empty[reg - (MEM_HIGH_EMPTY_START_ADDR & 0x00FF)];
+}
+
+static uint8_t read_working_ram(memory *mem, const uint8_t reg)
+{
+  return mem->working_ram[reg - 0x80];
+}
+
+static uint8_t read_timer(memory *mem, const uint8_t reg)
+{
+  sync_timer(mem);
+  return mem->io_registers[reg];
+}
+
+static uint8_t read_keys(memory *mem, const uint8_t reg)
+{
+  const uint8_t key_base = 0xCF;
+  uint8_t key_out = key_base | mem->io_registers[0];
+
+  key_get_raw_output(mem->k, &mem->io_registers[0], &key_out);
+
+  return key_out;
+}
+
+static uint8_t read_ie(memory *mem, const uint8_t reg)
+{
+  return mem->ie_register;
+}
+
+static void write_io(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->io_registers[reg] = input;
+}
+
+static void write_high_empty(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->high_empty[reg - (MEM_HIGH_EMPTY_START_ADDR & 0x00FF)] = input;
+}
+
+static void write_working_ram(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  check_code_write(mem, 0xFF00 + reg);
+  mem->working_ram[reg - 0x80] = input;
+}
+
+static void write_ignored(memory *mem, const uint8_t reg, const uint8_t input)
+{
+}
+
+static void write_sb(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (mem->serial_cb) mem->serial_cb(mem->serial_context, input);
+  mem->io_registers[reg] = input;
+}
+
+static void write_div(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  sync_io(mem);
+  mem->div_modified = true;
+  mem->io_registers[reg] = 0;
+}
+
+static void write_timer(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  sync_io(mem);
+  mem->io_registers[reg] = input;
+}
+
+static void write_palette(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->io_registers[reg] = input;
+  mem->palettes_resolved = false;
+}
+
+static void write_if(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->io_registers[reg] = input;
+  mem->irq_pending = input & mem->ie_register;
+}
+
+static void write_lcdc(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  sync_io(mem);
+
+  // If LCD is disabled, LY needs to be cleared
+  if ((mem->io_registers[reg] & MEM_LCDC_SCREEN_ENABLED_FLAG) &&
+      !(input & MEM_LCDC_SCREEN_ENABLED_FLAG))
     {
-#ifdef CGB
-      // Echo of above switchable RAM
-      const uint16_t offset = get_internal_bank_offset(mem);
-      mem->internal_8k_ram[address - 0xE000 + offset] = input;
-#else
-      mem->internal_8k_ram[address - 0xE000] = input;
-#endif
+      mem->io_registers[MEM_LY_ADDR & 0x00FF] = 0;
+      isr_compare_ly_lyc(mem, 0, mem->io_registers[MEM_LYC_ADDR & 0x00FF]);
+
+      mem->lcd_stopped = true;
     }
-  else if (address < 0xFEA0)
+
+  mem->io_registers[reg] = input;
+}
+
+static void write_stat(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  // Mode flags are not possible to overwrite
+  mem->io_registers[reg] = (mem->io_registers[reg] & 0x87) | (input & 0x78);
+}
+
+static void write_ly(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->io_registers[reg] = 0;
+  isr_compare_ly_lyc(mem, 0, mem->io_registers[MEM_LYC_ADDR & 0x00FF]);
+}
+
+static void write_lyc(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  gb_log(VERBOSE, "LYC == (%d)", input);
+  mem->io_registers[reg] = input;
+  isr_compare_ly_lyc(mem, mem->io_registers[MEM_LY_ADDR & 0x00FF], input);
+}
+
+static void write_dma(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  dma(mem, input);
+}
+
+static void write_boot(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  // Special register stops bootloader
+  if (mem->bootloader_running && input == 0x01)
     {
-      mem->oam[address - 0xFE00] = input;
+      sync_io(mem);
+      mem->bootloader_running = false;
+      code_changed(mem);
+      map_rom(mem);
     }
-  else if (address < 0xFF00)
+  else
+    write_high_empty(mem, reg, input);
+}
+
+static void write_ie(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->ie_register = input;
+  mem->irq_pending = mem->io_registers[MEM_IF_ADDR & 0x00FF] & input;
+}
+
+// Registers of the CGB are plain bytes to DMG games, returns whether
+// the write was stored as such
+static inline bool write_dmg_unused(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (mem->cgb_mode)
+    return false;
+
+  write_high_empty(mem, reg, input);
+  return true;
+}
+
+static void write_svbk(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (write_dmg_unused(mem, reg, input))
+    return;
+
+  uint8_t bank = input & MEM_VBK_BANK_MASK;
+  if (!bank)
+    bank = 1;
+
+  mem->high_empty[MEM_SVBK_ADDR - MEM_HIGH_EMPTY_START_ADDR] = bank;
+  code_changed(mem);
+  map_internal_ram(mem);
+}
+
+static void write_vbk(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (write_dmg_unused(mem, reg, input))
+    return;
+
+  mem->high_empty[MEM_VBK_ADDR - MEM_HIGH_EMPTY_START_ADDR] = input & 0x01;
+  map_video_ram(mem);
+}
+
+static void write_bcpd(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (write_dmg_unused(mem, reg, input))
+    return;
+
+  color_palette_data(mem, MEM_BCPS_BGPI_ADDR, MEM_PALETTE_BG_INDEX, input);
+}
+
+static void write_ocpd(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (write_dmg_unused(mem, reg, input))
+    return;
+
+  color_palette_data(mem, MEM_OCPS_OBPI_ADDR, MEM_PALETTE_SPRITE_INDEX, input);
+}
+
+static void write_hdma5(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  if (write_dmg_unused(mem, reg, input))
+    return;
+
+  if (!(mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] & MEM_HDMA5_MODE_BIT))
     {
-      mem->low_empty[address - 0xFEA0] = input;
+      gb_log(WARNING, "Wrote to HDMA5 while DMA active");
+      return;
     }
-  else if (address < MEM_HIGH_EMPTY_START_ADDR)
-    {
-      switch(address)
-      {
-      case MEM_DIV_ADDR:
-        mem->div_modified = true;
-        mem->io_registers[address & 0x00FF] = 0;
-        break;
-      case MEM_LCDC_ADDR:
-        // If LCD is disabled, LY needs to be cleared
-        if ((mem->io_registers[address & 0x00FF] &
-            MEM_LCDC_SCREEN_ENABLED_FLAG) &&
-            !(input & MEM_LCDC_SCREEN_ENABLED_FLAG))
-          {
-            mem->io_registers[MEM_LY_ADDR & 0x00FF] = 0;
-            isr_compare_ly_lyc(mem, 0, mmu_read_byte(mem, MEM_LYC_ADDR));
 
-            mem->lcd_stopped = true;
-          }
+  const uint16_t src = (mem->high_empty[MEM_HDMA1_ADDR - MEM_HIGH_EMPTY_START_ADDR] << 8) +
+    (mem->high_empty[MEM_HDMA2_ADDR - MEM_HIGH_EMPTY_START_ADDR] & 0xF0);
+  const uint16_t dst = ((mem->high_empty[MEM_HDMA3_ADDR - MEM_HIGH_EMPTY_START_ADDR] << 8) & 0x1F00) +
+    (mem->high_empty[MEM_HDMA4_ADDR - MEM_HIGH_EMPTY_START_ADDR] & 0xF0);
 
-          mem->io_registers[address & 0x00FF] = input;
-          break;
-      case MEM_LCD_STAT:
-        // Mode flags are not possible to overwrite
-        mem->io_registers[address & 0x00FF] =
-          (mem->io_registers[address & 0x00FF] & 0x87) |
-          (input & 0x78);
-        break;
-      case MEM_LY_ADDR:
-        mem->io_registers[address & 0x00FF] = 0;
-        isr_compare_ly_lyc(mem, 0, mmu_read_byte(mem, MEM_LYC_ADDR));
-        break;
-      case MEM_LYC_ADDR:
-        gb_log(VERBOSE, "LYC == (%d)", input);
-        mem->io_registers[address & 0x00FF] = input;
-        isr_compare_ly_lyc(mem, mmu_read_byte(mem, MEM_LY_ADDR), input);
-        break;
-      case MEM_DMA_ADDR:
-        dma(mem, input);
-        break;
-      case 0xFF26:
-        break;
-      case MEM_SB_ADDR:
-        if (mem->serial_cb) mem->serial_cb(input);
-        // Intentional fall through
-      default:
-        mem->io_registers[address & 0x00FF] = input;
-        break;
-      }
+  if (input & MEM_HDMA5_MODE_BIT)
+    {
+      mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = input & MEM_HDMA5_LENGTH_MASK;
+      mem->dma.h_blank.dst = dst;
+      mem->dma.h_blank.src = src;
     }
-  else if (address < 0xFF80)
+  else
     {
-#ifdef CGB
-      switch (address)
-      {
-      case MEM_SVBK_ADDR:
+      const uint16_t length = (uint16_t)((input & MEM_HDMA5_LENGTH_MASK) + 1) * MEM_HDMA_HBLANK_LENGTH;
+      const uint8_t bank = get_video_ram_bank(mem);
+
+      // Pages of RAM aren't contiguous, blocks never cross one though
+      for (uint16_t done = 0; done < length; done += MEM_HDMA_HBLANK_LENGTH)
         {
-          uint8_t bank = input & MEM_VBK_BANK_MASK;
-          if (!bank)
-            bank = 1;
+          const uint8_t* input_addr = get_dma_input_addr(mem, src + done);
 
-          mem->high_empty[MEM_SVBK_ADDR - MEM_HIGH_EMPTY_START_ADDR] = bank;
-          break;
+          memcpy(&mem->video_ram[bank][dst + done], input_addr, MEM_HDMA_HBLANK_LENGTH);
+          invalidate_tiles(mem, bank, dst + done, MEM_HDMA_HBLANK_LENGTH);
+          mark_written(mem, TRACKED_VIDEO_RAM + ((bank * 8192 + dst + done) >> MEM_PAGE_SHIFT));
         }
-      case MEM_VBK_ADDR:
-        mem->high_empty[MEM_VBK_ADDR - MEM_HIGH_EMPTY_START_ADDR] = input & 0x01;
-        break;
-      case MEM_BCPD_BGPD_ADDR:
-        color_palette_data(mem, MEM_BCPS_BGPI_ADDR, MEM_PALETTE_BG_INDEX, input);
-        break;
-      case MEM_OCPD_OBPD_ADDR:
-        color_palette_data(mem, MEM_OCPS_OBPI_ADDR, MEM_PALETTE_SPRITE_INDEX, input);
-        break;
-      case MEM_HDMA1_ADDR:
-      case MEM_HDMA2_ADDR:
-      case MEM_HDMA3_ADDR:
-      case MEM_HDMA4_ADDR:
-        mem->high_empty[address - MEM_HIGH_EMPTY_START_ADDR] = input;
-        break;
-      case MEM_HDMA5_ADDR:
+
+      map_video_ram(mem);
+
+      mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = 0xFF;
+    }
+}
+
+static void init_io_handlers(memory *mem)
+{
+  for (unsigned int reg = 0x00; reg <= 0xFF; ++reg)
+    {
+      if (reg < (MEM_HIGH_EMPTY_START_ADDR & 0x00FF))
         {
-          if (!(mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] & MEM_HDMA5_MODE_BIT))
-            {
-              gb_log(WARNING, "Wrote to HDMA5 while DMA active");
-              return;
-            }
+          mem->io_read[reg] = read_io;
+          mem->io_write[reg] = write_io;
+        }
+      else if (reg < 0x80)
+        {
+          mem->io_read[reg] = read_high_empty;
+          mem->io_write[reg] = write_high_empty;
+        }
+      else
+        {
+          mem->io_read[reg] = read_working_ram;
+          mem->io_write[reg] = write_working_ram;
+        }
+    }
 
-          const uint16_t src = (mem->high_empty[MEM_HDMA1_ADDR - MEM_HIGH_EMPTY_START_ADDR] << 8) +
-            (mem->high_empty[MEM_HDMA2_ADDR - MEM_HIGH_EMPTY_START_ADDR] & 0xF0);
-          const uint16_t dst = ((mem->high_empty[MEM_HDMA3_ADDR - MEM_HIGH_EMPTY_START_ADDR] << 8) & 0x1F00) +
-            (mem->high_empty[MEM_HDMA4_ADDR - MEM_HIGH_EMPTY_START_ADDR] & 0xF0);
+  mem->io_read[0x00] = read_keys;
+  mem->io_read[MEM_DIV_ADDR & 0x00FF] = read_timer;
+  mem->io_read[MEM_TIMA_ADDR & 0x00FF] = read_timer;
+  mem->io_read[MEM_IE_ADDR & 0x00FF] = read_ie;
 
-          if (input & MEM_HDMA5_MODE_BIT)
-            {
-              mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = input & MEM_HDMA5_LENGTH_MASK;
-              mem->dma.h_blank.dst = dst;
-              mem->dma.h_blank.src = src;
-            }
-          else
-            {
-              const uint16_t length = (uint16_t)((input & MEM_HDMA5_LENGTH_MASK) + 1) * MEM_HDMA_HBLANK_LENGTH;
-              const uint8_t bank = get_video_ram_bank(mem);
-              const uint8_t* input_addr = get_dma_input_addr(mem, src);
+  mem->io_write[MEM_SB_ADDR & 0x00FF] = write_sb;
+  mem->io_write[MEM_DIV_ADDR & 0x00FF] = write_div;
+  mem->io_write[MEM_TIMA_ADDR & 0x00FF] = write_timer;
+  mem->io_write[MEM_TMA_ADDR & 0x00FF] = write_timer;
+  mem->io_write[MEM_TAC_ADDR & 0x00FF] = write_timer;
+  mem->io_write[MEM_IF_ADDR & 0x00FF] = write_if;
+  mem->io_write[0x26] = write_ignored;
+  mem->io_write[MEM_LCDC_ADDR & 0x00FF] = write_lcdc;
+  mem->io_write[MEM_LCD_STAT & 0x00FF] = write_stat;
+  mem->io_write[MEM_LY_ADDR & 0x00FF] = write_ly;
+  mem->io_write[MEM_LYC_ADDR & 0x00FF] = write_lyc;
+  mem->io_write[MEM_DMA_ADDR & 0x00FF] = write_dma;
+  mem->io_write[MEM_BGP_ADDR & 0x00FF] = write_palette;
+  mem->io_write[MEM_OBP0_ADDR & 0x00FF] = write_palette;
+  mem->io_write[MEM_OBP1_ADDR & 0x00FF] = write_palette;
+  mem->io_write[0x50] = write_boot;
+  mem->io_write[MEM_IE_ADDR & 0x00FF] = write_ie;
+  mem->io_write[MEM_SVBK_ADDR & 0x00FF] = write_svbk;
+  mem->io_write[MEM_VBK_ADDR & 0x00FF] = write_vbk;
+  mem->io_write[MEM_BCPD_BGPD_ADDR & 0x00FF] = write_bcpd;
+  mem->io_write[MEM_OCPD_OBPD_ADDR & 0x00FF] = write_ocpd;
+  mem->io_write[MEM_HDMA5_ADDR & 0x00FF] = write_hdma5;
+}
 
-              memcpy(&mem->video_ram[bank][dst], input_addr, length);
+// Writes to work RAM, at 0xC000-0xDFFF, which wasn't mapped for writing
+// because of code in the page or because the page isn't the instance's
+// own yet
+static void write_internal_ram(memory *mem,
+                               const uint16_t address,
+                               const uint8_t input)
+{
+  check_code_write(mem, address);
 
-              mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] = 0xFF;
-            }
-            break;
-         }
-        default:
-#endif
-          // Special register stops bootloader
-          if (mem->bootloader_running && address == 0xFF50 && input == 0x01)
-            mem->bootloader_running = false;
-          else
-            mem->high_empty[address - MEM_HIGH_EMPTY_START_ADDR] = input;
-#ifdef CGB
-          break;
-      }
-#endif
+  const uint32_t offset = internal_ram_offset(mem, address);
+
+  if (!own_page(&mem->internal_ram_pages[offset >> MEM_RAM_PAGE_SHIFT]))
+    return;
+
+  *ram_byte(mem->internal_ram_pages, offset) = input;
+  mark_written(mem, offset >> MEM_PAGE_SHIFT);
+
+  // Page may have become writable, by getting copied, by the other
+  // instances dropping it or by getting flagged as written
+  if (!mem->write_map[address >> MEM_PAGE_SHIFT] &&
+      !page_has_code(mem, address >> MEM_PAGE_SHIFT))
+    map_internal_ram(mem);
+}
+
+static inline void write_high(memory *mem,
+                              const uint16_t address,
+                              const uint8_t input)
+{
+  if (address < 0xFE00)
+    {
+      // Echo of above (switchable on CGB) RAM
+      write_internal_ram(mem, address - 0x2000, input);
     }
-  else if (address < 0xFFFF)
+  else if (address < 0xFEA0)
+    {
+      mem->oam[address - 0xFE00] = input;
+      mem->sprites_selected = false;
+    }
+  else if (address < 0xFF00)
     {
-      mem->working_ram[address - 0xFF80] = input;
+      mem->low_empty[address - 0xFEA0] = input;
     }
   else
     {
-      mem->ie_register = input;
+      mmu_write_io(mem, address & 0x00FF, input);
     }
 }
 
-void mmu_write_byte(memory *mem,
-                    const uint16_t address,
-                    const uint8_t input)
+void mmu_write_unmapped(memory *mem,
+                        const uint16_t address,
+                        const uint8_t input)
 {
   switch(address & 0xF000)
     {
@@ -381,6 +1160,9 @@ void mmu_write_byte(memory *mem,
         {
           const uint8_t mask = (mem->rom.type & MBC_TYPE_MASK) == MBC5 ? 0x0F : 0x03;
           mem->banks.ram.selected = input & mask;
+          if (mem->banks.ram.blocks)
+            mem->banks.ram.selected &= mem->banks.ram.blocks - 1;
+          map_cart_ram(mem);
           gb_log(VERBOSE, "Selected RAM bank %d", mem->banks.ram.selected);
         }
       else
@@ -407,47 +1189,47 @@ void mmu_write_byte(memory *mem,
     case 0x8000:
     case 0x9000:
       {
-#ifdef CGB
         const uint8_t bank = get_video_ram_bank(mem);
         mem->video_ram[bank][address - 0x8000] = input;
-#else
-        mem->video_ram[address - 0x8000] = input;
-#endif
+        invalidate_tiles(mem, bank, address - 0x8000, 1);
+
+        // Tile maps aren't mapped for writing until flagged as written
+        if (mem->track_writes)
+          {
+            mark_written(mem, TRACKED_VIDEO_RAM + ((bank * 8192 + address - 0x8000) >> MEM_PAGE_SHIFT));
+            map_video_ram(mem);
+          }
         break;
       }
     case 0xA000:
     case 0xB000:
-      if (!mem->banks.ram.enabled)
+      if (!mem->banks.ram.size)
+        {
+          break;
+        }
+      else if (!mem->banks.ram.enabled)
         {
           assert (!"Tried to access disabled RAM");
         }
       else
         {
-          mem->banks.ram.written = true;
-          mem->banks.ram.data[mem->banks.ram.selected][address - 0xA000] =
-            input;
+          const uint32_t offset = cart_ram_offset(mem, address);
+
+          if (own_page(&mem->cart_ram_pages[offset >> MEM_RAM_PAGE_SHIFT]))
+            {
+              mem->banks.ram.written = true;
+              *ram_byte(mem->cart_ram_pages, offset) = input;
+              mark_written(mem, TRACKED_CART_RAM + (offset >> MEM_PAGE_SHIFT));
+            }
+
+          map_cart_ram(mem);
         }
       break;
     case 0xC000:
-#ifndef CGB
     case 0xD000:
-#endif
-      // Fixed first 4k of internal RAM on CGB
-      mem->internal_8k_ram[address - 0xC000] = input;
+      // Second 4k is switchable on CGB
+      write_internal_ram(mem, address, input);
       break;
-#ifdef CGB
-    case 0xE000:
-      // Echo of above
-      mem->internal_8k_ram[address - 0xE000] = input;
-      break;
-    case 0xD000:
-      {
-        // Switchable second half of internal RAM
-        const uint16_t offset = get_internal_bank_offset(mem);
-        mem->internal_8k_ram[address - 0xC000 + offset] = input;
-        break;
-      }
-#endif
     default:
       write_high(mem, address, input);
       break;
@@ -459,14 +1241,7 @@ static inline uint8_t read_high(memory *mem, const uint16_t address)
   if (address < 0xFE00)
     {
       // Echo of above switchable (on CGB) RAM
-#ifdef CGB
-      const uint16_t offset = get_internal_bank_offset(mem);
-#endif
-      return mem->internal_8k_ram[address - 0xE000
-#ifdef CGB
-          + offset
-#endif
-      ];
+      return *ram_byte(mem->internal_ram_pages, internal_ram_offset(mem, address - 0x2000));
     }
   else if (address < 0xFEA0)
     {
@@ -476,34 +1251,13 @@ static inline uint8_t read_high(memory *mem, const uint16_t address)
     {
       return mem->low_empty[address - 0xFEA0];
     }
-  else if (address == 0xFF00)
-    {
-      const uint8_t key_base = 0xCF;
-      uint8_t key_out = key_base | mem->io_registers[0];
-
-      key_get_raw_output(mem->k, &mem->io_registers[0], &key_out);
-
-      return key_out;
-    }
-  else if (address < MEM_HIGH_EMPTY_START_ADDR)
-    {
-      return mem->io_registers[address - 0xFF00];
-    }
-  else if (address < 0xFF80)
-    {
-      return mem->high_empty[address - MEM_HIGH_EMPTY_START_ADDR];
-    }
-  else if (address < 0xFFFF)
-    {
-      return mem->working_ram[address - 0xFF80];
-    }
   else
     {
-      return mem->ie_register;
+      return mmu_read_io(mem, address & 0x00FF);
     }
 }
 
-uint8_t mmu_read_byte(memory *mem, const uint16_t address)
+uint8_t mmu_read_unmapped(memory *mem, const uint16_t address)
 {
   switch(address & 0xF000)
     {
@@ -522,41 +1276,28 @@ uint8_t mmu_read_byte(memory *mem, const uint16_t address)
     case 0x8000:
     case 0x9000:
       {
-#ifdef CGB
         const uint8_t bank = get_video_ram_bank(mem);
         return mem->video_ram[bank][address - 0x8000];
-#else
-        return mem->video_ram[address - 0x8000];
-#endif
       }
     case 0xA000:
     case 0xB000:
-      if (!mem->banks.ram.enabled)
+      if (!mem->banks.ram.size)
+        {
+          return 0xFF;
+        }
+      else if (!mem->banks.ram.enabled)
         {
           assert (!"Tried to access disabled RAM");
         }
       else
         {
-          return mem->banks.ram.data[mem->banks.ram.selected][address - 0xA000];
+          return *ram_byte(mem->cart_ram_pages, cart_ram_offset(mem, address));
         }
       break;
     case 0xC000:
-#ifndef CGB
     case 0xD000:
-#endif
-      // Fixed first 4k of internal RAM
-      return mem->internal_8k_ram[address - 0xC000];
-#ifdef CGB
-    case 0xE000:
-      // Echo of above
-      return mem->internal_8k_ram[address - 0xE000];
-    case 0xD000:
-      {
-        // Switchable second half of internal RAM
-        const uint16_t offset = get_internal_bank_offset(mem);
-        return mem->internal_8k_ram[address - 0xC000 + offset];
-      }
-#endif
+      // Second 4k is switchable on CGB
+      return *ram_byte(mem->internal_ram_pages, internal_ram_offset(mem, address));
     default:
       return read_high(mem, address);
     }
@@ -566,19 +1307,6 @@ uint8_t mmu_read_byte(memory *mem, const uint16_t address)
   return 0;
 }
 
-uint16_t mmu_read_word(memory *mem, const uint16_t address)
-{
-  return mmu_read_byte(mem, address) |
-    (uint16_t)((mmu_read_byte(mem, address + 1)) << 8);
-}
-
-void mmu_write_word(memory *mem, const uint16_t address, const uint16_t word)
-{
-  mmu_write_byte(mem, address, (const uint8_t)word);
-  mmu_write_byte(mem, address + 1, word >> 8);
-}
-
-#ifdef CGB
 void mmu_hblank_dma(memory *mem)
 {
   if (!(mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] & MEM_HDMA5_MODE_BIT))
@@ -587,6 +1315,13 @@ void mmu_hblank_dma(memory *mem)
       const uint8_t* input_addr = get_dma_input_addr(mem, mem->dma.h_blank.src);
 
       memcpy(&mem->video_ram[bank][mem->dma.h_blank.dst], input_addr, MEM_HDMA_HBLANK_LENGTH);
+      invalidate_tiles(mem, bank, mem->dma.h_blank.dst, MEM_HDMA_HBLANK_LENGTH);
+
+      if (mem->track_writes)
+        {
+          mark_written(mem, TRACKED_VIDEO_RAM + ((bank * 8192 + mem->dma.h_blank.dst) >> MEM_PAGE_SHIFT));
+          map_video_ram(mem);
+        }
 
       mem->dma.h_blank.dst += MEM_HDMA_HBLANK_LENGTH;
       mem->dma.h_blank.src += MEM_HDMA_HBLANK_LENGTH;
@@ -594,4 +1329,3 @@ void mmu_hblank_dma(memory *mem)
       mem->high_empty[MEM_HDMA5_ADDR - MEM_HIGH_EMPTY_START_ADDR] -= 1;
     }
 }
-#endif
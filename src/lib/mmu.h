@@ -4,11 +4,44 @@
 #include "keys.h"
 #include "logger.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MBC_BATTERY_BIT 0x80
 
-typedef void (*serial_cb)(uint8_t);
+#define MEM_CODE_CHUNK_SHIFT 6
+
+#define MEM_PAGE_SHIFT 8
+#define MEM_PAGES (0x10000 >> MEM_PAGE_SHIFT)
+
+// Work and cartridge RAM are kept in pages of their own, which forked
+// instances share until writing to them
+#define MEM_RAM_PAGE_SHIFT 12
+#define MEM_RAM_PAGE_SIZE (1 << MEM_RAM_PAGE_SHIFT)
+
+#define MEM_INTERNAL_RAM_SIZE (8192 + 6 * 4096)
+#define MEM_CART_RAM_SIZE (16 * 8192)
+
+#define MEM_VIDEO_RAM_BANKS 2
+#define MEM_VIDEO_RAM_SIZE (MEM_VIDEO_RAM_BANKS * 8192)
+
+// Tiles of 16 bytes in each bank of video RAM, at 0x8000-0x97FF
+#define MEM_TILE_DATA_SIZE 0x1800
+#define MEM_TILES (MEM_TILE_DATA_SIZE / 16)
+
+// Pages of work, cartridge and video RAM, numbered in that order, which
+// writes are tracked for
+#define MEM_TRACKED_PAGES ((MEM_INTERNAL_RAM_SIZE + MEM_CART_RAM_SIZE + MEM_VIDEO_RAM_SIZE) >> MEM_PAGE_SHIFT)
+
+typedef void (*serial_cb)(void *context, uint8_t);
+typedef void (*io_sync_cb)(void*);
+
+struct memory_s;
+
+// Accesses to 0xFF00 + reg
+typedef uint8_t (*io_read_handler)(struct memory_s *mem, const uint8_t reg);
+typedef void (*io_write_handler)(struct memory_s *mem, const uint8_t reg, const uint8_t input);
 
 typedef enum {
   NONE = 0x00,
@@ -26,23 +59,18 @@ typedef enum {
 
 struct memory_s {
   uint8_t ie_register;
+
+  // IF & IE, kept up to date on writes to either register
+  uint8_t irq_pending;
   uint8_t working_ram[127];
   uint8_t internal_ram[128];
   uint8_t high_empty[52];
   uint8_t io_registers[76];
   uint8_t low_empty[96];
-#ifdef CGB
-  uint8_t internal_8k_ram[8192 + 6 * 4096];
-#else
-  uint8_t internal_8k_ram[8192];
-#endif
   uint8_t oam[160];
-#ifdef CGB
   uint8_t video_ram[2][8192];
   uint8_t palette[2][64];
-#else
-  uint8_t video_ram[8192];
-#endif
+  // Members from here on are saved one by one, see mmu_get_state()
   struct {
     uint8_t *data;
     mbc type;
@@ -64,11 +92,12 @@ struct memory_s {
     struct {
       bool enabled, written;
       uint8_t selected;
-      uint8_t data[16][8192];
+      uint8_t blocks;
+      // Bytes of RAM the cartridge has, smaller ones being mirrored
+      uint32_t size;
     }ram;
   }banks;
 
-#ifdef CGB
   bool cgb_mode;
 
   struct {
@@ -77,13 +106,77 @@ struct memory_s {
       uint16_t dst;
     }h_blank;
   }dma;
-#endif
 
+  // Members from here on aren't machine state, they are set up by the
+  // host or derived from the state, see MEM_STATE_SIZE
   serial_cb serial_cb;
+  void *serial_context;
+
+  // Bumped whenever memory seen at a code address may have changed, by
+  // switching a bank or writing to RAM flagged in code_chunks
+  uint32_t code_generation;
+  uint8_t code_chunks[0x10000 >> MEM_CODE_CHUNK_SHIFT];
+
+  // Host memory backing each page for the current banks, NULL where
+  // accesses have side effects and go through mmu_read_unmapped() or
+  // mmu_write_unmapped() instead
+  const uint8_t *read_map[MEM_PAGES];
+  uint8_t *write_map[MEM_PAGES];
+
+  // Handlers of the I/O registers, high RAM and IE
+  io_read_handler io_read[0x100];
+  io_write_handler io_write[0x100];
+
+  // Called before reading DIV or TIMA, which are only counted up then
+  io_sync_cb timer_sync_cb;
+
+  // Called before writing a register which changes how peripherals
+  // count cycles, so that they can be brought up to date first
+  io_sync_cb io_sync_cb;
+  void *io_sync_data;
+
+  // Pages of work and cartridge RAM. Their contents are machine state,
+  // saved apart from the rest. Pages which another instance shares, or
+  // which haven't been written yet, are mapped for reading only.
+  uint8_t *internal_ram_pages[MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+  uint8_t *cart_ram_pages[MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+
+  // Pages of RAM written since marking a checkpoint, as flags and as a
+  // list. While tracking, pages get mapped for writing once flagged.
+  bool track_writes;
+  uint8_t written[MEM_TRACKED_PAGES];
+  uint16_t written_list[MEM_TRACKED_PAGES];
+  unsigned int written_count;
+
+  // Tiles the renderer has decoded, cleared whenever their data may have
+  // changed. Tile data is never mapped for writing so that none is missed.
+  bool tiles_decoded[MEM_VIDEO_RAM_BANKS][MEM_TILES];
+
+  // Whether the renderer has palettes resolved to pixels, cleared when
+  // any gets written
+  bool palettes_resolved;
+
+  // Whether the renderer has selected the sprites of each line, cleared
+  // when OAM gets written
+  bool sprites_selected;
 };
 
 typedef struct memory_s memory;
 
+// Bytes at the start of memory holding the machine state, besides the
+// pages of RAM. Pointers to the ROM, bootloader and keys in it are only
+// valid within the instance, they are left out of saved states.
+#define MEM_STATE_SIZE offsetof(memory, serial_cb)
+
+// Memory as of a checkpoint, with references to the pages of RAM
+struct mem_checkpoint_s {
+  uint8_t state[MEM_STATE_SIZE];
+  uint8_t *internal_ram_pages[MEM_INTERNAL_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+  uint8_t *cart_ram_pages[MEM_CART_RAM_SIZE >> MEM_RAM_PAGE_SHIFT];
+};
+
+typedef struct mem_checkpoint_s mem_checkpoint;
+
 #define MEM_TILE_MAP_ADDR_1 0x9800
 #define MEM_TILE_MAP_ADDR_2 0x9C00
 #define MEM_TILE_ADDR_1 0x8800
@@ -173,6 +266,9 @@ typedef struct memory_s memory;
 
 void mmu_reset(memory *mem);
 
+// Releases the pages of RAM
+void mmu_uninit(memory *mem);
+
 #ifndef NDEBUG
 void mmu_debug_print(memory *mem, level l);
 #else
@@ -181,20 +277,98 @@ void mmu_debug_print(memory *mem, level l);
 
 void mmu_set_keys(memory *mem, keys *k);
 
-void mmu_set_rom(memory *mem, uint8_t *rom, mbc type, uint32_t rom_size);
+void mmu_set_rom(memory *mem, uint8_t *rom, mbc type, uint32_t rom_size, uint32_t ram_size);
+
+// Runs the game as on CGB, with its registers and banks of RAM, rather
+// than as on DMG
+void mmu_set_cgb_mode(memory *mem, const bool cgb_mode);
 
 void mmu_set_bootloader(memory *mem, uint8_t *bootloader);
 
-uint8_t mmu_read_byte(memory *mem, const uint16_t address);
+void mmu_set_io_sync(memory *mem, io_sync_cb cb, io_sync_cb timer_cb, void *data);
+
+// Flags RAM holding decoded code, writing to it bumps the code generation
+void mmu_mark_code(memory *mem, const uint16_t start, const uint16_t end);
+
+// Clears the flag telling cartridge RAM was written since the last save
+void mmu_clear_ram_written(memory *mem);
+
+// Brings derived data up to date after machine state got replaced: page
+// maps are rebuilt and code flags dropped, as code is being decoded anew
+void mmu_restore(memory *mem);
+
+// Copies the machine state, MEM_STATE_SIZE bytes, with pointers and
+// padding zeroed so that the same state always gives the same bytes
+void mmu_get_state(memory *mem, uint8_t *state);
+
+// Copies work RAM, MEM_INTERNAL_RAM_SIZE bytes, and cartridge RAM,
+// banks.ram.size bytes, to or from the buffers, NULL skipping one.
+// Setting returns false, leaving RAM as it was, when out of memory.
+void mmu_get_ram(memory *mem, uint8_t *internal, uint8_t *cart);
+bool mmu_set_ram(memory *mem, const uint8_t *internal, const uint8_t *cart);
+
+// Makes RAM of the instance share the pages of another one, each getting
+// a copy of a page once writing to it
+void mmu_share_ram(memory *mem, memory *from);
+
+// Keeps memory as it is to the checkpoint and starts tracking writes.
+// Pages of RAM are shared with it, copied once written to.
+void mmu_mark_checkpoint(memory *mem, mem_checkpoint *cp);
+
+// Returns memory to the checkpoint, copying back the pages written since.
+// Returns false when out of memory, memory being then only partly reset
+// and the pages left to copy back still flagged for trying again.
+bool mmu_reset_to_checkpoint(memory *mem, mem_checkpoint *cp);
+
+// Releases the pages of the checkpoint and stops tracking writes
+void mmu_drop_checkpoint(memory *mem, mem_checkpoint *cp);
 
-uint16_t mmu_read_word(memory *mem, const uint16_t address);
+uint8_t mmu_read_unmapped(memory *mem, const uint16_t address);
 
-void mmu_write_byte(memory *mem, const uint16_t address, const uint8_t input);
+void mmu_write_unmapped(memory *mem, const uint16_t address, const uint8_t input);
 
-void mmu_write_word(memory *mem, const uint16_t address, const uint16_t input);
+static inline uint8_t mmu_read_io(memory *mem, const uint8_t reg)
+{
+  return mem->io_read[reg](mem, reg);
+}
+
+static inline void mmu_write_io(memory *mem, const uint8_t reg, const uint8_t input)
+{
+  mem->io_write[reg](mem, reg, input);
+}
+
+static inline uint8_t mmu_read_byte(memory *mem, const uint16_t address)
+{
+  const uint8_t *page = mem->read_map[address >> MEM_PAGE_SHIFT];
+
+  if (page)
+    return page[address & 0xFF];
+
+  return mmu_read_unmapped(mem, address);
+}
+
+static inline uint16_t mmu_read_word(memory *mem, const uint16_t address)
+{
+  return mmu_read_byte(mem, address) |
+    (uint16_t)((mmu_read_byte(mem, address + 1)) << 8);
+}
+
+static inline void mmu_write_byte(memory *mem, const uint16_t address, const uint8_t input)
+{
+  uint8_t *page = mem->write_map[address >> MEM_PAGE_SHIFT];
+
+  if (page)
+    page[address & 0xFF] = input;
+  else
+    mmu_write_unmapped(mem, address, input);
+}
+
+static inline void mmu_write_word(memory *mem, const uint16_t address, const uint16_t word)
+{
+  mmu_write_byte(mem, address, (const uint8_t)word);
+  mmu_write_byte(mem, address + 1, word >> 8);
+}
 
-#ifdef CGB
 void mmu_hblank_dma(memory *mem);
-#endif
 
 #endif // MMU_H
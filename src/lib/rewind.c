@@ -0,0 +1,353 @@
+#include "rewind.h"
+
+#include "logger.h"
+#include "state.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Zero bytes which end a literal run, fewer are cheaper to copy along
+#define REWIND_MIN_ZERO_RUN 4
+
+#define REWIND_CHUNK 64
+
+// Each record in the ring holds the way back from a snapshot to the one
+// before it: its length, the encoded XOR of the two, then the frame of
+// the earlier snapshot and the length again for walking back from the
+// newest record. The XOR is encoded as pairs of a count of unchanged
+// bytes and a count of changed ones, followed by those.
+struct rewind_buffer_s {
+  unsigned int interval;
+
+  // Frames rendered since enabling, or as of the snapshot gone back to
+  uint32_t frame;
+
+  size_t state_size;
+  uint8_t *latest;
+  uint8_t *scratch;
+  uint32_t latest_frame;
+  bool has_latest;
+
+  uint8_t *ring;
+  size_t capacity;
+  size_t head, tail, used;
+  unsigned int records;
+
+  // Bytes of the record being written
+  size_t written;
+};
+
+static void ring_read(rewind_buffer *r, size_t pos, uint8_t *data, size_t n)
+{
+  while (n--)
+    {
+      *data++ = r->ring[pos];
+      pos = pos + 1 == r->capacity ? 0 : pos + 1;
+    }
+}
+
+static void ring_poke(rewind_buffer *r, size_t pos, const uint8_t *data, size_t n)
+{
+  while (n--)
+    {
+      r->ring[pos] = *data++;
+      pos = pos + 1 == r->capacity ? 0 : pos + 1;
+    }
+}
+
+static inline size_t ring_back(rewind_buffer *r, const size_t pos, const size_t n)
+{
+  return pos >= n ? pos - n : pos + r->capacity - n;
+}
+
+static void drop_oldest(rewind_buffer *r)
+{
+  uint32_t length;
+  ring_read(r, r->tail, (uint8_t*)&length, sizeof length);
+
+  const size_t size = length + 3 * sizeof(uint32_t);
+
+  r->tail = (r->tail + size) % r->capacity;
+  r->used -= size;
+  --r->records;
+}
+
+static void drop_all(rewind_buffer *r)
+{
+  r->head = r->tail = r->used = 0;
+  r->records = 0;
+}
+
+// Appends to the record being written, making room by dropping the
+// oldest records. Returns false when even all of them wouldn't do.
+static bool ring_write(rewind_buffer *r, const uint8_t *data, const size_t n)
+{
+  while (r->capacity - r->used < n)
+    {
+      if (!r->records)
+        return false;
+
+      drop_oldest(r);
+    }
+
+  ring_poke(r, r->head, data, n);
+  r->head = (r->head + n) % r->capacity;
+  r->used += n;
+  r->written += n;
+
+  return true;
+}
+
+static bool write_count(rewind_buffer *r, size_t count)
+{
+  uint8_t bytes[10];
+  size_t n = 0;
+
+  do
+    {
+      bytes[n] = count & 0x7F;
+      count >>= 7;
+      if (count)
+        bytes[n] |= 0x80;
+      ++n;
+    }
+  while (count);
+
+  return ring_write(r, bytes, n);
+}
+
+static size_t read_count(rewind_buffer *r, size_t *pos)
+{
+  size_t count = 0;
+  unsigned int shift = 0;
+  uint8_t byte;
+
+  do
+    {
+      byte = r->ring[*pos];
+      *pos = *pos + 1 == r->capacity ? 0 : *pos + 1;
+
+      count |= (size_t)(byte & 0x7F) << shift;
+      shift += 7;
+    }
+  while (byte & 0x80);
+
+  return count;
+}
+
+static inline size_t zero_run(const uint8_t *a, const uint8_t *b, size_t pos, const size_t size)
+{
+  const size_t start = pos;
+
+  while (pos < size && a[pos] == b[pos])
+    ++pos;
+
+  return pos - start;
+}
+
+static bool write_delta(rewind_buffer *r, const uint8_t *a, const uint8_t *b)
+{
+  const size_t size = r->state_size;
+  size_t pos = 0;
+
+  while (pos < size)
+    {
+      const size_t zeros = zero_run(a, b, pos, size);
+      pos += zeros;
+
+      // Short runs of unchanged bytes are taken along with the changed
+      size_t end = pos;
+      while (end < size)
+        {
+          const size_t run = zero_run(a, b, end, size);
+
+          if (run >= REWIND_MIN_ZERO_RUN || end + run == size)
+            break;
+
+          end += run ? run : 1;
+        }
+
+      if (!write_count(r, zeros) || !write_count(r, end - pos))
+        return false;
+
+      while (pos < end)
+        {
+          uint8_t chunk[REWIND_CHUNK];
+          const size_t n = end - pos < REWIND_CHUNK ? end - pos : REWIND_CHUNK;
+
+          for (size_t i = 0; i < n; ++i)
+            chunk[i] = a[pos + i] ^ b[pos + i];
+
+          if (!ring_write(r, chunk, n))
+            return false;
+
+          pos += n;
+        }
+    }
+
+  return true;
+}
+
+// Adds the way back from the snapshot in scratch to the latest one
+static void add_record(rewind_buffer *r)
+{
+  const size_t start = r->head;
+  uint32_t length = 0;
+
+  r->written = 0;
+
+  if (!ring_write(r, (uint8_t*)&length, sizeof length) ||
+      !write_delta(r, r->latest, r->scratch))
+    {
+      // All older records are gone by now, and this one doesn't fit
+      gb_log (WARNING, "Rewind buffer too small for a snapshot");
+      drop_all(r);
+      return;
+    }
+
+  length = (uint32_t)(r->written - sizeof length);
+
+  if (!ring_write(r, (uint8_t*)&r->latest_frame, sizeof r->latest_frame) ||
+      !ring_write(r, (uint8_t*)&length, sizeof length))
+    {
+      gb_log (WARNING, "Rewind buffer too small for a snapshot");
+      drop_all(r);
+      return;
+    }
+
+  ring_poke(r, start, (uint8_t*)&length, sizeof length);
+  ++r->records;
+}
+
+// Turns the latest snapshot into the one before it
+static void undo_record(rewind_buffer *r)
+{
+  uint32_t frame, length;
+  ring_read(r, ring_back(r, r->head, sizeof length), (uint8_t*)&length, sizeof length);
+  ring_read(r, ring_back(r, r->head, sizeof length + sizeof frame), (uint8_t*)&frame, sizeof frame);
+
+  const size_t start = ring_back(r, r->head, length + 3 * sizeof(uint32_t));
+  size_t pos = (start + sizeof length) % r->capacity;
+  size_t offset = 0;
+
+  while (offset < r->state_size)
+    {
+      offset += read_count(r, &pos);
+
+      for (size_t changed = read_count(r, &pos); changed; --changed)
+        {
+          r->latest[offset++] ^= r->ring[pos];
+          pos = pos + 1 == r->capacity ? 0 : pos + 1;
+        }
+    }
+
+  r->head = start;
+  r->used -= length + 3 * sizeof(uint32_t);
+  --r->records;
+
+  r->latest_frame = frame;
+}
+
+static void take_snapshot(chester *chester, rewind_buffer *r)
+{
+  // Not kept while the bootloader runs, as states from then can't be
+  // loaded once it's done
+  if (chester->mem.bootloader_running)
+    return;
+
+  chester_save_state(chester, r->scratch, r->state_size);
+
+  if (r->has_latest)
+    add_record(r);
+
+  uint8_t *latest = r->latest;
+  r->latest = r->scratch;
+  r->scratch = latest;
+
+  r->latest_frame = r->frame;
+  r->has_latest = true;
+}
+
+bool chester_rewind_enable(chester *chester, const unsigned int interval, const size_t capacity)
+{
+  chester_rewind_disable(chester);
+
+  rewind_buffer *r = calloc(1, sizeof(rewind_buffer));
+
+  if (!r)
+    {
+      return false;
+    }
+
+  r->interval = interval ? interval : 1;
+  r->state_size = chester_state_size(chester);
+  r->capacity = capacity;
+
+  r->latest = malloc(r->state_size);
+  r->scratch = malloc(r->state_size);
+  r->ring = malloc(capacity ? capacity : 1);
+
+  chester->rewind_buf = r;
+
+  if (!r->latest || !r->scratch || !r->ring)
+    {
+      chester_rewind_disable(chester);
+      return false;
+    }
+
+  take_snapshot(chester, r);
+
+  return true;
+}
+
+void chester_rewind_disable(chester *chester)
+{
+  rewind_buffer *r = chester->rewind_buf;
+
+  if (!r)
+    return;
+
+  free(r->ring);
+  free(r->scratch);
+  free(r->latest);
+  free(r);
+
+  chester->rewind_buf = NULL;
+  chester->rewind_pending = false;
+}
+
+unsigned int chester_rewind(chester *chester, const unsigned int frames)
+{
+  rewind_buffer *r = chester->rewind_buf;
+
+  if (!r || !r->has_latest)
+    return 0;
+
+  const uint32_t target = frames < r->frame ? r->frame - frames : 0;
+
+  while (r->latest_frame > target && r->records)
+    undo_record(r);
+
+  if (!chester_load_state(chester, r->latest, r->state_size))
+    {
+      gb_log (ERROR, "Could not rewind");
+      drop_all(r);
+      r->has_latest = false;
+      return 0;
+    }
+
+  const unsigned int back = r->frame - r->latest_frame;
+
+  r->frame = r->latest_frame;
+  chester->rewind_pending = false;
+
+  return back;
+}
+
+void rewind_frame_done(chester *chester)
+{
+  rewind_buffer *r = chester->rewind_buf;
+
+  if (++r->frame % r->interval == 0)
+    take_snapshot(chester, r);
+}
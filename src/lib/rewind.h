@@ -0,0 +1,30 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "chester.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct rewind_buffer_s rewind_buffer;
+
+// Keeps a snapshot of the instance every 'interval' frames, and as many
+// of the ones before it as fit in 'capacity' bytes. Those are kept as
+// the way back from the next snapshot: the two XORed together and run
+// length encoded, so that they take little more than the bytes which
+// changed. Memory used is the capacity and two saved states. Returns
+// false when out of memory.
+bool chester_rewind_enable(chester *chester, const unsigned int interval, const size_t capacity);
+
+void chester_rewind_disable(chester *chester);
+
+// Goes back to the latest snapshot at least the given number of frames
+// back, or to the oldest one there is. Snapshots after it are dropped.
+// Returns the number of frames gone back, 0 if there was no snapshot.
+unsigned int chester_rewind(chester *chester, const unsigned int frames);
+
+// Counts a frame rendered, taking a snapshot when one is due. Called by
+// the run loop between instructions.
+void rewind_frame_done(chester *chester);
+
+#endif // REWIND_H
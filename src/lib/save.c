@@ -2,15 +2,28 @@
 
 #include "logger.h"
 
-#include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 void save_game(char* file_name, memory *mem)
 {
   FILE *save_file = fopen(file_name, "wb");
   if (save_file)
   {
-    fwrite(&mem->banks.ram.data, sizeof mem->banks.ram.data, 1, save_file);
+    // Saved at the size the cartridge has
+    uint8_t *data = malloc(mem->banks.ram.size);
+
+    if (data)
+      {
+        mmu_get_ram(mem, NULL, data);
+        fwrite(data, 1, mem->banks.ram.size, save_file);
+        free(data);
+      }
+    else
+      {
+        gb_log(ERROR, "Memory error");
+      }
+
     fclose(save_file);
   }
 }
@@ -26,13 +39,32 @@ void load_game(char* file_name, memory *mem)
     file_size = ftell(save_file);
     rewind (save_file);
 
-    size_t result = fread(&mem->banks.ram.data, 1, sizeof mem->banks.ram.data, save_file);
+    // Saves written before RAM was sized from the header are bigger,
+    // only their start is read then
+    const size_t read_size = file_size < mem->banks.ram.size ?
+      file_size : mem->banks.ram.size;
+    uint8_t *data = calloc(1, mem->banks.ram.size);
 
-    if (result != file_size)
+    if (!data)
+      {
+        gb_log(ERROR, "Memory error");
+        fclose(save_file);
+        return;
+      }
+
+    size_t result = fread(data, 1, read_size, save_file);
+
+    // RAM is left zeroed on errors
+    if (result != read_size)
       {
         gb_log(ERROR, "Save file read error");
-        memset(mem->banks.ram.data, 0, sizeof mem->banks.ram.data);
       }
+    else
+      {
+        mmu_set_ram(mem, NULL, data);
+      }
+
+    free(data);
 
     fclose(save_file);
   }
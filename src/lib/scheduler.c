@@ -0,0 +1,75 @@
+#include "scheduler.h"
+
+#include <limits.h>
+
+static inline bool earlier(const scheduler *s, const uint8_t i, const uint8_t j)
+{
+  return s->deadline[s->heap[i]] < s->deadline[s->heap[j]];
+}
+
+static inline void swap(scheduler *s, const uint8_t i, const uint8_t j)
+{
+  const uint8_t e = s->heap[i];
+
+  s->heap[i] = s->heap[j];
+  s->heap[j] = e;
+
+  s->index[s->heap[i]] = i;
+  s->index[s->heap[j]] = j;
+}
+
+void scheduler_reset(scheduler *s)
+{
+  for (uint8_t e = 0; e < EVENT_COUNT; ++e)
+    {
+      s->deadline[e] = SCHEDULER_NEVER;
+      s->updated[e] = 0;
+      s->heap[e] = e;
+      s->index[e] = e;
+    }
+}
+
+void scheduler_schedule(scheduler *s, const event e, const uint64_t deadline)
+{
+  uint8_t i = s->index[e];
+
+  s->deadline[e] = deadline;
+
+  // Sift up if the deadline moved closer
+  while (i > 0 && earlier(s, i, (i - 1) / 2))
+    {
+      swap(s, i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+
+  // Sift down if it moved further away
+  for (;;)
+    {
+      const uint8_t left = 2 * i + 1;
+      const uint8_t right = left + 1;
+      uint8_t first = i;
+
+      if (left < EVENT_COUNT && earlier(s, left, first))
+        first = left;
+
+      if (right < EVENT_COUNT && earlier(s, right, first))
+        first = right;
+
+      if (first == i)
+        break;
+
+      swap(s, i, first);
+      i = first;
+    }
+}
+
+unsigned int scheduler_elapsed(scheduler *s, const event e, const uint64_t now)
+{
+  const uint64_t elapsed = now - s->updated[e];
+
+  s->updated[e] = now;
+
+  // Only a subsystem with nothing to do, like a disabled LCD, can be
+  // left behind for that long
+  return elapsed < UINT_MAX ? (unsigned int)elapsed : UINT_MAX;
+}
@@ -0,0 +1,51 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SCHEDULER_NEVER UINT64_MAX
+
+// Subsystems which need to be updated at a given cycle. Events due at
+// the same cycle are handled in this order.
+typedef enum event_e {
+  EVENT_GPU,
+  EVENT_TIMER,
+  EVENT_KEYS,
+  EVENT_SYNC,
+  EVENT_COUNT
+} event;
+
+struct scheduler_s {
+  // Absolute cycle at which each event is due
+  uint64_t deadline[EVENT_COUNT];
+
+  // Absolute cycle at which each subsystem was last brought up to date
+  uint64_t updated[EVENT_COUNT];
+
+  // Binary min-heap of events ordered by deadline, and the position of
+  // every event in it
+  uint8_t heap[EVENT_COUNT];
+  uint8_t index[EVENT_COUNT];
+};
+
+typedef struct scheduler_s scheduler;
+
+void scheduler_reset(scheduler *s);
+
+void scheduler_schedule(scheduler *s, const event e, const uint64_t deadline);
+
+static inline uint64_t scheduler_next_deadline(const scheduler *s)
+{
+  return s->deadline[s->heap[0]];
+}
+
+static inline bool scheduler_is_due(const scheduler *s, const event e, const uint64_t now)
+{
+  return s->deadline[e] <= now;
+}
+
+// Returns the cycles elapsed since the last call for that event
+unsigned int scheduler_elapsed(scheduler *s, const event e, const uint64_t now);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,80 @@
+#include "shared.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Reference count in front of the data, padded to keep it aligned
+union shared_header_u {
+  volatile long refs;
+  double align_double;
+  void *align_pointer;
+  uint64_t align_integer;
+};
+
+typedef union shared_header_u shared_header;
+
+static inline shared_header *get_header(const void *data)
+{
+  return (shared_header*)data - 1;
+}
+
+void *shared_alloc(const size_t size)
+{
+  shared_header *header = malloc(sizeof(shared_header) + size);
+
+  if (!header)
+    {
+      return NULL;
+    }
+
+  header->refs = 1;
+
+  return header + 1;
+}
+
+void *shared_ref(void *data)
+{
+  shared_header *header = get_header(data);
+
+#ifdef _MSC_VER
+  _InterlockedIncrement(&header->refs);
+#else
+  __atomic_add_fetch(&header->refs, 1, __ATOMIC_RELAXED);
+#endif
+
+  return data;
+}
+
+void shared_unref(void *data)
+{
+  if (!data)
+    return;
+
+  shared_header *header = get_header(data);
+
+#ifdef _MSC_VER
+  const long refs = _InterlockedDecrement(&header->refs);
+#else
+  const long refs = __atomic_sub_fetch(&header->refs, 1, __ATOMIC_ACQ_REL);
+#endif
+
+  if (!refs)
+    {
+      free(header);
+    }
+}
+
+bool shared_exclusive(const void *data)
+{
+  shared_header *header = get_header(data);
+
+#ifdef _MSC_VER
+  return _InterlockedCompareExchange(&header->refs, 0, 0) == 1;
+#else
+  return __atomic_load_n(&header->refs, __ATOMIC_ACQUIRE) == 1;
+#endif
+}
@@ -0,0 +1,20 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Buffers shared by forked instances, freed when the last reference to
+// one is dropped. References may be dropped on any thread, but a buffer
+// is only referenced anew by the instance holding it.
+
+void *shared_alloc(const size_t size);
+
+void *shared_ref(void *data);
+
+void shared_unref(void *data);
+
+// Whether the caller holds the only reference, so that it can write
+bool shared_exclusive(const void *data);
+
+#endif // SHARED_H
@@ -0,0 +1,164 @@
+#include "state.h"
+
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void fill_header(chester *chester, state_header *header)
+{
+  memset(header, 0, sizeof(state_header));
+
+  header->magic = STATE_MAGIC;
+  header->version = STATE_VERSION;
+  header->rom_checksum = (chester->rom[0x014E] << 8) | chester->rom[0x014F];
+
+  header->registers_size = sizeof(registers);
+  header->memory_size = MEM_STATE_SIZE;
+  header->internal_ram_size = MEM_INTERNAL_RAM_SIZE;
+  header->cart_ram_size = chester->mem.banks.ram.size;
+  header->gpu_size = sizeof(chester->g.clock);
+  header->keys_size = sizeof(keys);
+  header->scheduler_size = sizeof(scheduler);
+  header->machine_size = sizeof(state_machine);
+
+  header->size = sizeof(state_header) + header->registers_size +
+    header->memory_size + header->internal_ram_size +
+    header->cart_ram_size + header->gpu_size + header->keys_size +
+    header->scheduler_size + header->machine_size;
+}
+
+size_t chester_state_size(chester *chester)
+{
+  state_header header;
+  fill_header(chester, &header);
+
+  return header.size;
+}
+
+size_t chester_save_state(chester *chester, void *buffer, const size_t size)
+{
+  state_header header;
+  fill_header(chester, &header);
+
+  if (size < header.size)
+    {
+      return 0;
+    }
+
+  // Pointers and padding are cleared, so that the same state saves the
+  // same bytes
+  state_machine machine;
+  memset(&machine, 0, sizeof machine);
+  machine.cycles = chester->cycles;
+  machine.keys_cumulative_ticks = chester->keys_cumulative_ticks;
+  machine.keys_ticks = chester->keys_ticks;
+  machine.overshoot = chester->overshoot;
+
+  // Flags are saved as pending, they are brought up to date the same way
+  // after loading
+  uint8_t *p = buffer;
+  memcpy(p, &header, sizeof header); p += sizeof header;
+  memcpy(p, &chester->cpu_reg, header.registers_size); p += header.registers_size;
+  mmu_get_state(&chester->mem, p); p += header.memory_size;
+  mmu_get_ram(&chester->mem, p, p + header.internal_ram_size);
+  p += header.internal_ram_size + header.cart_ram_size;
+  memcpy(p, &chester->g.clock, header.gpu_size); p += header.gpu_size;
+  memcpy(p, &chester->k, header.keys_size); p += header.keys_size;
+  memcpy(p, &chester->sched, header.scheduler_size); p += header.scheduler_size;
+  memcpy(p, &machine, header.machine_size);
+
+  return header.size;
+}
+
+bool chester_load_state(chester *chester, const void *buffer, const size_t size)
+{
+  state_header expected, header;
+  fill_header(chester, &expected);
+
+  if (size < sizeof header)
+    {
+      gb_log (ERROR, "Saved state is truncated");
+      return false;
+    }
+
+  memcpy(&header, buffer, sizeof header);
+
+  if (memcmp(&header, &expected, sizeof header) || size < header.size)
+    {
+      gb_log (ERROR, "Saved state is not for this build and ROM");
+      return false;
+    }
+
+  const uint8_t *p = (const uint8_t*)buffer + sizeof header;
+  const uint8_t *mem_state = p + header.registers_size;
+
+  bool bootloader_running;
+  memcpy(&bootloader_running,
+         mem_state + offsetof(memory, bootloader_running),
+         sizeof bootloader_running);
+
+  if (bootloader_running && !chester->bootloader)
+    {
+      gb_log (ERROR, "Saved state needs the bootloader which is gone");
+      return false;
+    }
+
+  // RAM is replaced first, as it's the only part which may fail
+  const uint8_t *ram_state = mem_state + header.memory_size;
+
+  if (!mmu_set_ram(&chester->mem, ram_state, ram_state + header.internal_ram_size))
+    {
+      return false;
+    }
+
+  // Pointers in memory belong to this instance
+  memory *mem = &chester->mem;
+  uint8_t *rom = mem->rom.data;
+  keys *k = mem->k;
+
+  memcpy(&chester->cpu_reg, p, header.registers_size); p += header.registers_size;
+  memcpy(mem, p, header.memory_size); p += header.memory_size;
+  p += header.internal_ram_size + header.cart_ram_size;
+  memcpy(&chester->g.clock, p, header.gpu_size); p += header.gpu_size;
+  memcpy(&chester->k, p, header.keys_size); p += header.keys_size;
+  memcpy(&chester->sched, p, header.scheduler_size); p += header.scheduler_size;
+
+  state_machine machine;
+  memcpy(&machine, p, header.machine_size);
+
+  chester->cycles = machine.cycles;
+  chester->keys_cumulative_ticks = machine.keys_cumulative_ticks;
+  chester->keys_ticks = machine.keys_ticks;
+  chester->overshoot = machine.overshoot;
+
+  mem->rom.data = rom;
+  mem->k = k;
+
+  // Once it has finished the bootloader isn't needed any more, and run()
+  // must not reset the CPU as it would when seeing it finished
+  if (bootloader_running)
+    {
+      mem->bootloader = chester->bootloader;
+    }
+  else
+    {
+      mem->bootloader = NULL;
+
+      if (chester->bootloader)
+        {
+          free(chester->bootloader);
+          chester->bootloader = NULL;
+        }
+    }
+
+  // Code is decoded anew for the memory just loaded
+  mmu_restore(mem);
+  block_cache_reset(chester->blocks);
+
+  chester->batch_synced = false;
+  chester->frame_rendered = false;
+  chester->idle_loop.valid = false;
+
+  return true;
+}
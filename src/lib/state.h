@@ -0,0 +1,59 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "chester.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATE_MAGIC 0x54534843 // "CHST"
+#define STATE_VERSION 5
+
+// Saved states hold the machine structures as they are laid out in
+// memory, so they are only loaded by a build with the same layout and
+// for the same ROM, which the header is checked for
+struct state_header_s {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+
+  // Global checksum from the ROM header
+  uint16_t rom_checksum;
+
+  // Sizes of the sections which follow, in this order
+  uint16_t registers_size;
+  uint32_t memory_size;
+  uint32_t internal_ram_size;
+  uint32_t cart_ram_size;
+  uint16_t gpu_size;
+  uint16_t keys_size;
+  uint16_t scheduler_size;
+  uint16_t machine_size;
+};
+
+typedef struct state_header_s state_header;
+
+// State of the instance itself, besides the machine structures
+struct state_machine_s {
+  uint64_t cycles;
+  int keys_cumulative_ticks;
+  int keys_ticks;
+  unsigned int overshoot;
+};
+
+typedef struct state_machine_s state_machine;
+
+// Bytes needed to save the state of the instance
+size_t chester_state_size(chester *chester);
+
+// Saves the state of the instance to the buffer. Returns the bytes
+// written, 0 if the buffer is too small.
+size_t chester_save_state(chester *chester, void *buffer, const size_t size);
+
+// Replaces the state of the instance with one saved by
+// chester_save_state(). Returns false, leaving the instance as it was,
+// if the state is not for this build and ROM.
+bool chester_load_state(chester *chester, const void *buffer, const size_t size);
+
+#endif // STATE_H
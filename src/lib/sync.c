@@ -2,24 +2,26 @@
 
 #include "logger.h"
 
-void sync_init(sync_timer *s, unsigned int ticks, get_ticks_cb cb)
+void sync_init(sync_timer *s, unsigned int ticks, get_ticks_cb cb, void *context)
 {
   s->timing_cumulative_ticks = 0;
   s->timing_ticks = ticks;
 #ifndef NDEBUG
   s->timing_debug_ticks = 0;
 #endif
-  s->framestarttime = cb();
+  s->framestarttime = cb(context);
   s->waittime = (unsigned int)(1000.0f * s->timing_ticks / 4194304);
 }
 
-void sync_time(sync_timer *s, const unsigned int ticks, get_ticks_cb t_cb, delay_cb d_cb)
+void sync_time(sync_timer *s, const unsigned int ticks,
+               get_ticks_cb t_cb, void *t_context,
+               delay_cb d_cb, void *d_context)
 {
   if (s->timing_cumulative_ticks > s->timing_ticks)
     {
-      int32_t delaytime = s->waittime - (t_cb() - s->framestarttime);
+      int32_t delaytime = s->waittime - (t_cb(t_context) - s->framestarttime);
       if(delaytime > 0)
-        d_cb((uint32_t)delaytime);
+        d_cb(d_context, (uint32_t)delaytime);
 
 #ifndef NDEBUG
       if (++(s->timing_debug_ticks) > 10)
@@ -36,7 +38,7 @@ void sync_time(sync_timer *s, const unsigned int ticks, get_ticks_cb t_cb, delay
           s->timing_debug_ticks = 0;
         }
 #endif
-      s->framestarttime = t_cb();
+      s->framestarttime = t_cb(t_context);
 
       s->timing_cumulative_ticks = 0;
     }
@@ -45,3 +47,11 @@ void sync_time(sync_timer *s, const unsigned int ticks, get_ticks_cb t_cb, delay
       s->timing_cumulative_ticks += ticks;
     }
 }
+
+unsigned int sync_cycles_to_event(sync_timer *s)
+{
+  if (s->timing_cumulative_ticks > s->timing_ticks)
+    return 1;
+
+  return (unsigned int)(s->timing_ticks - s->timing_cumulative_ticks) + 1;
+}
@@ -3,8 +3,8 @@
 
 #include <stdint.h>
 
-typedef uint32_t (*get_ticks_cb)(void);
-typedef void (*delay_cb)(uint32_t);
+typedef uint32_t (*get_ticks_cb)(void *context);
+typedef void (*delay_cb)(void *context, uint32_t);
 
 typedef struct sync_timer_s
 {
@@ -17,8 +17,13 @@ typedef struct sync_timer_s
 #endif
 } sync_timer;
 
-void sync_init(sync_timer *s, unsigned int ticks, get_ticks_cb cb);
+void sync_init(sync_timer *s, unsigned int ticks, get_ticks_cb cb, void *context);
 
-void sync_time(sync_timer *s, const unsigned int ticks, get_ticks_cb t_cb, delay_cb d_cb);
+// Number of CPU cycles before the next call to sync_time() synchronizes
+unsigned int sync_cycles_to_event(sync_timer *s);
+
+void sync_time(sync_timer *s, const unsigned int ticks,
+               get_ticks_cb t_cb, void *t_context,
+               delay_cb d_cb, void *d_context);
 
 #endif // SYNC_H
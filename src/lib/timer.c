@@ -3,81 +3,95 @@
 #include "interrupts.h"
 #include "logger.h"
 
+#include <limits.h>
+
+// Timer cycles per TIMA increment, indexed by the clock select of TAC
+static const unsigned int tima_periods[] = {1024, 16, 64, 256};
+
 static inline uint8_t read_timer_register(memory *mem, uint16_t address)
 {
   // Faster than mmu_read_byte
   return mem->io_registers[address & 0x00FF];
 }
 
-void timer_update(registers *reg, memory *mem)
+static inline unsigned int to_cpu_cycles(registers *reg, const unsigned int cycles)
 {
-  // DIV timer
-  {
-    const unsigned int div = 256;
-
-    // Reset the subcounter if timer was cleared
-    if (mem->div_modified)
-      {
-        mem->div_modified = false;
-        reg->timer.t_timer = 0;
-        reg->timer.tick = 0;
-      }
+  // Timer counts single speed cycles, CPU ones are halved in double speed
+  return (cycles + (1u << reg->speed_shifter) - 1) >> reg->speed_shifter;
+}
+
+static inline unsigned int to_timer_cycles(registers *reg, const unsigned int cycles)
+{
+  return cycles << reg->speed_shifter;
+}
+
+unsigned int timer_cycles_to_event(registers *reg, memory *mem)
+{
+  // A pending DIV reset is handled by the next update
+  if (mem->div_modified)
+    return 1;
+
+  const uint8_t tac = read_timer_register(mem, MEM_TAC_ADDR);
 
-    reg->timer.t_timer += reg->clock.last.t
-#ifdef CGB
-      << reg->speed_shifter
-#endif
-      ;
+  // DIV and TIMA are counted up when read, only an overflow is an event
+  if (!(tac & MEM_TAC_START))
+    return UINT_MAX;
 
-    if (reg->timer.t_timer >= div)
-      {
-        reg->timer.t_timer -= div;
+  const unsigned int period = tima_periods[tac & 0x03];
+  const unsigned int tick = period != reg->timer.div ? 0 : reg->timer.tick;
+  const unsigned int increments = 256 - read_timer_register(mem, MEM_TIMA_ADDR);
 
-        ++(mem->io_registers[MEM_DIV_ADDR & 0x00FF]);
-      }
-  }
+  return to_cpu_cycles(reg, increments * period - tick);
+}
+
+void timer_update(registers *reg, memory *mem, const unsigned int cycles)
+{
+  const unsigned int timer_cycles = to_timer_cycles(reg, cycles);
+
+  // Reset the subcounters if timer was cleared
+  if (mem->div_modified)
+    {
+      mem->div_modified = false;
+      reg->timer.t_timer = 0;
+      reg->timer.tick = 0;
+    }
+
+  // DIV timer
+  reg->timer.t_timer += timer_cycles;
+  mem->io_registers[MEM_DIV_ADDR & 0x00FF] += (uint8_t)(reg->timer.t_timer / 256);
+  reg->timer.t_timer %= 256;
 
   const uint8_t tac = read_timer_register(mem, MEM_TAC_ADDR);
 
   if (tac & MEM_TAC_START)
     {
-      gb_log (VERBOSE, "Timer running");
-
-      static const unsigned int divs[] = {256, 4, 16, 64};
-      const unsigned int div = divs[tac & 0x03];
+      const unsigned int period = tima_periods[tac & 0x03];
 
-      if (div != reg->timer.div)
+      if (period != reg->timer.div)
         reg->timer.tick = 0;
 
-      reg->timer.tick += (reg->clock.last.t
-#ifdef CGB
-        << reg->speed_shifter
-#endif
-        ) / 4;
+      reg->timer.tick += timer_cycles;
 
-      while (reg->timer.tick >= div)
-        {
-          reg->timer.tick -= div;
+      unsigned int increments = reg->timer.tick / period;
+      reg->timer.tick %= period;
 
-          const uint8_t t = read_timer_register(mem, MEM_TIMA_ADDR) + 1;
+      uint8_t tima = read_timer_register(mem, MEM_TIMA_ADDR);
 
-          gb_log (VERBOSE, "Timer step (%02X)", t);
+      // The update at an overflow can come the rest of an instruction
+      // late, which may be enough to overflow again from TMA
+      while (increments >= 256u - tima)
+        {
+          increments -= 256u - tima;
 
-          if (!t)
-            {
-              gb_log (DEBUG, "Timer overflow");
+          gb_log (DEBUG, "Timer overflow");
 
-              isr_set_if_flag(mem, MEM_IF_TIMER_OVF_FLAG);
+          isr_set_if_flag(mem, MEM_IF_TIMER_OVF_FLAG);
 
-              mem->io_registers[MEM_TIMA_ADDR & 0x00FF] =
-                read_timer_register(mem, MEM_TMA_ADDR);
-            }
-          else
-            {
-              mem->io_registers[MEM_TIMA_ADDR & 0x00FF] = t;
-            }
+          tima = read_timer_register(mem, MEM_TMA_ADDR);
         }
 
-      reg->timer.div = div;
+      mem->io_registers[MEM_TIMA_ADDR & 0x00FF] = tima + (uint8_t)increments;
+
+      reg->timer.div = period;
     }
 }
@@ -4,6 +4,11 @@
 #include "cpu.h"
 #include "memory.h"
 
-void timer_update(registers *reg, memory *mem);
+// Number of CPU cycles before TIMA overflows, UINT_MAX while stopped.
+// DIV and TIMA are only brought up to date by timer_update(), which has
+// to be called before they are read.
+unsigned int timer_cycles_to_event(registers *reg, memory *mem);
+
+void timer_update(registers *reg, memory *mem, const unsigned int cycles);
 
 #endif // TIMER_H
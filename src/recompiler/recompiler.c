@@ -0,0 +1,503 @@
+// Translates the code of ROMs to C ahead of time. Code is recovered by
+// following every branch from the entry point and the interrupt vectors,
+// each run of contiguous instructions becomes a function which calls the
+// same primitives as the interpreter.
+//
+//   chester-recompile OUTPUT ROM...
+
+#include "aot.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BANK_SIZE 0x4000
+
+// Longer runs are split, compilers struggle with huge functions
+#define MAX_FUNCTION_LENGTH 64
+
+struct instruction_s {
+  const char *mnemonic;
+  const char *body;
+  operand_kind operand;
+  uint8_t cycles;
+};
+
+typedef struct instruction_s instruction;
+
+#define OPCODE(code, mnemonic, kind, cycles, effects, body) \
+  [code] = { mnemonic, #body, OPERAND_##kind, cycles },
+#define CB_OPCODE(code, mnemonic, cycles, effects, body)
+static const instruction instructions[256] = {
+#include "cpu_opcodes.h"
+};
+#undef CB_OPCODE
+#undef OPCODE
+
+#define OPCODE(code, mnemonic, kind, cycles, effects, body)
+#define CB_OPCODE(code, mnemonic, cycles, effects, body) \
+  [code] = { mnemonic, #body, OPERAND_NONE, cycles },
+static const instruction cb_instructions[256] = {
+#include "cpu_opcodes.h"
+};
+#undef CB_OPCODE
+#undef OPCODE
+
+struct location_s {
+  uint16_t bank;
+  uint16_t pc;
+};
+
+typedef struct location_s location;
+
+// Instruction and the function running it
+struct entry_s {
+  location at;
+  uint16_t function;
+};
+
+typedef struct entry_s entry;
+
+struct rom_s {
+  uint8_t *data;
+  uint32_t size;
+  unsigned int banks;
+
+  // Length of the instruction starting at each byte of each bank, or 0
+  uint8_t *lengths;
+  bool *emitted;
+
+  // Addresses left to explore
+  location *pending;
+  unsigned int pending_count, pending_size;
+};
+
+typedef struct rom_s rom;
+
+static inline unsigned int rom_index(const location l)
+{
+  return l.bank * BANK_SIZE + (l.pc & (BANK_SIZE - 1));
+}
+
+static inline uint8_t rom_byte(const rom *r, const location l, const uint16_t offset)
+{
+  return r->data[rom_index(l) + offset];
+}
+
+static bool push(rom *r, const uint16_t bank, const uint16_t pc)
+{
+  if (r->pending_count == r->pending_size)
+    {
+      r->pending_size = r->pending_size ? r->pending_size * 2 : 256;
+      location *pending = realloc(r->pending, r->pending_size * sizeof(location));
+
+      if (!pending)
+        return false;
+
+      r->pending = pending;
+    }
+
+  r->pending[r->pending_count].bank = bank;
+  r->pending[r->pending_count].pc = pc;
+  ++r->pending_count;
+
+  return true;
+}
+
+// Queues a branch target. Targets in the switchable bank are only known
+// from code in that bank, or after a bank was selected just before.
+static bool push_target(rom *r, const location from, const int selected, const uint16_t target)
+{
+  if (target < BANK_SIZE)
+    return push(r, 0, target);
+
+  if (target >= 2 * BANK_SIZE)
+    return true;
+
+  if (from.bank)
+    return push(r, from.bank, target);
+
+  if (r->banks == 2)
+    return push(r, 1, target);
+
+  if (selected >= 0)
+    return push(r, (uint16_t)selected, target);
+
+  return true;
+}
+
+static bool explore(rom *r, location l)
+{
+  const uint16_t limit = l.bank ? 2 * BANK_SIZE : BANK_SIZE;
+  int known_a = -1, selected = -1;
+
+  while (l.pc < limit && !r->lengths[rom_index(l)])
+    {
+      const uint8_t code = rom_byte(r, l, 0);
+      const instruction *ins = &instructions[code];
+      uint8_t length = 1;
+      uint16_t operand = 0;
+
+      if (!strcmp(ins->mnemonic, "-"))
+        break;
+
+      switch (ins->operand)
+        {
+        case OPERAND_D8:
+        case OPERAND_S8:
+          length = 2;
+          break;
+        case OPERAND_D16:
+          length = 3;
+          break;
+        default:
+          break;
+        }
+
+      if (l.pc + length > limit)
+        break;
+
+      if (length == 2)
+        operand = rom_byte(r, l, 1);
+      else if (length == 3)
+        operand = rom_byte(r, l, 1) | rom_byte(r, l, 2) << 8;
+
+      r->lengths[rom_index(l)] = length;
+
+      const uint16_t next = l.pc + length;
+      const uint16_t relative = (uint16_t)(next + (int8_t)operand);
+      bool ends = false;
+      bool queued = true;
+
+      switch (code)
+        {
+        case 0x18: // JR e
+          queued = push_target(r, l, selected, relative);
+          ends = true;
+          break;
+        case 0x20: // JR cc, e
+        case 0x28:
+        case 0x30:
+        case 0x38:
+          queued = push_target(r, l, selected, relative);
+          break;
+        case 0xC3: // JP nn
+          queued = push_target(r, l, selected, operand);
+          ends = true;
+          break;
+        case 0xC2: // JP cc, nn
+        case 0xCA:
+        case 0xD2:
+        case 0xDA:
+        case 0xC4: // CALL cc, nn
+        case 0xCC:
+        case 0xD4:
+        case 0xDC:
+        case 0xCD: // CALL nn
+          queued = push_target(r, l, selected, operand);
+          break;
+        case 0xC7: // RST n
+        case 0xCF:
+        case 0xD7:
+        case 0xDF:
+        case 0xE7:
+        case 0xEF:
+        case 0xF7:
+        case 0xFF:
+          queued = push(r, 0, code & 0x38);
+          break;
+        case 0xC9: // RET
+        case 0xD9: // RETI
+        case 0xE9: // JP (HL)
+          ends = true;
+          break;
+        default:
+          break;
+        }
+
+      if (!queued)
+        return false;
+
+      // Follow LD A, n then LD (nn), A selecting a ROM bank
+      if (code == 0x3E)
+        {
+          known_a = operand;
+        }
+      else if (code == 0xEA && operand >= 0x2000 && operand < 0x4000)
+        {
+          if (known_a >= 0)
+            selected = (known_a % r->banks) ? (int)(known_a % r->banks) : 1;
+        }
+      else if (code != 0xEA)
+        {
+          known_a = -1;
+        }
+
+      if (ends)
+        break;
+
+      l.pc = next;
+    }
+
+  return true;
+}
+
+static const char *operand_declaration(const operand_kind kind)
+{
+  switch (kind)
+    {
+    case OPERAND_D8:
+      return "const uint8_t n = 0x%02X; ";
+    case OPERAND_S8:
+      return "const int8_t n = (int8_t)0x%02X; ";
+    case OPERAND_D16:
+      return "const uint16_t nn = 0x%04X; ";
+    default:
+      return "";
+    }
+}
+
+static void emit_instruction(FILE *out, const rom *r, const location l)
+{
+  const uint8_t code = rom_byte(r, l, 0);
+  const uint8_t length = r->lengths[rom_index(l)];
+  const uint16_t next = l.pc + length;
+  const instruction *ins = &instructions[code];
+  uint16_t operand = 0;
+
+  if (length == 2)
+    operand = rom_byte(r, l, 1);
+  else if (length == 3)
+    operand = rom_byte(r, l, 1) | rom_byte(r, l, 2) << 8;
+
+  fprintf(out, "    case 0x%04X: // %s\n", l.pc, ins->mnemonic);
+  fprintf(out, "      batch->pc = 0x%04X;\n", l.pc);
+  fprintf(out, "      reg->pc = 0x%04X;\n", next);
+
+  uint8_t cycles = ins->cycles;
+
+  if (code == 0xCB)
+    {
+      // Same as cb_command()
+      ins = &cb_instructions[operand];
+      cycles = ins->cycles;
+
+      fprintf(out, "      { %s; }\n", ins->body);
+    }
+  else
+    {
+      fprintf(out, "      { ");
+      fprintf(out, operand_declaration(ins->operand), operand);
+      fprintf(out, "%s; }\n", ins->body);
+    }
+
+  fprintf(out, "      if (aot_end(reg, mem, batch, %u, 0x%04X))\n", cycles, next);
+  fprintf(out, "        return 0;\n");
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const entry *x = a, *y = b;
+  const uint32_t x_key = (uint32_t)x->at.bank << 16 | x->at.pc;
+  const uint32_t y_key = (uint32_t)y->at.bank << 16 | y->at.pc;
+
+  return x_key < y_key ? -1 : x_key > y_key;
+}
+
+// Emits a function for each run of contiguous instructions, then the
+// entries of all instructions sorted for the lookup
+static bool emit_program(FILE *out, rom *r, const unsigned int index, const char *path)
+{
+  entry *entries = NULL;
+  unsigned int count = 0, size = 0, runs = 0;
+
+  for (uint16_t bank = 0; bank < r->banks; ++bank)
+    {
+      const uint32_t base = bank ? BANK_SIZE : 0;
+
+      for (uint32_t pc = base; pc < base + BANK_SIZE; ++pc)
+        {
+          location l = { bank, (uint16_t)pc };
+
+          if (!r->lengths[rom_index(l)] || r->emitted[rom_index(l)])
+            continue;
+
+          fprintf(out, "static int run_%u_%u_%04X(registers *reg, memory *mem, block_batch *batch)\n", index, bank, l.pc);
+          fprintf(out, "{\n  switch (reg->pc)\n    {\n");
+
+          for (unsigned int length = 0; length < MAX_FUNCTION_LENGTH && l.pc < base + BANK_SIZE &&
+                 r->lengths[rom_index(l)] && !r->emitted[rom_index(l)]; ++length)
+            {
+              if (count == size)
+                {
+                  size = size ? size * 2 : 1024;
+                  entry *e = realloc(entries, size * sizeof(entry));
+
+                  if (!e)
+                    {
+                      free(entries);
+                      return false;
+                    }
+
+                  entries = e;
+                }
+
+              entries[count].at = l;
+              entries[count].function = (uint16_t)pc;
+              ++count;
+
+              r->emitted[rom_index(l)] = true;
+              emit_instruction(out, r, l);
+
+              l.pc += r->lengths[rom_index(l)];
+            }
+
+          fprintf(out, "    }\n\n  return 0;\n}\n\n");
+          ++runs;
+        }
+    }
+
+  if (count)
+    qsort(entries, count, sizeof(entry), compare_entries);
+
+  fprintf(out, "static const aot_entry entries_%u[] = {\n", index);
+
+  for (unsigned int i = 0; i < count; ++i)
+    {
+      fprintf(out, "  { %u, 0x%04X, run_%u_%u_%04X },\n", entries[i].at.bank, entries[i].at.pc,
+              index, entries[i].at.bank, entries[i].function);
+    }
+
+  if (!count)
+    fprintf(out, "  { 0, 0, NULL },\n");
+
+  fprintf(out, "};\n\n");
+  fprintf(out, "static const aot_program program_%u = { 0x%08X, %u, entries_%u, %u };\n\n",
+          index, aot_rom_hash(r->data, r->size), r->size, index, count);
+
+  printf("%s: %u instructions in %u functions\n", path, count, runs);
+
+  free(entries);
+
+  return true;
+}
+
+static bool load(rom *r, const char *path)
+{
+  FILE *f = fopen(path, "rb");
+
+  memset(r, 0, sizeof(rom));
+
+  if (!f)
+    {
+      fprintf(stderr, "Could not open %s\n", path);
+      return false;
+    }
+
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  if (size < 2 * BANK_SIZE || size % BANK_SIZE)
+    {
+      fprintf(stderr, "%s is not a ROM\n", path);
+      fclose(f);
+      return false;
+    }
+
+  r->size = (uint32_t)size;
+  r->banks = r->size / BANK_SIZE;
+  r->data = malloc(r->size);
+  r->lengths = calloc(r->size, 1);
+  r->emitted = calloc(r->size, sizeof(bool));
+
+  const bool ok = r->data && r->lengths && r->emitted &&
+    fread(r->data, 1, r->size, f) == r->size;
+
+  fclose(f);
+
+  if (!ok)
+    fprintf(stderr, "Could not read %s\n", path);
+
+  return ok;
+}
+
+static void unload(rom *r)
+{
+  free(r->data);
+  free(r->lengths);
+  free(r->emitted);
+  free(r->pending);
+}
+
+int main(int argc, char **argv)
+{
+  static const uint16_t entry_points[] = { 0x0100, 0x0040, 0x0048, 0x0050, 0x0058, 0x0060 };
+
+  if (argc < 3)
+    {
+      fprintf(stderr, "Usage: %s OUTPUT ROM...\n", argv[0]);
+      return 1;
+    }
+
+  FILE *out = fopen(argv[1], "w");
+
+  if (!out)
+    {
+      fprintf(stderr, "Could not create %s\n", argv[1]);
+      return 1;
+    }
+
+  fprintf(out, "// Generated by chester-recompile, do not edit\n\n");
+  fprintf(out, "#include \"aot.h\"\n#include \"cpu_inline.h\"\n\n#include <stddef.h>\n\n");
+
+  int ret = 0;
+
+  for (int i = 2; i < argc && !ret; ++i)
+    {
+      rom r;
+
+      if (!load(&r, argv[i]))
+        {
+          ret = 1;
+        }
+      else
+        {
+          for (unsigned int e = 0; e < sizeof(entry_points) / sizeof(entry_points[0]) && !ret; ++e)
+            {
+              if (!push(&r, 0, entry_points[e]))
+                ret = 1;
+            }
+
+          while (r.pending_count && !ret)
+            {
+              if (!explore(&r, r.pending[--r.pending_count]))
+                ret = 1;
+            }
+
+          if (!ret && !emit_program(out, &r, (unsigned int)(i - 2), argv[i]))
+            ret = 1;
+        }
+
+      unload(&r);
+    }
+
+  if (!ret)
+    {
+      fprintf(out, "const aot_program *const aot_programs[] = {\n");
+
+      for (int i = 2; i < argc; ++i)
+        fprintf(out, "  &program_%d,\n", i - 2);
+
+      fprintf(out, "  NULL\n};\n");
+    }
+
+  fclose(out);
+
+  if (ret)
+    remove(argv[1]);
+
+  return ret;
+}
@@ -0,0 +1,11 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Checkpoint, cpu_instrs) {
+  runTestFromCheckpoint(BLARGG, "cpu_instrs/cpu_instrs.gb", 40, 3);
+}
+
+TEST(Checkpoint, instr_timing) {
+  runTestFromCheckpoint(BLARGG, "instr_timing/instr_timing.gb", 1, 3);
+}
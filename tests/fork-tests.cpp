@@ -0,0 +1,11 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Fork, cpu_instrs) {
+  runTestFromFork(BLARGG, "cpu_instrs/cpu_instrs.gb", 40);
+}
+
+TEST(Fork, instr_timing) {
+  runTestFromFork(BLARGG, "instr_timing/instr_timing.gb", 1);
+}
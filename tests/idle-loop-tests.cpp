@@ -0,0 +1,39 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(IdleLoop, self_loop) {
+  runTestIdleLoop("self-loop.gb", {
+    0xF3,             // DI
+    0x18, 0xFE        // JR -2
+  }, true);
+}
+
+TEST(IdleLoop, ly_polling) {
+  runTestIdleLoop("ly-polling.gb", {
+    0xF3,             // DI
+    0x3E, 0x05,       // LD A, 0x05
+    0xE0, 0x07,       // LDH (TAC), A: timer running
+    0xF0, 0x44,       // LDH A, (LY)
+    0xFE, 0x90,       // CP 0x90
+    0x20, 0xFA,       // JR NZ, -6
+    0xF0, 0x44,       // LDH A, (LY)
+    0xFE, 0x90,       // CP 0x90
+    0x28, 0xFA,       // JR Z, -6
+    0x18, 0xF2        // JR -14
+  }, true);
+}
+
+TEST(IdleLoop, div_polling) {
+  // DIV changes without an event, this loop cannot be skipped
+  runTestIdleLoop("div-polling.gb", {
+    0xF3,             // DI
+    0xF0, 0x04,       // LDH A, (DIV)
+    0xFE, 0x80,       // CP 0x80
+    0x20, 0xFA,       // JR NZ, -6
+    0xF0, 0x04,       // LDH A, (DIV)
+    0xFE, 0x80,       // CP 0x80
+    0x28, 0xFA,       // JR Z, -6
+    0x18, 0xF2        // JR -14
+  }, false);
+}
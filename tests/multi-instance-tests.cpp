@@ -0,0 +1,52 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(MultiInstance, cpu_instrs) {
+  runTestOnThreads(BLARGG, "cpu_instrs/cpu_instrs.gb", 8);
+}
+
+TEST(MultiInstance, instr_timing) {
+  runTestOnThreads(BLARGG, "instr_timing/instr_timing.gb", 16);
+}
+
+TEST(MultiInstance, mbc1_rom_4Mb) {
+  runTestOnThreads(GEKKIO, "emulator-only/mbc1/rom_4Mb.gb", 8);
+}
+
+extern "C" {
+#include "batch.h"
+}
+
+#include <cstring>
+#include <string>
+
+#ifdef BATCH_ENABLED
+TEST(Batch, cpu_instrs) {
+  const unsigned int size = 16;
+  const std::string rom(std::string(BLARGGS_ROMS_DIR) + "/cpu_instrs/cpu_instrs.gb");
+
+  chester_batch* batch = chester_batch_create(rom.c_str(), size, 0);
+  ASSERT_NE(nullptr, batch);
+  ASSERT_EQ(size, chester_batch_size(batch));
+
+  // Instances run the same code with the same inputs, so they have to
+  // end up in the same state however they got spread over the workers
+  for (int step = 0; step < 60; ++step) {
+    ASSERT_EQ(0, chester_batch_step(batch, NULL, 60));
+
+    const uint8_t* frames = chester_batch_frames(batch);
+    const uint8_t* ram = chester_batch_ram(batch);
+
+    for (unsigned int i = 1; i < size; ++i) {
+      EXPECT_EQ(0, memcmp(frames, frames + i * BATCH_FRAME_SIZE, BATCH_FRAME_SIZE)) << "instance " << i;
+      EXPECT_EQ(0, memcmp(ram, ram + i * BATCH_RAM_SIZE, BATCH_RAM_SIZE)) << "instance " << i;
+    }
+  }
+
+  EXPECT_EQ(60u, chester_batch_get_latency(batch).batches);
+  EXPECT_GE(chester_batch_instance(batch, 0)->cycles, (60ull * 60 - 1) * FRAME_CYCLES);
+
+  chester_batch_destroy(batch);
+}
+#endif
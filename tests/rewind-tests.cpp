@@ -0,0 +1,11 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Rewind, cpu_instrs) {
+  runTestWithRewind(BLARGG, "cpu_instrs/cpu_instrs.gb", 600);
+}
+
+TEST(Rewind, instr_timing) {
+  runTestWithRewind(BLARGG, "instr_timing/instr_timing.gb", 30);
+}
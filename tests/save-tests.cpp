@@ -0,0 +1,20 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Save, no_ram) {
+  runTestWritingCartRam(0x00, std::vector<uint8_t>(8, 0xFF), 0);
+}
+
+TEST(Save, ram_8k) {
+  // Bank selects are masked away, each bank being the same 8 KiB
+  runTestWritingCartRam(0x02, { 0x13, 0x23, 0x13, 0x23, 0x13, 0x23, 0x13, 0x23 }, 8192);
+}
+
+TEST(Save, ram_32k) {
+  runTestWritingCartRam(0x03, { 0x10, 0x20, 0x11, 0x21, 0x12, 0x22, 0x13, 0x23 }, 32768);
+}
+
+TEST(Save, old_128k_save) {
+  runTestLoadingSave(0x03, 128 * 1024);
+}
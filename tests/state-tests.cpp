@@ -0,0 +1,15 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(State, cpu_instrs) {
+  runTestFromSavedState(BLARGG, "cpu_instrs/cpu_instrs.gb", 40);
+}
+
+TEST(State, instr_timing) {
+  runTestFromSavedState(BLARGG, "instr_timing/instr_timing.gb", 1);
+}
+
+TEST(State, same_bytes) {
+  runTestSavingTwoInstances(BLARGG, "cpu_instrs/cpu_instrs.gb", 40);
+}
@@ -0,0 +1,11 @@
+#include "test-runner.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Stepping, cpu_instrs_in_chunks) {
+  runTestInChunks(BLARGG, "cpu_instrs/cpu_instrs.gb", 40);
+}
+
+TEST(Stepping, cpu_instrs_by_frames) {
+  runTestByFrames(BLARGG, "cpu_instrs/cpu_instrs.gb", 600);
+}
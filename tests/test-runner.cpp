@@ -3,17 +3,23 @@
 #include "gtest/gtest.h"
 
 extern "C" {
+#include "checkpoint.h"
 #include "chester.h"
+#include "rewind.h"
+#include "state.h"
 }
 
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
 #include <string>
+#include <thread>
+#include <vector>
 
-static std::string* outputPtr = nullptr;
-
-// Can't get function pointer with capture from lambda, so have
-// to use static function
-static void serialListener(uint8_t b) {
-  *outputPtr += b;
+// Serial output is collected to the string given as callback context
+static void serialListener(void* context, uint8_t b) {
+  *static_cast<std::string*>(context) += b;
 }
 
 enum Result {
@@ -44,35 +50,490 @@ std::function<Result()> getValidator(RomType romType, const std::string& testOut
   }
 }
 
+static void registerCallbacks(chester& chester, std::string& serialOutput) {
+  register_keys_callback(&chester, [](void*, keys*) { return 0; }, NULL);
+  register_get_ticks_callback(&chester, [](void*) { return static_cast<uint32_t>(0); }, NULL);
+  register_delay_callback(&chester, [](void*, uint32_t) {}, NULL);
+  register_gpu_init_callback(&chester, [](void*, gpu*) { return true; }, NULL);
+  register_gpu_uninit_callback(&chester, [](void*, gpu*) {}, NULL);
+  register_gpu_render_callback(&chester, [](void*, gpu*) {}, NULL);
+  register_gpu_alloc_image_buffer_callback(&chester, NULL, NULL);
+  register_serial_callback(&chester, serialListener, &serialOutput);
+}
+
+static bool initRom(chester& chester, RomType romType, const char* romPath, std::string& serialOutput) {
+  registerCallbacks(chester, serialOutput);
+
+  const std::string romRoot(romType == BLARGG ?
+    BLARGGS_ROMS_DIR : GEKKIOS_ROMS_DIR);
+  return init(&chester, (romRoot + '/' + romPath).c_str(), NULL, NULL);
+}
+
+static Result runUntilDone(chester& chester, const std::function<Result()>& validator, int runs) {
+  Result result = UNINITIALIZED;
+  do {
+    run(&chester);
+    result = validator();
+  } while(--runs && result == ONGOING);
+
+  return result;
+}
+
+// Doesn't use gtest assertions so that it can be run on any thread
+static Result runRom(RomType romType, const char* romPath, std::string& serialOutput) {
+  chester chester;
+
+  if (!initRom(chester, romType, romPath, serialOutput)) {
+    return UNINITIALIZED;
+  }
+
+  const auto validator = getValidator(romType, serialOutput);
+  if (!validator) {
+    uninit(&chester);
+    return UNINITIALIZED;
+  }
+
+  const Result result = runUntilDone(chester, validator, 4 * 60);
+
+  uninit(&chester);
+
+  return result;
+}
+
 void runTest(RomType romType, const char* romPath) {
+  std::string serialOutput;
+
+  EXPECT_EQ(PASSED, runRom(romType, romPath, serialOutput));
+}
+
+void runTestOnThreads(RomType romType, const char* romPath, unsigned int threadCount) {
+  std::string expectedOutput;
+  ASSERT_EQ(PASSED, runRom(romType, romPath, expectedOutput));
+
+  std::vector<Result> results(threadCount, UNINITIALIZED);
+  std::vector<std::string> outputs(threadCount);
+  std::vector<std::thread> threads;
+
+  for (unsigned int i = 0; i < threadCount; ++i) {
+    threads.emplace_back([&, i]() {
+      results[i] = runRom(romType, romPath, outputs[i]);
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // Each instance has to behave exactly like the one run alone
+  for (unsigned int i = 0; i < threadCount; ++i) {
+    EXPECT_EQ(PASSED, results[i]) << "instance " << i;
+    EXPECT_EQ(expectedOutput, outputs[i]) << "instance " << i;
+  }
+}
+
+void runTestFromSavedState(RomType romType, const char* romPath, int runsBeforeSaving) {
+  chester chester;
+  std::string serialOutput;
+  ASSERT_TRUE(initRom(chester, romType, romPath, serialOutput));
+
+  const auto validator = getValidator(romType, serialOutput);
+  ASSERT_TRUE(validator);
+
+  for (int i = 0; i < runsBeforeSaving; ++i) {
+    run(&chester);
+  }
+  ASSERT_EQ(ONGOING, validator());
+
+  std::vector<uint8_t> state(chester_state_size(&chester));
+  ASSERT_EQ(state.size(), chester_save_state(&chester, state.data(), state.size()));
+  const std::string outputBeforeSaving(serialOutput);
+
+  EXPECT_EQ(PASSED, runUntilDone(chester, validator, 4 * 60));
+  const std::string expectedOutput(serialOutput);
+  const uint64_t expectedCycles = chester.cycles;
+
+  // Has to get to the end in the exact same way once more
+  ASSERT_TRUE(chester_load_state(&chester, state.data(), state.size()));
+  serialOutput = outputBeforeSaving;
+
+  EXPECT_EQ(PASSED, runUntilDone(chester, validator, 4 * 60));
+  EXPECT_EQ(expectedOutput, serialOutput);
+  EXPECT_EQ(expectedCycles, chester.cycles);
+
+  uninit(&chester);
+}
+
+// Writes a 32 KiB ROM of the given type and RAM size code to the temporary
+// directory, with the program at 0x0150
+static std::string writeRom(const char* romName, const std::vector<uint8_t>& program, uint8_t type, uint8_t ramSizeCode) {
+  std::vector<uint8_t> rom(0x8000, 0x00);
+  const std::vector<uint8_t> entry = {
+    0x00,             // NOP
+    0xC3, 0x50, 0x01  // JP 0x0150
+  };
+  std::copy(entry.begin(), entry.end(), rom.begin() + 0x100);
+  rom[0x147] = type;
+  rom[0x148] = 0x00;
+  rom[0x149] = ramSizeCode;
+  std::copy(program.begin(), program.end(), rom.begin() + 0x150);
+
+  const std::string romPath = testing::TempDir() + romName;
+  std::ofstream(romPath, std::ios::binary).write(reinterpret_cast<const char*>(rom.data()), rom.size());
+
+  return romPath;
+}
+
+// Writes a MBC1+RAM+BATTERY ROM with the given RAM size code, which
+// writes 0x10 + bank to the first byte and 0x20 + bank to the last one of
+// each of four RAM banks when asked to, then sends all of them back over
+// serial
+static std::string makeRom(const char* romName, uint8_t ramSizeCode, bool writeRam) {
+  std::vector<uint8_t> program = {
+    0xF3,             // DI
+    0x3E, 0x0A,       // LD A, 0x0A
+    0xEA, 0x00, 0x00, // LD (0x0000), A: enable RAM
+    0x3E, 0x01,       // LD A, 0x01
+    0xEA, 0x00, 0x60  // LD (0x6000), A: RAM banking mode
+  };
+  const auto selectBank = [&](uint8_t bank) {
+    program.insert(program.end(), {
+      0x3E, bank,       // LD A, bank
+      0xEA, 0x00, 0x40  // LD (0x4000), A
+    });
+  };
+  for (uint8_t bank = 0; writeRam && bank < 4; ++bank) {
+    selectBank(bank);
+    program.insert(program.end(), {
+      0x3E, static_cast<uint8_t>(0x10 + bank), // LD A, 0x10 + bank
+      0xEA, 0x00, 0xA0,                        // LD (0xA000), A
+      0x3E, static_cast<uint8_t>(0x20 + bank), // LD A, 0x20 + bank
+      0xEA, 0xFF, 0xBF                         // LD (0xBFFF), A
+    });
+  }
+  for (uint8_t bank = 0; bank < 4; ++bank) {
+    selectBank(bank);
+    program.insert(program.end(), {
+      0xFA, 0x00, 0xA0, // LD A, (0xA000)
+      0xEA, 0x01, 0xFF, // LD (0xFF01), A
+      0xFA, 0xFF, 0xBF, // LD A, (0xBFFF)
+      0xEA, 0x01, 0xFF  // LD (0xFF01), A
+    });
+  }
+  program.insert(program.end(), {
+    0x18, 0xFE        // JR -2
+  });
+
+  return writeRom(romName, program, 0x03, ramSizeCode);
+}
+
+static std::vector<uint8_t> readFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Runs the ROM made up with saves kept next to it, returning its output
+static std::string runMadeUpRom(const std::string& romPath) {
   chester chester;
   std::string serialOutput;
-  outputPtr = &serialOutput;
+  registerCallbacks(chester, serialOutput);
 
-  register_keys_callback(&chester, [](keys*) { return 0; });
-  register_get_ticks_callback(&chester, []() { return static_cast<uint32_t>(0); });
-  register_delay_callback(&chester, [](uint32_t) {});
-  register_gpu_init_callback(&chester, [](gpu*) { return true; });
-  register_gpu_uninit_callback(&chester, [](gpu*) {});
-  register_gpu_render_callback(&chester, [](gpu*) {});
-  register_gpu_alloc_image_buffer_callback(&chester, NULL);
-  register_serial_callback(&chester, serialListener);
+  EXPECT_TRUE(init(&chester, romPath.c_str(), testing::TempDir().c_str(), NULL));
+  run(&chester);
+  uninit(&chester);
 
-  const std::string romRoot(romType == BLARGG ?
-    BLARGGS_ROMS_DIR : GEKKIOS_ROMS_DIR);
-  ASSERT_TRUE(init(&chester, (romRoot + '/' + romPath).c_str(), NULL, NULL));
+  return serialOutput;
+}
+
+void runTestWritingCartRam(uint8_t ramSizeCode, const std::vector<uint8_t>& expectedOutput, size_t expectedSaveSize) {
+  const std::string romName = "cart-ram-" + std::to_string(ramSizeCode) + ".gb";
+  const std::string romPath = makeRom(romName.c_str(), ramSizeCode, true);
+  const std::string savePath = romPath + ".sav";
+  std::remove(savePath.c_str());
+
+  const std::string output = runMadeUpRom(romPath);
+  EXPECT_EQ(std::string(expectedOutput.begin(), expectedOutput.end()), output);
+
+  // Saved at the size in the header, nothing at all without RAM
+  const std::vector<uint8_t> save = readFile(savePath);
+  ASSERT_EQ(expectedSaveSize, save.size());
+  if (expectedSaveSize) {
+    const std::vector<uint8_t> expectedSave(expectedOutput.begin(), expectedOutput.end());
+    std::vector<uint8_t> saved;
+    for (size_t bank = 0; bank < 4; ++bank) {
+      const size_t offset = bank * 8192 % expectedSaveSize;
+      saved.push_back(save[offset]);
+      saved.push_back(save[offset + 8191]);
+    }
+    EXPECT_EQ(expectedSave, saved);
+  }
+
+  std::remove(savePath.c_str());
+  std::remove(romPath.c_str());
+}
+
+void runTestLoadingSave(uint8_t ramSizeCode, size_t saveSize) {
+  const std::string romName = "old-save-" + std::to_string(ramSizeCode) + ".gb";
+  const std::string romPath = makeRom(romName.c_str(), ramSizeCode, false);
+  const std::string savePath = romPath + ".sav";
+
+  std::vector<uint8_t> save(saveSize);
+  for (size_t i = 0; i < saveSize; ++i) {
+    save[i] = static_cast<uint8_t>(i * 7 + (i >> 13));
+  }
+  std::ofstream(savePath, std::ios::binary).write(reinterpret_cast<const char*>(save.data()), save.size());
+
+  // Only the start of the save gets read into RAM
+  std::string expectedOutput;
+  for (size_t bank = 0; bank < 4; ++bank) {
+    expectedOutput += static_cast<char>(save[bank * 8192]);
+    expectedOutput += static_cast<char>(save[bank * 8192 + 8191]);
+  }
+  EXPECT_EQ(expectedOutput, runMadeUpRom(romPath));
+
+  std::remove(savePath.c_str());
+  std::remove(romPath.c_str());
+}
+
+void runTestIdleLoop(const char* romName, const std::vector<uint8_t>& program, bool skipped) {
+  const std::string romPath = writeRom(romName, program, 0x00, 0x00);
+
+  chester chester;
+  std::string serialOutput;
+  registerCallbacks(chester, serialOutput);
+  ASSERT_TRUE(init(&chester, romPath.c_str(), NULL, NULL));
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(0, run(&chester));
+  }
+
+  if (skipped) {
+    EXPECT_GT(get_skipped_idle_cycles(&chester), 0u);
+  } else {
+    EXPECT_EQ(0u, get_skipped_idle_cycles(&chester));
+  }
+
+  uninit(&chester);
+  std::remove(romPath.c_str());
+}
+
+void runTestInChunks(RomType romType, const char* romPath, int runs) {
+  chester whole, chunked;
+  std::string wholeOutput, chunkedOutput;
+  ASSERT_TRUE(initRom(whole, romType, romPath, wholeOutput));
+  ASSERT_TRUE(initRom(chunked, romType, romPath, chunkedOutput));
+
+  const uint64_t total = static_cast<uint64_t>(runs) * (4194304 / 4);
+  ASSERT_EQ(0, run_until(&whole, whole.cycles + total));
+
+  // Chunks of any size, overshoot of each being taken off the next
+  std::mt19937 random(1);
+  std::uniform_int_distribution<unsigned int> chunkSize(1, 100000);
+  uint64_t budget = 0;
+  while (budget < total) {
+    const unsigned int cycles = static_cast<unsigned int>(std::min<uint64_t>(chunkSize(random), total - budget));
+    ASSERT_EQ(0, run_cycles(&chunked, cycles));
+    budget += cycles;
+  }
+
+  EXPECT_EQ(whole.cycles, chunked.cycles);
+  EXPECT_EQ(whole.overshoot, chunked.overshoot);
+  EXPECT_EQ(wholeOutput, chunkedOutput);
+
+  // Registers and memory are compared as saved
+  std::vector<uint8_t> wholeState(chester_state_size(&whole));
+  std::vector<uint8_t> chunkedState(chester_state_size(&chunked));
+  ASSERT_EQ(wholeState.size(), chester_save_state(&whole, wholeState.data(), wholeState.size()));
+  ASSERT_EQ(chunkedState.size(), chester_save_state(&chunked, chunkedState.data(), chunkedState.size()));
+  EXPECT_EQ(wholeState, chunkedState);
+
+  uninit(&chunked);
+  uninit(&whole);
+}
+
+void runTestByFrames(RomType romType, const char* romPath, unsigned int frames) {
+  chester chester;
+  std::string serialOutput;
+  ASSERT_TRUE(initRom(chester, romType, romPath, serialOutput));
+
+  unsigned int renders = 0;
+  register_gpu_render_callback(&chester, [](void* context, gpu*) {
+    ++*static_cast<unsigned int*>(context);
+  }, &renders);
+
+  uint64_t lastFrameCycles = 0;
+  for (unsigned int i = 0; i < frames; ++i) {
+    const unsigned int rendersBefore = renders;
+    ASSERT_EQ(0, run_frame(&chester));
+
+    // Returns right after the frame, which the next one starts from
+    if (chester.frame_rendered) {
+      EXPECT_EQ(rendersBefore + 1, renders) << "frame " << i;
+      EXPECT_EQ(0u, chester.overshoot) << "frame " << i;
+
+      // GPU modes drop the cycles run over, so frames run a bit longer
+      if (lastFrameCycles) {
+        EXPECT_GE(chester.cycles - lastFrameCycles, static_cast<uint64_t>(FRAME_CYCLES)) << "frame " << i;
+        EXPECT_LT(chester.cycles - lastFrameCycles, static_cast<uint64_t>(2 * FRAME_CYCLES)) << "frame " << i;
+      }
+      lastFrameCycles = chester.cycles;
+    } else {
+      EXPECT_EQ(rendersBefore, renders) << "frame " << i;
+      lastFrameCycles = 0;
+    }
+  }
+
+  // LCD stays on for most of the run
+  EXPECT_GT(renders, frames / 2);
+
+  uninit(&chester);
+}
+
+void runTestSavingTwoInstances(RomType romType, const char* romPath, int runsBeforeSaving) {
+  // Instances start from different garbage, as they may on the stack
+  chester first, second;
+  std::memset(&first, 0x55, sizeof first);
+  std::memset(&second, 0xAA, sizeof second);
+
+  std::string firstOutput, secondOutput;
+  ASSERT_TRUE(initRom(first, romType, romPath, firstOutput));
+  ASSERT_TRUE(initRom(second, romType, romPath, secondOutput));
+
+  for (int i = 0; i < runsBeforeSaving; ++i) {
+    run(&first);
+    run(&second);
+  }
+  ASSERT_EQ(first.cycles, second.cycles);
+
+  // Same state has to save the same bytes
+  std::vector<uint8_t> firstState(chester_state_size(&first));
+  std::vector<uint8_t> secondState(chester_state_size(&second));
+  ASSERT_EQ(firstState.size(), chester_save_state(&first, firstState.data(), firstState.size()));
+  ASSERT_EQ(secondState.size(), chester_save_state(&second, secondState.data(), secondState.size()));
+
+  ASSERT_EQ(firstState.size(), secondState.size());
+  for (size_t i = 0; i < firstState.size(); ++i) {
+    EXPECT_EQ(firstState[i], secondState[i]) << "offset " << i;
+  }
+
+  uninit(&second);
+  uninit(&first);
+}
+
+void runTestFromCheckpoint(RomType romType, const char* romPath, int runsBeforeMarking, unsigned int episodes) {
+  chester chester;
+  std::string serialOutput;
+  ASSERT_TRUE(initRom(chester, romType, romPath, serialOutput));
 
   const auto validator = getValidator(romType, serialOutput);
   ASSERT_TRUE(validator);
 
-  int i = 4 * 60;
-  Result result = UNINITIALIZED;
-  do {
+  for (int i = 0; i < runsBeforeMarking; ++i) {
     run(&chester);
-    result = validator();
-  } while(--i && result == ONGOING);
+  }
+  ASSERT_EQ(ONGOING, validator());
+
+  ASSERT_TRUE(chester_mark_checkpoint(&chester));
+  std::vector<uint8_t> expectedState(chester_state_size(&chester));
+  ASSERT_EQ(expectedState.size(), chester_save_state(&chester, expectedState.data(), expectedState.size()));
+  const std::string outputAtCheckpoint(serialOutput);
+
+  EXPECT_EQ(PASSED, runUntilDone(chester, validator, 4 * 60));
+  const std::string expectedOutput(serialOutput);
+  const uint64_t expectedCycles = chester.cycles;
+
+  // Every episode has to start from the exact same state and get to the
+  // end in the exact same way
+  std::vector<uint8_t> state(expectedState.size());
+  for (unsigned int i = 0; i < episodes; ++i) {
+    ASSERT_TRUE(chester_reset_to_checkpoint(&chester));
+    ASSERT_EQ(state.size(), chester_save_state(&chester, state.data(), state.size()));
+    EXPECT_EQ(expectedState, state) << "episode " << i;
+    serialOutput = outputAtCheckpoint;
+
+    EXPECT_EQ(PASSED, runUntilDone(chester, validator, 4 * 60)) << "episode " << i;
+    EXPECT_EQ(expectedOutput, serialOutput) << "episode " << i;
+    EXPECT_EQ(expectedCycles, chester.cycles) << "episode " << i;
+  }
+
+  uninit(&chester);
+}
+
+void runTestFromFork(RomType romType, const char* romPath, int runsBeforeForking) {
+  chester parent;
+  std::string parentOutput;
+  ASSERT_TRUE(initRom(parent, romType, romPath, parentOutput));
+
+  const auto parentValidator = getValidator(romType, parentOutput);
+  ASSERT_TRUE(parentValidator);
+
+  for (int i = 0; i < runsBeforeForking; ++i) {
+    run(&parent);
+  }
+  ASSERT_EQ(ONGOING, parentValidator());
+
+  chester child;
+  std::string childOutput(parentOutput);
+  registerCallbacks(child, childOutput);
+
+  if (!chester_fork(&parent, &child)) {
+    uninit(&child);
+    uninit(&parent);
+    FAIL() << "Could not fork";
+  }
+
+  const auto childValidator = getValidator(romType, childOutput);
+  Result childResult = UNINITIALIZED;
+  std::thread childThread([&]() {
+    childResult = runUntilDone(child, childValidator, 4 * 60);
+  });
+
+  const Result parentResult = runUntilDone(parent, parentValidator, 4 * 60);
+  childThread.join();
+
+  // Both have to get to the end in the exact same way
+  EXPECT_EQ(PASSED, parentResult);
+  EXPECT_EQ(PASSED, childResult);
+  EXPECT_EQ(parentOutput, childOutput);
+  EXPECT_EQ(parent.cycles, child.cycles);
+
+  uninit(&child);
+  uninit(&parent);
+}
+
+void runTestWithRewind(RomType romType, const char* romPath, unsigned int framesBeforeRewinding) {
+  chester chester;
+  std::string serialOutput;
+  ASSERT_TRUE(initRom(chester, romType, romPath, serialOutput));
+
+  const auto validator = getValidator(romType, serialOutput);
+  ASSERT_TRUE(validator);
+
+  const unsigned int interval = 10;
+  ASSERT_TRUE(chester_rewind_enable(&chester, interval, 1 << 20));
+
+  // Snapshot is taken of the frame which run_frame() returns after
+  const unsigned int frames = framesBeforeRewinding - framesBeforeRewinding % interval;
+  unsigned int rendered = 0;
+  while (rendered < frames) {
+    run_frame(&chester);
+    rendered += chester.frame_rendered;
+  }
+
+  std::vector<uint8_t> expected(chester_state_size(&chester));
+  ASSERT_EQ(expected.size(), chester_save_state(&chester, expected.data(), expected.size()));
+
+  while (rendered < 2 * frames) {
+    run_frame(&chester);
+    rendered += chester.frame_rendered;
+  }
+
+  // Has to get back to the exact same state
+  EXPECT_EQ(frames, chester_rewind(&chester, frames));
+  std::vector<uint8_t> state(expected.size());
+  ASSERT_EQ(state.size(), chester_save_state(&chester, state.data(), state.size()));
+  EXPECT_EQ(expected, state);
 
-  EXPECT_EQ(PASSED, result);
+  EXPECT_EQ(PASSED, runUntilDone(chester, validator, 4 * 60));
 
   uninit(&chester);
 }
@@ -1,8 +1,57 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 enum RomType {
   BLARGG,
   GEKKIO
 };
 
 void runTest(RomType romType, const char* romPath);
+
+// Runs the ROM alone, then on the given number of threads at the same
+// time, each thread having its own instance
+void runTestOnThreads(RomType romType, const char* romPath, unsigned int threadCount);
+
+// Runs the ROM for a while and saves its state, then runs it to the end
+// twice: on from there, and once more after loading the state
+void runTestFromSavedState(RomType romType, const char* romPath, int runsBeforeSaving);
+
+// Runs a ROM made up with the given RAM size code in its header, which
+// writes four RAM banks and reads them back over serial. Both the output
+// and the .sav written then have to be as expected.
+void runTestWritingCartRam(uint8_t ramSizeCode, const std::vector<uint8_t>& expectedOutput, size_t expectedSaveSize);
+
+// Runs a ROM made up with the given RAM size code in its header, with a
+// .sav of the given size to load, which has to be read back from the start
+void runTestLoadingSave(uint8_t ramSizeCode, size_t saveSize);
+
+// Runs a ROM made up of the program, which loops forever, and checks
+// whether cycles were skipped in idle loops
+void runTestIdleLoop(const char* romName, const std::vector<uint8_t>& program, bool skipped);
+
+// Runs the ROM for a while on two instances, one in one go and the other
+// in chunks of random sizes, which have to end up in the same state
+void runTestInChunks(RomType romType, const char* romPath, int runs);
+
+// Runs the ROM frame by frame, each run having to return right after
+// rendering a single frame
+void runTestByFrames(RomType romType, const char* romPath, unsigned int frames);
+
+// Runs the ROM for a while on two instances and saves the state of both,
+// which has to be the same bytes
+void runTestSavingTwoInstances(RomType romType, const char* romPath, int runsBeforeSaving);
+
+// Runs the ROM for a while and marks a checkpoint, then runs it to the
+// end once and once more for each episode reset to the checkpoint
+void runTestFromCheckpoint(RomType romType, const char* romPath, int runsBeforeMarking, unsigned int episodes);
+
+// Runs the ROM for a while and forks it, then runs both instances to the
+// end at the same time, each on its own thread
+void runTestFromFork(RomType romType, const char* romPath, int runsBeforeForking);
+
+// Runs the ROM with rewinding enabled, going back to a frame seen before
+// and on to the end from there
+void runTestWithRewind(RomType romType, const char* romPath, unsigned int framesBeforeRewinding);